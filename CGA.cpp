@@ -102,8 +102,8 @@ void CGA::initScreen() {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create renderer: %s", SDL_GetError());
         return;
     }
-//    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, PC_WIDTH, PC_HEIGHT);
-//    SDL_SetRenderTarget(renderer, texture);
+    texture = nullptr;
+    createScreenTexture();
     SDL_SetRenderDrawColor(renderer, 0x00, 255, 0x00, 0x00);
     SDL_RenderClear(renderer);
     // load font
@@ -131,6 +131,16 @@ void CGA::initScreen() {
     createFontCache();
 }
 
+// Text is drawn into a texture that keeps it from frame to frame,
+// since what's presented can't be counted on to still be there
+void CGA::createScreenTexture() {
+    if (texture != nullptr) {
+        SDL_DestroyTexture(texture);
+    }
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, pcWidth, pcHeight);
+    redrawAll = true;
+}
+
 #define MILLI_PER_FRAME 16
 
 void CGA::renderLoop() {
@@ -157,6 +167,16 @@ void CGA::renderLoop() {
                 case SDL_KEYUP:
                     ppi.keyboardUp(e.key.keysym);
                     break;
+                case SDL_WINDOWEVENT:
+                    // the window's contents are gone, so the next frame redraws and presents them all
+                    if (e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                        redrawAll = true;
+                    }
+                    break;
+                case SDL_RENDER_TARGETS_RESET:
+                case SDL_RENDER_DEVICE_RESET:
+                    redrawAll = true; // and so is the screen texture's
+                    break;
                 default:
                     break;
             }
@@ -165,6 +185,7 @@ void CGA::renderLoop() {
         if (modeChanged) {
             modeChanged = false;
             SDL_SetWindowSize(window, pcWidth, pcHeight);
+            createScreenTexture();
         }
         
         if (difference > MILLI_PER_FRAME) { // roughly 60 fps
@@ -206,26 +227,38 @@ void CGA::renderScreen(uint32_t timing) {
     } else {
         bgColor = colorPalette[0];
     }
-    SDL_SetRenderDrawColor(renderer, bgColor.r, bgColor.g, bgColor.b, 255);
-    SDL_RenderClear(renderer);
     if (graphicsMode) {
+        SDL_SetRenderDrawColor(renderer, bgColor.r, bgColor.g, bgColor.b, 255);
+        SDL_RenderClear(renderer);
+        redrawAll = true;
         return;
     } else { // text mode
+        if (!memory.isReadable(CGA_BASE_MEMORY_LOCATION, MAX_TEXT_CELLS * 2)) {
+            return;
+        }
+        const byte *cells = memory.readBlock(CGA_BASE_MEMORY_LOCATION);
         const int cursorLocation = ((int)registers6845[0xE] << 8) | ((int)registers6845[0xF]);
-        const byte cursorRow = cursorLocation / numColumns;
-        const byte cursorColumn = cursorLocation - (cursorRow * numColumns);
+        // if text mode, draw cursor every half second
+        const int cursor = ((timing % 1000) > 500) ? cursorLocation : -1;
         cellWidth = pcWidth / numColumns;
         cellHeight = pcHeight / NUM_ROWS;
+        bool changed = redrawAll;
+        SDL_SetRenderTarget(renderer, texture);
         for (int row = 0; row < NUM_ROWS; row++) {
             horizontalRetraceEnd();
             
             for (int column = 0; column < numColumns; column++) {
-                const address memLocation = CGA_BASE_MEMORY_LOCATION + (row * (numColumns * 2)) + column * 2;
-                const byte character = memory.readByte(memLocation);
-                // cout << character;
-                const byte attribute = memory.readByte(memLocation + 1);
-                // if text mode, draw cursor every half second
-                if (cursorColumn == column && cursorRow == row && ((timing % 1000) > 500)) {
+                const int cell = row * numColumns + column;
+                const byte character = cells[cell * 2];
+                const byte attribute = cells[cell * 2 + 1];
+                if (!redrawAll && shownCells[cell * 2] == character && shownCells[cell * 2 + 1] == attribute
+                    && (cell == cursor) == (cell == shownCursor)) {
+                    continue;
+                }
+                shownCells[cell * 2] = character;
+                shownCells[cell * 2 + 1] = attribute;
+                changed = true;
+                if (cell == cursor) {
                     drawCharacter(row, column, 219, (attribute&0xF0) | 15);
                 } else {
                     drawCharacter(row, column, character, attribute);
@@ -233,7 +266,14 @@ void CGA::renderScreen(uint32_t timing) {
             }
             horizontalRetraceStart();
         }
+        SDL_SetRenderTarget(renderer, NULL);
+        shownCursor = cursor;
+        redrawAll = false;
+        if (!changed) {
+            return; // same as last frame
+        }
     }
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
     SDL_RenderPresent(renderer);
 }
 
@@ -282,10 +322,6 @@ void CGA::horizontalRetraceEnd() {
 }
 
 inline void CGA::drawCharacter(byte row, byte column, byte character, byte attribute) {
-    // Can't draw non-characters
-    if (character == 0) {
-        return;
-    }
     // some monitors/bios treat color and black and white modes both as color, so we'll try that here
     SDL_Color bgColor = colorPalette[highNibble(attribute)];
     int fgColor = lowNibble(attribute);
@@ -297,7 +333,10 @@ inline void CGA::drawCharacter(byte row, byte column, byte character, byte attri
     // draw background of text cell
     SDL_SetRenderDrawColor(renderer, bgColor.r, bgColor.g, bgColor.b, bgColor.a);
     SDL_RenderFillRect(renderer, &rect);
-    // draw text in foreground
+    // draw text in foreground, if it's a character that can be drawn
+    if (character == 0) {
+        return;
+    }
     
     char text = ((char)character);
 //    text = ((char)row * numColumns + column) + 1;
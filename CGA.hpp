@@ -34,6 +34,7 @@ namespace DK86PC {
 #define NUM_CHARACTERS 256
 #define NUM_COLORS 16
 #define NUM_6845_REGISTERS 18
+#define MAX_TEXT_CELLS (80 * 25)
 
 class CGA {
 public:
@@ -64,6 +65,7 @@ public:
     void set6845RegisterValue(byte value);
 private:
     inline void drawCharacter(byte row, byte column, byte character, byte attribute);
+    void createScreenTexture();
     void createFontCache();
     void freeFontCache();
     Memory &memory;
@@ -89,6 +91,11 @@ private:
     SDL_Texture *fontCache[NUM_COLORS][NUM_CHARACTERS];
     byte registers6845[NUM_6845_REGISTERS];
     byte registerIndex6845;
+    // What's on the screen texture already, so a frame only redraws the
+    // text cells that changed and isn't presented at all if none did
+    byte shownCells[MAX_TEXT_CELLS * 2];
+    int shownCursor = -1; // cell the blinking cursor is drawn over, -1 if it's blinked off
+    bool redrawAll = true;
 };
 
 }
@@ -18,9 +18,12 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "Instructions.h"
+#include "OperandLayouts.h"
 #include "CPU.hpp"
+#include "Hypercalls.hpp"
 #include <iostream>
 #include <iomanip>
+#include <cstring>
 
 using namespace std;
 
@@ -29,7 +32,142 @@ namespace DK86PC {
     
     
     // Utility Stuff
-    #define NEXT_INSTRUCTION ((((address)cs) << 4) + ip)
+    #define NEXT_INSTRUCTION (csBase + ip)
+    
+    // Timings are from the 8086 manual, plus 4 clocks for each word the 8088's
+    // 8 bit bus has to move to or from memory. Where it gives a range, the
+    // fastest is used.
+    // 8088 clocks for each opcode with a register operand (or none at all)
+    static constexpr byte registerCycles[256] = {
+        /* 0_ */ 3, 3, 3, 3, 4, 4, 14, 12, 3, 3, 3, 3, 4, 4, 14, 4,
+        /* 1_ */ 3, 3, 3, 3, 4, 4, 14, 12, 3, 3, 3, 3, 4, 4, 14, 12,
+        /* 2_ */ 3, 3, 3, 3, 4, 4, 2, 4, 3, 3, 3, 3, 4, 4, 2, 4,
+        /* 3_ */ 3, 3, 3, 3, 4, 4, 2, 8, 3, 3, 3, 3, 4, 4, 2, 8,
+        /* 4_ */ 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+        /* 5_ */ 15, 15, 15, 15, 15, 15, 15, 15, 12, 12, 12, 12, 12, 12, 12, 12,
+        /* 6_ */ 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        /* 7_ */ 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        /* 8_ */ 4, 4, 4, 4, 3, 3, 4, 4, 2, 2, 2, 2, 2, 2, 2, 12,
+        /* 9_ */ 3, 3, 3, 3, 3, 3, 3, 3, 2, 5, 36, 4, 14, 12, 4, 4,
+        /* A_ */ 10, 14, 10, 14, 18, 26, 22, 30, 4, 4, 11, 15, 12, 16, 15, 19,
+        /* B_ */ 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        /* C_ */ 4, 4, 24, 20, 2, 2, 4, 4, 4, 4, 33, 34, 72, 71, 4, 44,
+        /* D_ */ 2, 2, 8, 8, 83, 60, 4, 11, 2, 2, 2, 2, 2, 2, 2, 2,
+        /* E_ */ 5, 6, 5, 6, 10, 14, 10, 14, 23, 15, 15, 15, 8, 12, 8, 12,
+        /* F_ */ 2, 4, 2, 2, 2, 2, 5, 5, 2, 2, 2, 2, 2, 2, 3, 3,
+    };
+
+    // 8088 clocks for each ModRM opcode with a memory operand, not counting the EA calculation
+    static constexpr byte memoryCycles[256] = {
+        /* 0_ */ 16, 24, 9, 13, 0, 0, 0, 0, 16, 24, 9, 13, 0, 0, 0, 0,
+        /* 1_ */ 16, 24, 9, 13, 0, 0, 0, 0, 16, 24, 9, 13, 0, 0, 0, 0,
+        /* 2_ */ 16, 24, 9, 13, 0, 0, 0, 0, 16, 24, 9, 13, 0, 0, 0, 0,
+        /* 3_ */ 16, 24, 9, 13, 0, 0, 0, 0, 9, 13, 9, 13, 0, 0, 0, 0,
+        /* 4_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 5_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 6_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 7_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 8_ */ 17, 25, 17, 25, 9, 13, 17, 25, 9, 13, 8, 12, 13, 2, 12, 25,
+        /* 9_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* A_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* B_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* C_ */ 0, 0, 0, 0, 24, 24, 10, 14, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* D_ */ 15, 23, 20, 28, 0, 0, 0, 0, 8, 8, 8, 8, 8, 8, 8, 8,
+        /* E_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* F_ */ 0, 0, 0, 0, 0, 0, 11, 15, 0, 0, 0, 0, 0, 0, 15, 23,
+    };
+
+    // Members of these groups take different amounts of time:
+    // 80/82, 81/83, F6, F7 and FF, see groupCycleIndex()
+    static constexpr byte groupRegisterCycles[5][8] = {
+        {4, 4, 4, 4, 4, 4, 4, 4},
+        {4, 4, 4, 4, 4, 4, 4, 4},
+        {5, 5, 3, 3, 70, 80, 80, 101},
+        {5, 5, 3, 3, 118, 128, 144, 165},
+        {3, 3, 20, 20, 11, 11, 15, 15},
+    };
+    static constexpr byte groupMemoryCycles[5][8] = {
+        {17, 17, 17, 17, 17, 17, 17, 10},
+        {25, 25, 25, 25, 25, 25, 25, 14},
+        {11, 11, 16, 16, 76, 86, 86, 107},
+        {15, 15, 24, 24, 128, 138, 154, 175},
+        {23, 23, 29, 53, 22, 32, 24, 24},
+    };
+    
+    // Effective address calculation clocks by mod and rm
+    static constexpr byte eaCycles[3][8] = {
+        {7, 8, 8, 7, 5, 5, 6, 5},
+        {11, 12, 12, 11, 9, 9, 9, 9},
+        {11, 12, 12, 11, 9, 9, 9, 9},
+    };
+    
+    #define PREFIX_CYCLES 2
+    
+    // REP string instructions (A4-A7, AA-AF) take REPEAT_START_CYCLES, REP
+    // included, then these for each repetition
+    static constexpr byte repeatCycles[12] = {17, 25, 22, 30, 0, 0, 10, 14, 13, 17, 15, 19};
+    #define REPEAT_START_CYCLES 9
+    
+    static constexpr int groupCycleIndex(byte opcode) {
+        switch (opcode) {
+            case 0x80: case 0x82: return 0;
+            case 0x81: case 0x83: return 1;
+            case 0xF6: return 2;
+            case 0xF7: return 3;
+            case 0xFF: return 4;
+            default: return -1;
+        }
+    }
+    
+    // 8088 clocks for an instruction as decoded, not counting taken jumps,
+    // repeats or shifts by CL; modrm only matters if the opcode has one
+    static constexpr word instructionCycles(byte opcode, byte modrm, byte prefixCount, bool repeatCX) {
+        word cycles = registerCycles[opcode];
+        if (operandLayouts[opcode] & MODRM) {
+            const byte mod = modrm >> 6;
+            const byte reg = (modrm >> 3) & 0b111;
+            const byte rm = modrm & 0b111;
+            const int group = groupCycleIndex(opcode);
+            if (mod == 0b11) {
+                if (group >= 0) {
+                    cycles = groupRegisterCycles[group][reg];
+                }
+            } else {
+                cycles = ((group >= 0) ? groupMemoryCycles[group][reg] : memoryCycles[opcode]) + eaCycles[mod][rm];
+            }
+        }
+        cycles += prefixCount * PREFIX_CYCLES;
+        if (repeatCX && opcode >= 0xA4 && opcode <= 0xAF && repeatCycles[opcode - 0xA4] != 0) {
+            // charged for the first repetition up front, taken back by emptyRepeat()
+            cycles = REPEAT_START_CYCLES + repeatCycles[opcode - 0xA4] + (prefixCount - 1) * PREFIX_CYCLES;
+        }
+        return cycles;
+    }
+    
+    // Which FusedPair an instruction makes with the opcode byte right after it.
+    // Only unprefixed followers count, so next is the follower's own opcode.
+    static inline byte fuseKind(const DecodedInstruction &decoded, byte next) {
+        const byte opcode = decoded.opcode;
+        if (decoded.repeatCX || decoded.lock) {
+            return FUSE_NONE;
+        }
+        if (next >= 0x60 && next <= 0x7F) { // Jcc or its 60-6F alias
+            const byte reg = ModRegRM(decoded.modrm).reg;
+            if ((opcode >= 0x38 && opcode <= 0x3D) || (opcode >= 0x28 && opcode <= 0x2D) || // CMP, SUB
+                (opcode >= 0x84 && opcode <= 0x85) || (opcode >= 0xA8 && opcode <= 0xA9) || // TEST
+                (opcode >= 0x40 && opcode <= 0x4F) || // INC/DEC reg
+                (opcode >= 0x80 && opcode <= 0x83 && (reg == 0b111 || reg == 0b101))) { // CMP/SUB imm
+                return FUSE_JUMP;
+            }
+        }
+        if ((opcode == 0xAC || opcode == 0xAD) && next == opcode - 2) { // LODS, STOS
+            return FUSE_NEXT;
+        }
+        if ((opcode & 0xF8) == (next & 0xF8) && (opcode >= 0x50 && opcode <= 0x5F)) { // PUSH, PUSH or POP, POP
+            return FUSE_NEXT;
+        }
+        return FUSE_NONE;
+    }
     
     inline void CPU::setSignFlagByte(byte data) {
         if (highBitByte(data)) {
@@ -84,244 +222,201 @@ namespace DK86PC {
         nothing3 = 0;
         nothing4 = 1;
     }
+
+    // Lazy flags: the ALU helpers only note their operands and result, and
+    // each arithmetic flag is worked out from those when something reads it
+    inline bool CPU::getCarry() {
+        switch (lazyOp) {
+            case LAZY_NONE:
+                return carry;
+            case LAZY_ADD8:
+                return ((word)lazyLeft + (word)lazyRight + lazyCarryIn) > 0x00FF;
+            case LAZY_ADD16:
+                return ((uint32_t)lazyLeft + (uint32_t)lazyRight + lazyCarryIn) > 0x0000FFFF;
+            case LAZY_SUB8:
+            case LAZY_SUB16:
+                return ((uint32_t)lazyRight + lazyCarryIn) > lazyLeft;
+            case LAZY_INC8:
+            case LAZY_INC16:
+            case LAZY_DEC8:
+            case LAZY_DEC16:
+                return lazyKept;
+            default: // logic
+                return false;
+        }
+    }
     
-    inline word CPU::getRegWord(byte reg) {
-        switch (reg) {
-            case 0b000:        // w = 1
-                return ax;
-                break;
-            case 0b001:
-                return cx;
-                break;
-            case 0b010:
-                return Dx;
-                break;
-            case 0b011:
-                return bx;
-                break;
-            case 0b100:
-                return sp;
-                break;
-            case 0b101:
-                return bp;
-                break;
-            case 0b110:
-                return si;
-                break;
-            case 0b111:
-                return di;
-                break;
+    inline bool CPU::getParity() {
+        if (lazyOp == LAZY_NONE) {
+            return parity;
         }
-        
-        return 0;
+        byte tested = lowByte(lazyResult);
+        tested ^= tested >> 4;
+        tested ^= tested >> 2;
+        tested ^= tested >> 1;
+        return (~tested) & 1;
     }
     
-    inline byte CPU::getRegByte(byte reg) {
-        switch (reg) {
-            case 0b000:         // w = 0
-                return al;
-                break;
-            case 0b001:
-                return cl;
-                break;
-            case 0b010:
-                return dl;
-                break;
-            case 0b011:
-                return bl;
-                break;
-            case 0b100:
-                return ah;
-                break;
-            case 0b101:
-                return Ch;
-                break;
-            case 0b110:
-                return dh;
-                break;
-            case 0b111:
-                return bh;
-                break;
+    inline bool CPU::getAuxiliaryCarry() {
+        switch (lazyOp) {
+            case LAZY_NONE:
+                return auxiliaryCarry;
+            case LAZY_ADD8:
+            case LAZY_ADD16:
+            case LAZY_SUB8:
+            case LAZY_SUB16:
+                return ((lazyLeft ^ lazyRight ^ lazyResult) & 0x10) != 0;
+            case LAZY_INC8:
+            case LAZY_INC16:
+                return lowNibble(lazyResult) == 0;
+            case LAZY_DEC8:
+            case LAZY_DEC16:
+                return lowNibble(lazyResult) == 0x0F;
+            default: // logic leaves it alone
+                return lazyKept;
         }
-        
-        return 0;
     }
     
-    inline address CPU::calcEffectiveAddress(ModRegRM mrr) {
-        word disp = 0;
-        if (mrr.mod == 0b01) {
-            disp = signExtend(memory.readByte(NEXT_INSTRUCTION + 2));
-        } else if (mrr.mod == 0b10) {
-            disp = memory.readWord(NEXT_INSTRUCTION + 2);
+    inline bool CPU::getZero() {
+        if (lazyOp == LAZY_NONE) {
+            return zero;
         }
-        
-        address ea = bx + si + disp; // 0b000
-        switch (mrr.rm) {
-            case 0b000:
-                ea = bx + si + disp;
-                break;
-            case 0b001:
-                ea = bx + di + disp;
-                break;
-            case 0b010:
-                ea = bp + si + disp;
-                break;
-            case 0b011:
-                ea = bp + di + disp;
-                break;
-            case 0b100:
-                ea = si + disp;
-                break;
-            case 0b101:
-                ea = di + disp;
-                break;
-            case 0b110:
-                if (mrr.mod == 0b00) {
-                    ea = memory.readWord(NEXT_INSTRUCTION + 2); // direct addressing
-                } else {
-                    ea = bp + disp;
-                }
-                break;
-            case 0b111:
-                ea = bx + disp;
-                break;
+        return lazyResult == 0;
+    }
+    
+    inline bool CPU::getSign() {
+        if (lazyOp == LAZY_NONE) {
+            return sign;
+        }
+        return (lazyOp & LAZY_WORD) ? highBitWord(lazyResult) : highBitByte(lazyResult);
+    }
+    
+    inline bool CPU::getOverflow() {
+        const word highBit = (lazyOp & LAZY_WORD) ? 0x8000 : 0x80;
+        switch (lazyOp) {
+            case LAZY_NONE:
+                return overflow;
+            case LAZY_ADD8:
+            case LAZY_ADD16:
+                return ((lazyLeft ^ lazyResult) & (lazyRight ^ lazyResult) & highBit) != 0;
+            case LAZY_SUB8:
+            case LAZY_SUB16:
+                return ((lazyLeft ^ lazyRight) & (lazyLeft ^ lazyResult) & highBit) != 0;
+            case LAZY_INC8:
+            case LAZY_INC16:
+                return lazyResult == highBit;
+            case LAZY_DEC8:
+            case LAZY_DEC16:
+                return lazyResult == highBit - 1;
+            default: // logic
+                return false;
+        }
+    }
+    
+    // Write the arithmetic flags out to the flags word, for anything that
+    // reads or changes it as a whole or sets individual flags itself
+    inline void CPU::materializeFlags() {
+        if (lazyOp == LAZY_NONE) {
+            return;
+        }
+        const bool newCarry = getCarry();
+        const bool newParity = getParity();
+        const bool newAuxiliaryCarry = getAuxiliaryCarry();
+        const bool newZero = getZero();
+        const bool newSign = getSign();
+        const bool newOverflow = getOverflow();
+        carry = newCarry;
+        parity = newParity;
+        auxiliaryCarry = newAuxiliaryCarry;
+        zero = newZero;
+        sign = newSign;
+        overflow = newOverflow;
+        lazyOp = LAZY_NONE;
+    }
+    
+    inline word CPU::getRegWord(byte reg) {
+        return registers[reg];
+    }
+    
+    inline byte CPU::getRegByte(byte reg) {
+        return registerBytes[byteRegisterIndex[reg]];
+    }
+    
+    // One of these is made for each mod/rm combination, so the registers and
+    // displacement to add up are fixed at compile time rather than switched on
+    template <byte MOD, byte RM>
+    word CPU::effectiveAddress(const CPU &cpu, const DecodedInstruction &decoded) {
+        if (MOD == 0b00 && RM == 0b110) {
+            return decoded.displacement; // direct addressing
+        }
+        word ea;
+        switch (RM) {
+            case 0b000: ea = cpu.bx + cpu.si; break;
+            case 0b001: ea = cpu.bx + cpu.di; break;
+            case 0b010: ea = cpu.bp + cpu.si; break;
+            case 0b011: ea = cpu.bp + cpu.di; break;
+            case 0b100: ea = cpu.si; break;
+            case 0b101: ea = cpu.di; break;
+            case 0b110: ea = cpu.bp; break;
+            default: ea = cpu.bx; break;
+        }
+        if (MOD == 0b01 || MOD == 0b10) {
+            ea += decoded.displacement; // already sign extended for mod 01
         }
-        return ea & 0xFFFF;
+        return ea;
+    }
+    
+    // mod 11 is a register operand, but LEA/LES/LDS with one still shouldn't crash
+    const AddressKernel CPU::addressKernels[4][8] = {
+        {&CPU::effectiveAddress<0, 0>, &CPU::effectiveAddress<0, 1>, &CPU::effectiveAddress<0, 2>, &CPU::effectiveAddress<0, 3>,
+         &CPU::effectiveAddress<0, 4>, &CPU::effectiveAddress<0, 5>, &CPU::effectiveAddress<0, 6>, &CPU::effectiveAddress<0, 7>},
+        {&CPU::effectiveAddress<1, 0>, &CPU::effectiveAddress<1, 1>, &CPU::effectiveAddress<1, 2>, &CPU::effectiveAddress<1, 3>,
+         &CPU::effectiveAddress<1, 4>, &CPU::effectiveAddress<1, 5>, &CPU::effectiveAddress<1, 6>, &CPU::effectiveAddress<1, 7>},
+        {&CPU::effectiveAddress<2, 0>, &CPU::effectiveAddress<2, 1>, &CPU::effectiveAddress<2, 2>, &CPU::effectiveAddress<2, 3>,
+         &CPU::effectiveAddress<2, 4>, &CPU::effectiveAddress<2, 5>, &CPU::effectiveAddress<2, 6>, &CPU::effectiveAddress<2, 7>},
+        {&CPU::effectiveAddress<3, 0>, &CPU::effectiveAddress<3, 1>, &CPU::effectiveAddress<3, 2>, &CPU::effectiveAddress<3, 3>,
+         &CPU::effectiveAddress<3, 4>, &CPU::effectiveAddress<3, 5>, &CPU::effectiveAddress<3, 6>, &CPU::effectiveAddress<3, 7>}
+    };
+    
+    inline address CPU::calcEffectiveAddress() {
+        return currentInstruction->addressKernel(*this, *currentInstruction);
     }
 
-    inline address CPU::calcPhysicalAddress(ModRegRM mrr) {
-        address ea = calcEffectiveAddress(mrr);
-        // bp implicitly should use ss
-        // maybe should allow bp to be overridden
-        word *segment = ((mrr.rm == 0b010 || mrr.rm == 0b011 || (mrr.rm == 0b110 && mrr.mod != 0b00)) && !segmentOverride) ? &ss : currentSegment;
-        address pa = ((*segment << 4) + ea); // physical address
-        return pa;
+    // the segment (SS for bp based addressing, unless overridden) was settled at decode time
+    inline address CPU::calcPhysicalAddress() {
+        return (segments[currentInstruction->addressSegment] << 4) + calcEffectiveAddress();
     }
     
     inline word CPU::getModRMWord(ModRegRM mrr) {
         if (mrr.mod == 0b11) {
             return getRegWord(mrr.rm);
         }
-        return memory.readWord(calcPhysicalAddress(mrr));
+        return memory.readWord(calcPhysicalAddress());
     }
     
     inline byte CPU::getModRMByte(ModRegRM mrr) {
         if (mrr.mod == 0b11) {
             return getRegByte(mrr.rm);
         }
-        return memory.readByte(calcPhysicalAddress(mrr));
+        return memory.readByte(calcPhysicalAddress());
     }
     
+    // reg is the low nibble of a MOV immediate opcode, so bit 3 is w
     template <typename T>
     inline void CPU::setReg(byte reg, T data) {
-        switch (reg) {
-            case 0b000:         // w = 0
-                al = data;
-                break;
-            case 0b001:
-                cl = data;
-                break;
-            case 0b010:
-                dl = data;
-                break;
-            case 0b011:
-                bl = data;
-                break;
-            case 0b100:
-                ah = data;
-                break;
-            case 0b101:
-                Ch = data;
-                break;
-            case 0b110:
-                dh = data;
-                break;
-            case 0b111:
-                bh = data;
-                break;
-            case 0b1000:        // w = 1
-                ax = data;
-                break;
-            case 0b1001:
-                cx = data;
-                break;
-            case 0b1010:
-                Dx = data;
-                break;
-            case 0b1011:
-                bx = data;
-                break;
-            case 0b1100:
-                sp = data;
-                break;
-            case 0b1101:
-                bp = data;
-                break;
-            case 0b1110:
-                si = data;
-                break;
-            case 0b1111:
-                di = data;
-                break;
+        if (reg & 0b1000) {
+            registers[reg & 0b111] = data;
+        } else {
+            registerBytes[byteRegisterIndex[reg]] = data;
         }
     }
     
     inline void CPU::setRegByte(byte reg, byte data) {
-        switch (reg) {
-            case 0b000:         // w = 0
-                al = data;
-                break;
-            case 0b001:
-                cl = data;
-                break;
-            case 0b010:
-                dl = data;
-                break;
-            case 0b011:
-                bl = data;
-                break;
-            case 0b100:
-                ah = data;
-                break;
-            case 0b101:
-                Ch = data;
-                break;
-            case 0b110:
-                dh = data;
-                break;
-            case 0b111:
-                bh = data;
-                break;
-        }
+        registerBytes[byteRegisterIndex[reg]] = data;
     }
     
     inline void CPU::setRegWord(byte reg, word data) {
-        switch (reg) {
-            case 0b000:        // w = 1
-                ax = data;
-                break;
-            case 0b001:
-                cx = data;
-                break;
-            case 0b010:
-                Dx = data;
-                break;
-            case 0b011:
-                bx = data;
-                break;
-            case 0b100:
-                sp = data;
-                break;
-            case 0b101:
-                bp = data;
-                break;
-            case 0b110:
-                si = data;
-                break;
-            case 0b111:
-                di = data;
-                break;
-        }
+        registers[reg] = data;
     }
     
     inline void CPU::setModRMByte(ModRegRM mrr, byte data) {
@@ -330,7 +425,7 @@ namespace DK86PC {
             return;
         }
         
-        address pa = calcPhysicalAddress(mrr); // physical address
+        address pa = calcPhysicalAddress(); // physical address
         memory.setByte(pa, data);
     }
     
@@ -340,63 +435,154 @@ namespace DK86PC {
             return;
         }
         
-        address pa = calcPhysicalAddress(mrr); // physical address
+        address pa = calcPhysicalAddress(); // physical address
         memory.setWord(pa, data);
     }
     
-    // increment instruction length if necessary
-    inline void CPU::modInstructionLength(ModRegRM mrr, byte &il) {
-        if (mrr.mod == 0b01) {
-            il += 1;
-        } else if (mrr.mod == 0b10) {
-            il += 2;
-        } else if (mrr.mod == 0b00 && mrr.rm == 0b110) {
-            il += 2;
-        }
-    }
-
     inline word CPU::getSegmentRegWord(byte reg) {
-        switch (reg) {
-            case 0b000:        // w = 1
-                return es;
-                break;
-            case 0b001:
-                return cs;
-                break;
-            case 0b010:
-                return ss;
-                break;
-            case 0b011:
-                return ds;
-                break;
-            default:
-                cout << "invalid segment register" << endl;
-                return ds;
+        if (reg > 0b011) {
+            cout << "invalid segment register" << endl;
+            return ds;
         }
+        return segments[reg];
     }
 
     inline void CPU::setSegmentRegWord(byte reg, word data) {
-        switch (reg) {
-            case 0b000:        // w = 1
-                es = data;
-                break;
-            case 0b001:
-                cs = data;
-                break;
-            case 0b010:
-                ss = data;
-                break;
-            case 0b011:
-                ds = data;
-                break;
-            default:
-                cout << "invalid segment register" << endl;
-                return;
+        if (reg > 0b011) {
+            cout << "invalid segment register" << endl;
+            return;
+        }
+        if (reg == 0b01) {
+            setCS(data);
+            return;
+        }
+        segments[reg] = data;
+    }
+    
+    inline word *CPU::segmentRegister(byte reg) {
+        return &segments[reg & 0b11];
+    }
+    
+    // Little endian word at offset in a window of code
+    static inline word windowWord(const byte *window, byte offset) {
+        return (((word)window[offset + 1]) << 8) | window[offset];
+    }
+    
+    // Pull a whole instruction (prefixes, ModRM, displacement, immediates) out of memory.
+    // After its prefixes an instruction is at most 6 bytes, so it and the opcode
+    // after it (for fusing) always fit in one FETCH_WINDOW.
+    void CPU::decode(address location, DecodedInstruction &decoded) {
+        decoded = DecodedInstruction();
+        decoded.location = location;
+        // every field is taken out of one window of code, fetched in one load
+        byte window[FETCH_WINDOW];
+        memory.fetchWindow(location, window);
+        address windowStart = location;
+        address place = location;
+        byte opcode = window[0];
+        
+        // check for prefix to opcode
+        while (true) {
+            switch (opcode) {
+                case 0xF0:
+                    decoded.lock = true;
+                    break;
+                case 0xF3:
+                    decoded.repeatCX = true;
+                    decoded.repeatZF = true;
+                    break;
+                case 0xF2:
+                    decoded.repeatCX = true;
+                    break;
+                case 0x26: case 0x2E: case 0x36: case 0x3E:
+                    decoded.segment = (opcode >> 3) & 0b11; // ES, CS, SS, DS
+                    decoded.segmentOverride = true;
+                    break;
+                default:
+                    goto actualOpcode;
+            }
+            decoded.prefixCount++;
+            place++;
+            if (place - windowStart == FETCH_WINDOW) {
+                windowStart = place;
+                memory.fetchWindow(windowStart, window);
+            }
+            opcode = window[place - windowStart];
+        }
+        
+    actualOpcode:
+        if (place != windowStart) {
+            // the rest of the instruction may not fit after the prefixes
+            windowStart = place;
+            memory.fetchWindow(windowStart, window);
+        }
+        decoded.opcode = opcode;
+        byte layout = operandLayouts[opcode];
+        byte length = 1;
+        if (layout & MODRM) {
+            ModRegRM mrr = ModRegRM(window[1]);
+            decoded.modrm = mrr.full;
+            length = 2;
+            if (mrr.mod == 0b01) {
+                decoded.displacement = signExtend(window[2]);
+                length += 1;
+            } else if (mrr.mod == 0b10 || (mrr.mod == 0b00 && mrr.rm == 0b110)) {
+                decoded.displacement = windowWord(window, 2);
+                length += 2;
+            }
+            decoded.addressKernel = addressKernels[mrr.mod][mrr.rm];
+            if (decoded.segmentOverride) {
+                decoded.addressSegment = decoded.segment;
+            } else if (mrr.rm == 0b010 || mrr.rm == 0b011 || (mrr.rm == 0b110 && mrr.mod != 0b00)) {
+                decoded.addressSegment = 0b10; // bp implicitly uses SS
+            }
+            if ((layout & GRP3IMM) && mrr.reg == 0b000) {
+                layout |= (opcode & 1) ? IMM16 : IMM8;
+            }
         }
+        
+        if (layout & IMM8) {
+            decoded.immediate = window[length];
+            if (opcode == 0x83) { // sign extend so it can share 0x81's handlers
+                decoded.immediate = signExtend((byte) decoded.immediate);
+            }
+            length += 1;
+        } else if (layout & IMM16) {
+            decoded.immediate = windowWord(window, length);
+            length += 2;
+        } else if (layout & FARPTR) {
+            decoded.immediate = windowWord(window, length);
+            decoded.immediate2 = windowWord(window, length + 2);
+            length += 4;
+        }
+        decoded.length = length;
+        decoded.cycles = instructionCycles(opcode, decoded.modrm, decoded.prefixCount, decoded.repeatCX);
+        decoded.fuse = fuseKind(decoded, window[length]);
+    }
+    
+    // Find the decoded instruction at location in the cache, decoding it on a miss
+    // or if memory in its page has been written to since it was decoded
+    inline const DecodedInstruction &CPU::fetchDecoded(address location) {
+        DecodedInstruction &cached = decodeCache[location & (DECODE_CACHE_SIZE - 1)];
+        if (cached.location == location && cached.version == memory.codeVersion(location)) {
+            return cached;
+        }
+        
+        decode(location, cached);
+        const address last = location + cached.prefixCount + cached.length - 1;
+        if ((last >> CODE_PAGE_SHIFT) == (location >> CODE_PAGE_SHIFT)) {
+            memory.markCode(location);
+            cached.version = memory.codeVersion(location);
+        } else {
+            // straddles two pages, not worth tracking both, so just don't keep it
+            cached.location = NO_LOCATION;
+        }
+        return cached;
     }
     
     // ROL
     inline void CPU::rolByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = (amount & 0x1F) % 8;
         byte operand = getModRMByte(mrr);
         while (count > 0) {
@@ -411,6 +597,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rorByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         byte operand = getModRMByte(mrr);
         while (count > 0) {
@@ -426,6 +613,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rclByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         byte operand = getModRMByte(mrr);
         while (count > 0) {
@@ -441,6 +629,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rcrByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         byte operand = getModRMByte(mrr);
         if (count >= 1) {
@@ -458,6 +647,7 @@ namespace DK86PC {
     }
     
     inline void CPU::shlByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         byte operand = getModRMByte(mrr);
         
@@ -476,6 +666,7 @@ namespace DK86PC {
     }
     
     inline void CPU::shrByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         byte operand = getModRMByte(mrr);
         if (count >= 1) { overflow = highBitByte(operand); }
@@ -491,6 +682,7 @@ namespace DK86PC {
     }
     
     inline void CPU::sarByte(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         byte operand = getModRMByte(mrr);
         while (count > 0) {
@@ -508,6 +700,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rolWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = (amount & 0x1F) % 16;
         word operand = getModRMWord(mrr);
         while (count > 0) {
@@ -522,6 +715,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rorWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         word operand = getModRMWord(mrr);
         while (count > 0) {
@@ -537,6 +731,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rclWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         word operand = getModRMWord(mrr);
         while (count > 0) {
@@ -552,6 +747,7 @@ namespace DK86PC {
     }
     
     inline void CPU::rcrWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         word operand = getModRMWord(mrr);
         if (count >= 1) {
@@ -569,6 +765,7 @@ namespace DK86PC {
     }
     
     inline void CPU::shlWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         word operand = getModRMWord(mrr);
         
@@ -587,6 +784,7 @@ namespace DK86PC {
     }
     
     inline void CPU::shrWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         word operand = getModRMWord(mrr);
         if (count >= 1) { overflow = highBitWord(operand); }
@@ -602,6 +800,7 @@ namespace DK86PC {
     }
     
     inline void CPU::sarWord(ModRegRM mrr, byte amount) {
+        materializeFlags();
         int count = amount & 0x1F;
         word operand = getModRMWord(mrr);
         while (count > 0) {
@@ -619,149 +818,150 @@ namespace DK86PC {
     }
 
     inline void CPU::xorByte(byte &left, byte right) {
+        lazyKept = getAuxiliaryCarry();
         left = left ^ right;
-        overflow = 0;
-        carry = 0;
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_LOGIC8;
     }
 
     inline void CPU::xorWord(word &left, word right) {
+        lazyKept = getAuxiliaryCarry();
         left = left ^ right;
-        overflow = 0;
-        carry = 0;
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_LOGIC16;
     }
 
     inline void CPU::orByte(byte &left, byte right) {
+        lazyKept = getAuxiliaryCarry();
         left = left | right;
-        overflow = 0;
-        carry = 0;
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_LOGIC8;
     }
 
     inline void CPU::orWord(word &left, word right) {
+        lazyKept = getAuxiliaryCarry();
         left = left | right;
-        overflow = 0;
-        carry = 0;
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_LOGIC16;
     }
 
     inline void CPU::andByte(byte &left, byte right) {
+        lazyKept = getAuxiliaryCarry();
         left = left & right;
-        overflow = 0;
-        carry = 0;
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_LOGIC8;
     }
 
     inline void CPU::andWord(word &left, word right) {
+        lazyKept = getAuxiliaryCarry();
         left = left & right;
-        overflow = 0;
-        carry = 0;
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_LOGIC16;
     }
     
     inline void CPU::subByte(byte &left, byte right) {
-        byte originalHigh = highBitByte(left);
-        carry = (right > left);
-        auxiliaryCarry = (lowNibble(right) > lowNibble(left));
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = false;
         left = left - right;
-        overflow = (originalHigh ^ highBitByte(right)) && (originalHigh ^ highBitByte(left));
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_SUB8;
     }
 
     inline void CPU::subWord(word &left, word right) {
-        word originalHigh = highBitWord(left);
-        carry = (right > left);
-        auxiliaryCarry = (lowNibble(right) > lowNibble(left));
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = false;
         left = left - right;
-        overflow = (originalHigh ^ highBitWord(right)) && (originalHigh ^ highBitWord(left));
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_SUB16;
     }
 
     inline void CPU::subByteWithBorrow(byte &left, byte right) {
-        byte originalHigh = highBitByte(left);
-        bool oldCarry = carry;
-        carry = (right > left - carry);
-        auxiliaryCarry = (lowNibble(right) > lowNibble(left) - oldCarry);
+        const bool oldCarry = getCarry();
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = oldCarry;
         left = left - right - oldCarry;
-        overflow = (originalHigh ^ highBitByte(right)) && (originalHigh ^ highBitByte(left));
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_SUB8;
     }
 
     inline void CPU::subWordWithBorrow(word &left, word right) {
-        word originalHigh = highBitWord(left);
-        bool oldCarry = carry;
-        carry = (right > left - carry);
-        auxiliaryCarry = (lowNibble(right) > lowNibble(left) - oldCarry);
+        const bool oldCarry = getCarry();
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = oldCarry;
         left = left - right - oldCarry;
-        overflow = (originalHigh ^ highBitWord(right)) && (originalHigh ^ highBitWord(left));
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_SUB16;
     }
 
     inline void CPU::addByte(byte &left, byte right) {
-        const byte originalHigh = highBitByte(left);
-        carry = ((word)right + (word)left) > 0x00FF;
-        auxiliaryCarry = ((lowNibble(right) + lowNibble(left)) > 0x0F);
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = false;
         left = left + right;
-        overflow = (originalHigh == highBitByte(right)) && (originalHigh ^ highBitByte(left));
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_ADD8;
     }
 
     inline void CPU::addWord(word &left, word right) {
-        const word originalHigh = highBitWord(left);
-        carry = ((uint32_t)right + (uint32_t)left) > 0x0000FFFF;
-        auxiliaryCarry = ((lowNibble(right) + lowNibble(left)) > 0x0F);
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = false;
         left = left + right;
-        overflow = (originalHigh == highBitWord(right)) && (originalHigh ^ highBitWord(left));
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_ADD16;
     }
 
     inline void CPU::addByteWithCarry(byte &left, byte right) {
-        const byte originalHigh = highBitByte(left);
-        bool oldCarry = carry;
-        carry = ((word)right + (word)left + oldCarry) > 0x00FF;
-        auxiliaryCarry = ((lowNibble(right) + lowNibble(left) + oldCarry) > 0x0F);
+        const bool oldCarry = getCarry();
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = oldCarry;
         left = left + right + oldCarry;
-        overflow = (originalHigh == highBitByte(right)) && (originalHigh ^ highBitByte(left));
-        setSZPFlagsByte(left);
+        lazyResult = left;
+        lazyOp = LAZY_ADD8;
     }
 
     inline void CPU::addWordWithCarry(word &left, word right) {
-        word originalHigh = highBitWord(left);
-        bool oldCarry = carry;
-        carry = ((uint32_t)right + (uint32_t)left + oldCarry) > 0x0000FFFF;
-        auxiliaryCarry = ((lowNibble(right) + lowNibble(left) + oldCarry) > 0x0F);
+        const bool oldCarry = getCarry();
+        lazyLeft = left;
+        lazyRight = right;
+        lazyCarryIn = oldCarry;
         left = left + right + oldCarry;
-        overflow = (originalHigh == highBitWord(right)) && (originalHigh ^ highBitWord(left));
-        setSZPFlagsWord(left);
+        lazyResult = left;
+        lazyOp = LAZY_ADD16;
     }
 
+    // INC and DEC leave carry alone, so hang on to whatever it was
     inline void CPU::incByte(byte &temp) {
-        auxiliaryCarry = (lowNibble(temp) == 0x0F);
+        lazyKept = getCarry();
         temp++;
-        overflow = (temp == 0x80);
-        setSZPFlagsByte(temp);
+        lazyResult = temp;
+        lazyOp = LAZY_INC8;
     }
 
     inline void CPU::incWord(word &temp) {
-        auxiliaryCarry = (lowNibble(temp) == 0x0F);
+        lazyKept = getCarry();
         temp++;
-        overflow = (temp == 0x8000);
-        setSZPFlagsWord(temp);
+        lazyResult = temp;
+        lazyOp = LAZY_INC16;
     }
     
     inline void CPU::decByte(byte &temp) {
-        auxiliaryCarry = (lowNibble(temp) == 0);
+        lazyKept = getCarry();
         temp--;
-        overflow = (temp == 0x7F);
-        setSZPFlagsByte(temp);
+        lazyResult = temp;
+        lazyOp = LAZY_DEC8;
     }
     
     inline void CPU::decWord(word &temp) {
-        auxiliaryCarry = (lowNibble(temp) == 0);
+        lazyKept = getCarry();
         temp--;
-        overflow = (temp == 0x7FFF);
-        setSZPFlagsWord(temp);
+        lazyResult = temp;
+        lazyOp = LAZY_DEC16;
     }
 
     inline void CPU::push(word value) {
@@ -777,17 +977,22 @@ namespace DK86PC {
     }
         
     inline void CPU::performInterrupt(byte type) {
+        if (observer != nullptr) {
+            observer->interrupt(type);
+        }
+        materializeFlags();
         push(flags);
         interrupt = false;
         trace = false;
         push(cs);
         push(ip - prefixCount);
-        cs = memory.readWord(type * 4 + 2);
+        setCS(memory.readWord(type * 4 + 2));
         ip = memory.readWord(type * 4);
         
     }
 
-    inline void CPU::debugPrint(byte opcode) {
+    void CPU::debugPrint(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
         cout << "\t" << "AX " << hex << uppercase << setfill('0') << setw(4) << ax << dec;
         cout << " BX " << hex << uppercase << setfill('0') << setw(4) << bx << dec;
         cout << " CX " << hex << uppercase << setfill('0') << setw(4) << cx << dec;
@@ -797,7 +1002,7 @@ namespace DK86PC {
         cout << " BP " << hex << uppercase << setfill('0') << setw(4) << bp << dec;
         cout << " SI " << hex << uppercase << setfill('0') << setw(4) << si << dec;
         cout << " DI " << hex << uppercase << setfill('0') << setw(4) << di << dec;
-        cout << " " << carry << parity << auxiliaryCarry << zero << sign << trace << interrupt << direction << overflow << endl;
+        cout << " " << getCarry() << getParity() << getAuxiliaryCarry() << getZero() << getSign() << trace << interrupt << direction << getOverflow() << endl;
         cout << "\t" << "CS " << hex << uppercase << setfill('0') << setw(4) << cs << dec;
         cout << " DS " << hex << uppercase << setfill('0') << setw(4) << ds << dec;
         cout << " ES " << hex << uppercase << setfill('0') << setw(4) << es << dec;
@@ -807,12 +1012,15 @@ namespace DK86PC {
         Instruction instr = instructions[opcode];
         string mnemonic = instr.mnemonic;
         if (mnemonic.substr(0, 3) == "GRP") {
-            mnemonic = getGroupMnemonic(instr, memory.readByte(NEXT_INSTRUCTION + 1) >> 3 & 7);
+            mnemonic = getGroupMnemonic(instr, ModRegRM(decoded.modrm).reg);
         }
         cout << " " << mnemonic;
         cout << endl;
     }
     
+    void TraceObserver::instruction(CPU &cpu, const DecodedInstruction &decoded) {
+        cpu.debugPrint(decoded);
+    }
     
     void CPU::reset() {
         cycleCount = 0;
@@ -826,20 +1034,25 @@ namespace DK86PC {
         bp = 0;
         si = 0;
         di = 0;
-        cs = 0xFFFF;
+        setCS(0xFFFF);
         ds = 0;
         es = 0;
         ss = 0;
         ip = 0; // reset vector at OxFFFF0 (cs << 4 + ip)
         flags = 0x0000;
+        lazyOp = LAZY_NONE;
         setFlagsDefaults();
         prefixCount = 0;
         delayInterrupt = false;
         halted = false;
+        jump = false;
+        fpu.reset();
     }
 
     void CPU::hardwareInterrupt(byte info) {
         if (interrupt) {
+            halted = false;
+            prefixCount = 0; // ip is already where to come back to
             //byte baseVector = info & 0b11111000;
             //byte irq = info & 0b00000111;
             //performInterrupt(baseVector / 4 + irq);
@@ -850,2606 +1063,3007 @@ namespace DK86PC {
         }
     }
     
-    // returns the number of cycles counted
-    void CPU::step() {
-        bool jump = false;
-        bool lock = false;
-        bool repeatCX = false;
-        bool repeatZF = false;
-        byte instructionLength = 1;
-        prefixCount = 0;
-        
-        // Make sure interrupt after STI is only enabled one instruction later
-        if (delayInterrupt) {
-            interrupt = true;
-            delayInterrupt = false;
+    // Opcode handlers
+    // named after the operand notation in DebugTable/8086_table.txt
+    
+    // ADD integer addition
+    inline void CPU::addEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        addByte(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::addEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        addWord(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::addGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        addByte(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::addGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        addWord(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::addALIb(const DecodedInstruction &decoded) {
+        addByte(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::addAXIv(const DecodedInstruction &decoded) {
+        addWord(ax, decoded.immediate);
+    }
+    
+    // PUSH es
+    inline void CPU::pushES(const DecodedInstruction &decoded) {
+        push(es);
+    }
+    
+    // POP es
+    inline void CPU::popES(const DecodedInstruction &decoded) {
+        es = pop();
+    }
+    
+    // OR inclusive or
+    inline void CPU::orEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        orByte(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::orEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        orWord(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::orGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        orByte(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::orGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        orWord(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::orALIb(const DecodedInstruction &decoded) {
+        orByte(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::orAXIv(const DecodedInstruction &decoded) {
+        orWord(ax, decoded.immediate);
+    }
+    
+    // PUSH cs
+    inline void CPU::pushCS(const DecodedInstruction &decoded) {
+        push(cs);
+    }
+    
+    // ADC integer addition with carry
+    inline void CPU::adcEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        addByteWithCarry(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::adcEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        addWordWithCarry(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::adcGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        addByteWithCarry(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::adcGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        addWordWithCarry(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::adcALIb(const DecodedInstruction &decoded) {
+        addByteWithCarry(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::adcAXIv(const DecodedInstruction &decoded) {
+        addWordWithCarry(ax, decoded.immediate);
+    }
+    
+    // PUSH ss
+    inline void CPU::pushSS(const DecodedInstruction &decoded) {
+        push(ss);
+    }
+    
+    // POP ss
+    inline void CPU::popSS(const DecodedInstruction &decoded) {
+        ss = pop();
+    }
+    
+    // SBB integer subtraction with Borrow
+    inline void CPU::sbbEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        subByteWithBorrow(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::sbbEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        subWordWithBorrow(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::sbbGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        subByteWithBorrow(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::sbbGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        subWordWithBorrow(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::sbbALIb(const DecodedInstruction &decoded) {
+        subByteWithBorrow(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::sbbAXIv(const DecodedInstruction &decoded) {
+        subWordWithBorrow(ax, decoded.immediate);
+    }
+    
+    // PUSH ds
+    inline void CPU::pushDS(const DecodedInstruction &decoded) {
+        push(ds);
+    }
+    
+    // POP ds
+    inline void CPU::popDS(const DecodedInstruction &decoded) {
+        ds = pop();
+    }
+    
+    // AND
+    inline void CPU::andEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        andByte(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::andEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        andWord(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::andGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        andByte(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::andGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        andWord(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::andALIb(const DecodedInstruction &decoded) {
+        andByte(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::andAXIv(const DecodedInstruction &decoded) {
+        andWord(ax, decoded.immediate);
+    }
+    
+    //DAA Decimal Adjust for Addition
+    inline void CPU::daa(const DecodedInstruction &decoded) {
+        materializeFlags();
+        byte origValue = al;
+        bool origC = carry;
+        carry = false;
+        if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
+            al += 6;
+            carry = (origC | ((al & 0x80) > 0));
+            auxiliaryCarry = true;
+        } else {
+            auxiliaryCarry = false;
         }
-        
-        byte opcode = memory.readByte(NEXT_INSTRUCTION);
-        currentSegment = &ds;
-        segmentOverride = false;
-        
-        
-        
-        // check for prefix to opcode
-        while (true) {
-            #ifdef DEBUG
-            debugPrint(opcode);
-            #endif
-            switch (opcode) {
-                case 0xF0:
-                    lock = true;
-                    break;
-                case 0xF3:
-                    repeatCX = true;
-                    repeatZF = true;
-                    break;
-                case 0xF2:
-                    repeatCX = true;
-                    break;
-                case 0x2E:
-                    currentSegment = &cs;
-                    segmentOverride = true;
-                    break;
-                case 0x36:
-                    currentSegment = &ss;
-                    segmentOverride = true;
-                    break;
-                case 0x3E:
-                    currentSegment = &ds;
-                    segmentOverride = true;
-                    break;
-                case 0x26:
-                    currentSegment = &es;
-                    segmentOverride = true;
-                    break;
-                default:
-                    goto actualOpcode;
-            }
-            prefixCount++;
-            ip += 1;
-            opcode = memory.readByte(NEXT_INSTRUCTION);
-            
-        }
-        
-    actualOpcode:
-        switch (opcode) {
-            
-            // ADD integer addition
-            case 0x00:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                addByte(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-            
-            case 0x01:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                addWord(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-            
-            case 0x02:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                addByte(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x03:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                addWord(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x04:
-                addByte(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-                
-            case 0x05:
-                addWord(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-                
-            // PUSH es
-            case 0x06:
-                push(es);
-                break;
-            
-            // POP es
-            case 0x07:
-                es = pop();
-                break;
-            
-            // OR inclusive or
-            case 0x08:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                orByte(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-                
-            case 0x09:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                orWord(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-                
-            case 0x0A:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                orByte(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x0B:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                orWord(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x0C:
-                orByte(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-                
-            case 0x0D:
-                orWord(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-            
-            // PUSH cs
-            case 0x0E:
-                push(cs);
-                break;
-            
-            // ADC integer addition with carry
-            case 0x10:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                addByteWithCarry(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-            
-            case 0x11:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                addWordWithCarry(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-            
-            case 0x12:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                addByteWithCarry(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x13:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                addWordWithCarry(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x14:
-                addByteWithCarry(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-                
-            case 0x15:
-                addWordWithCarry(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-            
-            // PUSH ss
-            case 0x16:
-                push(ss);
-                break;
-            
-            // POP ss
-            case 0x17:
-                ss = pop();
-                break;
-            
-            // SBB integer subtraction with Borrow
-            case 0x18:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                subByteWithBorrow(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-            
-            case 0x19:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                subWordWithBorrow(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-            
-            case 0x1A:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                subByteWithBorrow(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x1B:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                subWordWithBorrow(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x1C:
-                subByteWithBorrow(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-                
-            case 0x1D:
-                subWordWithBorrow(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-            
-            // PUSH ds
-            case 0x1E:
-                push(ds);
-                break;
-                
-            // POP ds
-            case 0x1F:
-                ds = pop();
-                break;
-            
-            // AND
-            case 0x20:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                andByte(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-                
-            case 0x21:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                andWord(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-                
-            case 0x22:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                andByte(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x23:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                andWord(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x24:
-                andByte(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-                
-            case 0x25:
-                andWord(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-            
-            //DAA Decimal Adjust for Addition
-            case 0x27:
-            {
-                byte origValue = al;
-                bool origC = carry;
-                carry = false;
-                if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
-                    al += 6;
-                    carry = (origC | ((al & 0x80) > 0));
-                    auxiliaryCarry = true;
-                } else {
-                    auxiliaryCarry = false;
-                }
-                if ((origValue > 0x99) || (origC)) {
-                    al += 0x60;
-                    carry = true;
-                } else {
-                    carry = false;
-                }
-                setSZPFlagsByte(al);
-                break;
-            }
-            
-            // SUB integer subtraction
-            case 0x28:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                subByte(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-            
-            case 0x29:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                subWord(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-            
-            case 0x2A:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                subByte(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x2B:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                subWord(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x2C:
-                subByte(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-                
-            case 0x2D:
-                subWord(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-            
-            // DAS Decimal Adjust for Subtraction
-            case 0x2F:
-            {
-                byte origValue = al;
-                bool origC = carry;
-                carry = false;
-                if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
-                    al -= 6;
-                    carry = (origC | ((al & 0x80) == 0));
-                    auxiliaryCarry = true;
-                } else {
-                    auxiliaryCarry = false;
-                }
-                if ((origValue > 0x99) || (origC)) {
-                    al -= 0x60;
-                    carry = true;
-                }
-                setSZPFlagsByte(al);
-                break;
-            }
-            
-            // XOR exclusive or
-            case 0x30:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                xorByte(temp, getRegByte(mrr.reg));
-                setModRMByte(mrr, temp);
-                break;
-            }
-                
-            case 0x31:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                xorWord(temp, getRegWord(mrr.reg));
-                setModRMWord(mrr, temp);
-                break;
-            }
-                
-            case 0x32:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                xorByte(temp, getModRMByte(mrr));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x33:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                xorWord(temp, getModRMWord(mrr));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-            
-            case 0x34:
-                xorByte(al, memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-            case 0x35:
-                xorWord(ax, memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-                
-            // AAA ASCII Adjust for Addition
-            case 0x37:
-                if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
-                    al += 6;
-                    ah += 1;
-                    carry = true;
-                    auxiliaryCarry = true;
-                } else {
-                    auxiliaryCarry = false;
-                    carry = false;
-                }
-                al &= 0x0F;
-                setSZPFlagsByte(al);
-                break;
-            
-            // CMP Memory/Reg with Reg byte
-            case 0x38:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                subByte(temp, getRegByte(mrr.reg));
-                break;
-            }
-                
-            // CMP Memory/Reg with Reg word
-            case 0x39:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                subWord(temp, getRegWord(mrr.reg));
-                break;
-            }
-                
-            // CMP Reg w/ Memory/Reg byte
-            case 0x3A:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getRegByte(mrr.reg);
-                subByte(temp, getModRMByte(mrr));
-                break;
-            }
-            
-            // CMP Reg w/ Memory/Reg word
-            case 0x3B:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getRegWord(mrr.reg);
-                subWord(temp, getModRMWord(mrr));
-                break;
-            }
-                
-            // CMP Immed w/ AL
-            case 0x3C:
-            {
-                instructionLength = 2;
-                byte temp = al;
-                subByte(temp, memory.readByte(NEXT_INSTRUCTION + 1));
-                break;
-            }
-                
-            // CMP Immed w/ AX
-            case 0x3D:
-            {
-                instructionLength = 3;
-                word temp = ax;
-                subWord(temp, memory.readWord(NEXT_INSTRUCTION + 1));
-                break;
-            }
-                
-            // AAS ASCII Adjust for Subtraction
-            case 0x3F:
-                if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
-                    al -= 6;
-                    ah -= 1;
-                    carry = true;
-                    auxiliaryCarry = true;
-                } else {
-                    carry = false;
-                    auxiliaryCarry = false;
-                }
-                al &= 0x0F;
-                setSZPFlagsByte(al);
-                break;
-                
-            // INC AX
-            case 0x40:
-                incWord(ax);
-                break;
-            
-            // INC CX
-            case 0x41:
-                incWord(cx);
-                break;
-            
-            // INC DX
-            case 0x42:
-                incWord(Dx);
-                break;
-            
-            // INC BX
-            case 0x43:
-                incWord(bx);
-                break;
-            
-            // INC SP
-            case 0x44:
-                incWord(sp);
-                break;
-            
-            // INC BP
-            case 0x45:
-                incWord(bp);
-                break;
-            
-            // INC SI
-            case 0x46:
-                incWord(si);
-                break;
-            
-            // INC DI
-            case 0x47:
-                incWord(di);
-                break;
-            
-            // DEC AX
-            case 0x48:
-                decWord(ax);
-                break;
-            
-            // DEC CX
-            case 0x49:
-                decWord(cx);
-                break;
-            
-            // DEC DX
-            case 0x4A:
-                decWord(Dx);
-                break;
-            
-            // DEC BX
-            case 0x4B:
-                decWord(bx);
-                break;
-            
-            // DEC SP
-            case 0x4C:
-                decWord(sp);
-                break;
-            
-            // DEC BP
-            case 0x4D:
-                decWord(bp);
-                break;
-            
-            // DEC SI
-            case 0x4E:
-                decWord(si);
-                break;
-            
-            // DEC DI
-            case 0x4F:
-                decWord(di);
-                break;
-            
-            // PUSH ax
-            case 0x50:
-                push(ax);
-                break;
-            
-            // PUSH cx
-            case 0x51:
-                push(cx);
-                break;
-            
-            // PUSH dx
-            case 0x52:
-                push(Dx);
-                break;
-            
-            // PUSH bx
-            case 0x53:
-                push(bx);
-                break;
-                
-            // PUSH sp
-            case 0x54:
-                push(sp);
-                break;
-                
-            // PUSH bp
-            case 0x55:
-                push(bp);
-                break;
-                
-            // PUSH si
-            case 0x56:
-                push(si);
-                break;
-                
-            // PUSH di
-            case 0x57:
-                push(di);
-                break;
-            
-            // POP ax
-            case 0x58:
-                ax = pop();
-                break;
-            
-            // POP cx
-            case 0x59:
-                cx = pop();
-                break;
-            
-            // POP dx
-            case 0x5A:
-                Dx = pop();
-                break;
-            
-            // POP bx
-            case 0x5B:
-                bx = pop();
-                break;
-                
-            // POP sp
-            case 0x5C:
-                sp = pop();
-                break;
-                
-            // POP bp
-            case 0x5D:
-                bp = pop();
-                break;
-                
-            // POP si
-            case 0x5E:
-                si = pop();
-                break;
-                
-            // POP di
-            case 0x5F:
-                di = pop();
-                break;
-            
-            // JO jump on overflow
-            case 0x70:
-                if (overflow) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JNO jump on not overflow
-            case 0x71:
-                if (!overflow) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JC/JB/JNAE jump on carry
-            case 0x72:
-                if (carry) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-                
-            // JNC/JNB/JAE jump not carry
-            case 0x73:
-                if (!carry) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JE/JZ jump on equal/zero
-            case 0x74:
-                if (zero) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JNE/JNZ jump on NOT equal/zero
-            case 0x75:
-                if (!zero) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JBE/JNA Jump on below or equal/not above
-            case 0x76:
-                if (zero || carry) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JNBE/JA Jump on not below or equal above
-            case 0x77:
-                if (!(zero || carry)) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JS Jump on Sign
-            case 0x78:
-                if (sign) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JS Jump on Not Sign
-            case 0x79:
-                if (!sign) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JP/JPE Jump on Parity
-            case 0x7A:
-                if (parity) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JNP/JPO Jump on Not Parity
-            case 0x7B:
-                if (!parity) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JL/JNGE Jump if neither greater nor equal
-            case 0x7C:
-                if (sign ^ overflow) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JNL/JGE Jump if not less
-            case 0x7D:
-                if (!(sign ^ overflow)) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JLE/JNG Jump if not greater
-            case 0x7E:
-                if ((sign ^ overflow) || zero) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // JNLE/JG Jump if greater
-            case 0x7F:
-                if (!((sign ^ overflow) || zero)) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-                
-            case 0x80:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000: // ADD
-                    {
-                        byte temp = getModRMByte(mrr);
-                        addByte(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b001: // OR
-                    {
-                        byte temp = getModRMByte(mrr);
-                        orByte(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b010: // ADC
-                    {
-                        byte temp = getModRMByte(mrr);
-                        addByteWithCarry(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b011: // SBB
-                    {
-                        byte temp = getModRMByte(mrr);
-                        subByteWithBorrow(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b100: // AND
-                    {
-                        byte temp = getModRMByte(mrr);
-                        andByte(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b101: // SUB
-                    {
-                        byte temp = getModRMByte(mrr);
-                        subByte(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b110: // XOR
-                    {
-                        byte temp = getModRMByte(mrr);
-                        xorByte(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b111: // CMP
-                        byte temp = getModRMByte(mrr);
-                        subByte(temp, memory.readByte(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 1;
-                        break;
-                        
-                }
-                break;
-            }
-            
-            case 0x81:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000:  // ADD
-                    {
-                        word temp = getModRMWord(mrr);
-                        addWord(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b001: // OR
-                    {
-                        word temp = getModRMWord(mrr);
-                        orWord(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b010: // ADC
-                    {
-                        word temp = getModRMWord(mrr);
-                        addWordWithCarry(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b011: // SBB
-                    {
-                        word temp = getModRMWord(mrr);
-                        subWordWithBorrow(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b100:  // AND
-                        {
-                            word temp = getModRMWord(mrr);
-                            andWord(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                            instructionLength += 2;
-                            setModRMWord(mrr, temp);
-                            break;
-                        }
-                    case 0b101: // SUB
-                    {
-                        word temp = getModRMWord(mrr);
-                        subWord(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b110: // XOR
-                    {
-                        word temp = getModRMWord(mrr);
-                        xorWord(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b111: // CMP
-                        word temp = getModRMWord(mrr);
-                        subWord(temp, memory.readWord(NEXT_INSTRUCTION + instructionLength));
-                        instructionLength += 2;
-                        break;
-                        
-                }
-                break;
-            }
-            
-            case 0x83:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000: // ADD
-                    {
-                        word temp = getModRMWord(mrr);
-                        addWord(temp, signExtend(memory.readByte(NEXT_INSTRUCTION + instructionLength)));
-                        instructionLength += 1;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b001:
-                    {
-                        cout << "unimplemented";
-                        break;
-                    }
-                    case 0b010: // ADC
-                    {
-                        word temp = getModRMWord(mrr);
-                        addWordWithCarry(temp, signExtend(memory.readByte(NEXT_INSTRUCTION + instructionLength)));
-                        instructionLength += 1;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b011: // SBB
-                    {
-                        word temp = getModRMWord(mrr);
-                        subWordWithBorrow(temp, signExtend(memory.readByte(NEXT_INSTRUCTION + instructionLength)));
-                        instructionLength += 1;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b100:
-                        cout << "unimplemented";
-                        break;
-                    case 0b101: // SUB
-                    {
-                        word temp = getModRMWord(mrr);
-                        subWord(temp, signExtend(memory.readByte(NEXT_INSTRUCTION + instructionLength)));
-                        instructionLength += 1;
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b110:
-                    {
-                        cout << "unimplemented";
-                        break;
-                    }
-                    case 0b111: // CMP
-                        word temp = getModRMWord(mrr);
-                        subWord(temp, signExtend(memory.readByte(NEXT_INSTRUCTION + instructionLength)));
-                        instructionLength += 1;
-                        break;
-                        
-                }
-                break;
-            }
-                
-            // TEST
-            case 0x84:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp1 = getRegByte(mrr.reg);
-                byte temp2 = getModRMByte(mrr);
-                byte result = temp1 & temp2;
-                setSZPFlagsByte(result);
-                carry = false;
-                overflow = false;
-                break;
-            }
-            
-            // TEST
-            case 0x85:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp1 = getRegWord(mrr.reg);
-                word temp2 = getModRMWord(mrr);
-                word result = temp1 & temp2;
-                setSZPFlagsWord(result);
-                carry = false;
-                overflow = false;
-                break;
-            }
-            
-            // XCHG byte reg to modrm
-            case 0x86:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte temp = getModRMByte(mrr);
-                setModRMByte(mrr, getRegByte(mrr.reg));
-                setRegByte(mrr.reg, temp);
-                break;
-            }
-            
-            // XCHG word reg to modrm
-            case 0x87:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word temp = getModRMWord(mrr);
-                setModRMWord(mrr, getRegWord(mrr.reg));
-                setRegWord(mrr.reg, temp);
-                break;
-            }
-                
-            // MOV byte reg to rm
-            case 0x88:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setModRMByte(mrr, getRegByte(mrr.reg));
-                break;
-            }
-            
-            // MOV word reg to rm
-            case 0x89:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setModRMWord(mrr, getRegWord(mrr.reg));
-                break;
-            }
-            
-            // MOV byte rm to reg
-            case 0x8A:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setRegByte(mrr.reg, getModRMByte(mrr));
-                break;
-            }
-            
-            // MOV word rm to reg
-            case 0x8B:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setRegWord(mrr.reg, getModRMWord(mrr));
-                break;
-            }
-                
-            // MOV segment register to rm
-            case 0x8C:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setModRMWord(mrr, getSegmentRegWord(mrr.reg));
-                break;
-            }
-            
-            // LEA
-            case 0x8D:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                address ea = calcEffectiveAddress(mrr);
-                setRegWord(mrr.reg, ea);
-                break;
-            }
-            
-            // MOV rm to segment register
-            case 0x8E:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setSegmentRegWord(mrr.reg, getModRMWord(mrr));
-                break;
-            }
-            
-            // POP
-            case 0x8F:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                setModRMWord(mrr, pop());
-                break;
-            }
-                
-            // NOP no op (technically XCHG AX with AX)
-            case 0x90:
-                break;
-            
-            // XCHG AX w/ CX
-            case 0x91:
-            {
-                word temp = ax;
-                ax = cx;
-                cx = temp;
-                break;
-            }
-            
-            // XCHG AX w/ DX
-            case 0x92:
-            {
-                word temp = ax;
-                ax = Dx;
-                Dx = temp;
-                break;
-            }
-            
-            // XCHG AX w/ BX
-            case 0x93:
-            {
-                word temp = ax;
-                ax = bx;
-                bx = temp;
-                break;
-            }
-            
-            // XCHG AX w/ SP
-            case 0x94:
-            {
-                word temp = ax;
-                ax = sp;
-                sp = temp;
-                break;
-            }
-            
-            // XCHG AX w/ BP
-            case 0x95:
-            {
-                word temp = ax;
-                ax = bp;
-                bp = temp;
-                break;
-            }
-            
-            // XCHG AX w/ SI
-            case 0x96:
-            {
-                word temp = ax;
-                ax = si;
-                si = temp;
-                break;
-            }
-            
-            // XCHG AX w/ DI
-            case 0x97:
-            {
-                word temp = ax;
-                ax = di;
-                di = temp;
-                break;
+        if ((origValue > 0x99) || (origC)) {
+            al += 0x60;
+            carry = true;
+        } else {
+            carry = false;
+        }
+        setSZPFlagsByte(al);
+    }
+    
+    // SUB integer subtraction
+    inline void CPU::subEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        subByte(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::subEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        subWord(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::subGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        subByte(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::subGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        subWord(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::subALIb(const DecodedInstruction &decoded) {
+        subByte(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::subAXIv(const DecodedInstruction &decoded) {
+        subWord(ax, decoded.immediate);
+    }
+    
+    // DAS Decimal Adjust for Subtraction
+    inline void CPU::das(const DecodedInstruction &decoded) {
+        materializeFlags();
+        byte origValue = al;
+        bool origC = carry;
+        carry = false;
+        if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
+            al -= 6;
+            carry = (origC | ((al & 0x80) == 0));
+            auxiliaryCarry = true;
+        } else {
+            auxiliaryCarry = false;
+        }
+        if ((origValue > 0x99) || (origC)) {
+            al -= 0x60;
+            carry = true;
+        }
+        setSZPFlagsByte(al);
+    }
+    
+    // XOR exclusive or
+    inline void CPU::xorEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        xorByte(temp, getRegByte(mrr.reg));
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::xorEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        xorWord(temp, getRegWord(mrr.reg));
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::xorGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        xorByte(temp, getModRMByte(mrr));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    inline void CPU::xorGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        xorWord(temp, getModRMWord(mrr));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    inline void CPU::xorALIb(const DecodedInstruction &decoded) {
+        xorByte(al, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::xorAXIv(const DecodedInstruction &decoded) {
+        xorWord(ax, decoded.immediate);
+    }
+    
+    // AAA ASCII Adjust for Addition
+    inline void CPU::aaa(const DecodedInstruction &decoded) {
+        materializeFlags();
+        if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
+            al += 6;
+            ah += 1;
+            carry = true;
+            auxiliaryCarry = true;
+        } else {
+            auxiliaryCarry = false;
+            carry = false;
+        }
+        al &= 0x0F;
+        setSZPFlagsByte(al);
+    }
+    
+    // CMP Memory/Reg with Reg byte
+    inline void CPU::cmpEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        subByte(temp, getRegByte(mrr.reg));
+    }
+    
+    // CMP Memory/Reg with Reg word
+    inline void CPU::cmpEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        subWord(temp, getRegWord(mrr.reg));
+    }
+    
+    // CMP Reg w/ Memory/Reg byte
+    inline void CPU::cmpGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getRegByte(mrr.reg);
+        subByte(temp, getModRMByte(mrr));
+    }
+    
+    // CMP Reg w/ Memory/Reg word
+    inline void CPU::cmpGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getRegWord(mrr.reg);
+        subWord(temp, getModRMWord(mrr));
+    }
+    
+    // CMP Immed w/ AL
+    inline void CPU::cmpALIb(const DecodedInstruction &decoded) {
+        byte temp = al;
+        subByte(temp, (byte) decoded.immediate);
+    }
+    
+    // CMP Immed w/ AX
+    inline void CPU::cmpAXIv(const DecodedInstruction &decoded) {
+        word temp = ax;
+        subWord(temp, decoded.immediate);
+    }
+    
+    // AAS ASCII Adjust for Subtraction
+    inline void CPU::aas(const DecodedInstruction &decoded) {
+        materializeFlags();
+        if (((al & 0x0F) > 9) || (auxiliaryCarry)) {
+            al -= 6;
+            ah -= 1;
+            carry = true;
+            auxiliaryCarry = true;
+        } else {
+            carry = false;
+            auxiliaryCarry = false;
+        }
+        al &= 0x0F;
+        setSZPFlagsByte(al);
+    }
+    
+    // INC AX
+    inline void CPU::incAX(const DecodedInstruction &decoded) {
+        incWord(ax);
+    }
+    
+    // INC CX
+    inline void CPU::incCX(const DecodedInstruction &decoded) {
+        incWord(cx);
+    }
+    
+    // INC DX
+    inline void CPU::incDX(const DecodedInstruction &decoded) {
+        incWord(Dx);
+    }
+    
+    // INC BX
+    inline void CPU::incBX(const DecodedInstruction &decoded) {
+        incWord(bx);
+    }
+    
+    // INC SP
+    inline void CPU::incSP(const DecodedInstruction &decoded) {
+        incWord(sp);
+    }
+    
+    // INC BP
+    inline void CPU::incBP(const DecodedInstruction &decoded) {
+        incWord(bp);
+    }
+    
+    // INC SI
+    inline void CPU::incSI(const DecodedInstruction &decoded) {
+        incWord(si);
+    }
+    
+    // INC DI
+    inline void CPU::incDI(const DecodedInstruction &decoded) {
+        incWord(di);
+    }
+    
+    // DEC AX
+    inline void CPU::decAX(const DecodedInstruction &decoded) {
+        decWord(ax);
+    }
+    
+    // DEC CX
+    inline void CPU::decCX(const DecodedInstruction &decoded) {
+        decWord(cx);
+    }
+    
+    // DEC DX
+    inline void CPU::decDX(const DecodedInstruction &decoded) {
+        decWord(Dx);
+    }
+    
+    // DEC BX
+    inline void CPU::decBX(const DecodedInstruction &decoded) {
+        decWord(bx);
+    }
+    
+    // DEC SP
+    inline void CPU::decSP(const DecodedInstruction &decoded) {
+        decWord(sp);
+    }
+    
+    // DEC BP
+    inline void CPU::decBP(const DecodedInstruction &decoded) {
+        decWord(bp);
+    }
+    
+    // DEC SI
+    inline void CPU::decSI(const DecodedInstruction &decoded) {
+        decWord(si);
+    }
+    
+    // DEC DI
+    inline void CPU::decDI(const DecodedInstruction &decoded) {
+        decWord(di);
+    }
+    
+    // PUSH ax
+    inline void CPU::pushAX(const DecodedInstruction &decoded) {
+        push(ax);
+    }
+    
+    // PUSH cx
+    inline void CPU::pushCX(const DecodedInstruction &decoded) {
+        push(cx);
+    }
+    
+    // PUSH dx
+    inline void CPU::pushDX(const DecodedInstruction &decoded) {
+        push(Dx);
+    }
+    
+    // PUSH bx
+    inline void CPU::pushBX(const DecodedInstruction &decoded) {
+        push(bx);
+    }
+    
+    // PUSH sp
+    inline void CPU::pushSP(const DecodedInstruction &decoded) {
+        push(sp);
+    }
+    
+    // PUSH bp
+    inline void CPU::pushBP(const DecodedInstruction &decoded) {
+        push(bp);
+    }
+    
+    // PUSH si
+    inline void CPU::pushSI(const DecodedInstruction &decoded) {
+        push(si);
+    }
+    
+    // PUSH di
+    inline void CPU::pushDI(const DecodedInstruction &decoded) {
+        push(di);
+    }
+    
+    // POP ax
+    inline void CPU::popAX(const DecodedInstruction &decoded) {
+        ax = pop();
+    }
+    
+    // POP cx
+    inline void CPU::popCX(const DecodedInstruction &decoded) {
+        cx = pop();
+    }
+    
+    // POP dx
+    inline void CPU::popDX(const DecodedInstruction &decoded) {
+        Dx = pop();
+    }
+    
+    // POP bx
+    inline void CPU::popBX(const DecodedInstruction &decoded) {
+        bx = pop();
+    }
+    
+    // POP sp
+    inline void CPU::popSP(const DecodedInstruction &decoded) {
+        sp = pop();
+    }
+    
+    // POP bp
+    inline void CPU::popBP(const DecodedInstruction &decoded) {
+        bp = pop();
+    }
+    
+    // POP si
+    inline void CPU::popSI(const DecodedInstruction &decoded) {
+        si = pop();
+    }
+    
+    // POP di
+    inline void CPU::popDI(const DecodedInstruction &decoded) {
+        di = pop();
+    }
+    
+    // JO jump on overflow
+    inline void CPU::jo(const DecodedInstruction &decoded) {
+        if (getOverflow()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNO jump on not overflow
+    inline void CPU::jno(const DecodedInstruction &decoded) {
+        if (!getOverflow()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JC/JB/JNAE jump on carry
+    inline void CPU::jb(const DecodedInstruction &decoded) {
+        if (getCarry()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNC/JNB/JAE jump not carry
+    inline void CPU::jnb(const DecodedInstruction &decoded) {
+        if (!getCarry()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JE/JZ jump on equal/zero
+    inline void CPU::jz(const DecodedInstruction &decoded) {
+        if (getZero()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNE/JNZ jump on NOT equal/zero
+    inline void CPU::jnz(const DecodedInstruction &decoded) {
+        if (!getZero()) {
+            if ((byte) decoded.immediate == 0xFD && skipDecJnz()) {
+                return;
             }
-                
-            // CBW Convert Byte to Word
-            case 0x98:
-                if ((al & 0x80) == 0x80) {
-                    ah = 0xFF;
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JBE/JNA Jump on below or equal/not above
+    inline void CPU::jbe(const DecodedInstruction &decoded) {
+        if (getZero() || getCarry()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNBE/JA Jump on not below or equal above
+    inline void CPU::ja(const DecodedInstruction &decoded) {
+        if (!(getZero() || getCarry())) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JS Jump on Sign
+    inline void CPU::js(const DecodedInstruction &decoded) {
+        if (getSign()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JS Jump on Not Sign
+    inline void CPU::jns(const DecodedInstruction &decoded) {
+        if (!getSign()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JP/JPE Jump on Parity
+    inline void CPU::jpe(const DecodedInstruction &decoded) {
+        if (getParity()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNP/JPO Jump on Not Parity
+    inline void CPU::jpo(const DecodedInstruction &decoded) {
+        if (!getParity()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JL/JNGE Jump if neither greater nor equal
+    inline void CPU::jl(const DecodedInstruction &decoded) {
+        if (getSign() ^ getOverflow()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNL/JGE Jump if not less
+    inline void CPU::jge(const DecodedInstruction &decoded) {
+        if (!(getSign() ^ getOverflow())) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JLE/JNG Jump if not greater
+    inline void CPU::jle(const DecodedInstruction &decoded) {
+        if ((getSign() ^ getOverflow()) || getZero()) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JNLE/JG Jump if greater
+    inline void CPU::jg(const DecodedInstruction &decoded) {
+        if (!((getSign() ^ getOverflow()) || getZero())) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // Whether the Jcc with the given low opcode nibble is taken. Right after a
+    // CMP or SUB the operands are still around, so the unsigned and signed
+    // comparisons are done on them directly instead of going through the flags.
+    inline bool CPU::jumpCondition(byte condition) {
+        const bool compared = (lazyOp == LAZY_SUB8 || lazyOp == LAZY_SUB16) && !lazyCarryIn;
+        const bool wide = lazyOp & LAZY_WORD;
+        bool taken;
+        switch (condition >> 1) {
+            case 0: // O
+                taken = getOverflow();
+                break;
+            case 1: // B
+                taken = compared ? lazyLeft < lazyRight : getCarry();
+                break;
+            case 2: // Z
+                taken = getZero();
+                break;
+            case 3: // BE
+                taken = compared ? lazyLeft <= lazyRight : (getCarry() || getZero());
+                break;
+            case 4: // S
+                taken = getSign();
+                break;
+            case 5: // P
+                taken = getParity();
+                break;
+            case 6: // L
+                if (compared) {
+                    taken = wide ? (int16_t) lazyLeft < (int16_t) lazyRight : (int8_t) lazyLeft < (int8_t) lazyRight;
                 } else {
-                    ah = 0;
+                    taken = getSign() ^ getOverflow();
                 }
                 break;
-            
-            // CWD Convert Word to Doubleword
-            case 0x99:
-                if ((ax & 0x8000) == 0x8000) {
-                    Dx = 0xFFFF;
+            default: // LE
+                if (compared) {
+                    taken = wide ? (int16_t) lazyLeft <= (int16_t) lazyRight : (int8_t) lazyLeft <= (int8_t) lazyRight;
                 } else {
-                    Dx = 0;
+                    taken = (getSign() ^ getOverflow()) || getZero();
                 }
                 break;
-            
-            // CALL direct
-            case 0x9A:
-            { // scope for new variables
-                instructionLength = 5;
-                push(cs);
-                push(ip + instructionLength);
-                // next two instructions are new ip
-                // can't change ip until after have read CS
-                word nextIp = memory.readWord(NEXT_INSTRUCTION + 1);
-                // next two after that are new cs
-                word nextCs = memory.readWord(NEXT_INSTRUCTION + 3);
-                ip = nextIp;
-                cs = nextCs;
+        }
+        return taken != (condition & 1);
+    }
+    
+    // GRP1 ADD/OR/ADC/SBB/AND/SUB/XOR/CMP rm with an immediate, picked by the reg field
+    inline void CPU::group1Eb(const DecodedInstruction &decoded) {
+        (this->*group1ByteHandlers[ModRegRM(decoded.modrm).reg])(decoded);
+    }
+    
+    // 0x83's byte immediate is sign extended at decode time, so it shares 0x81's handlers
+    inline void CPU::group1Ev(const DecodedInstruction &decoded) {
+        (this->*group1WordHandlers[ModRegRM(decoded.modrm).reg])(decoded);
+    }
+    
+    inline void CPU::addEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        addByte(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::orEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        orByte(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::adcEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        addByteWithCarry(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::sbbEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        subByteWithBorrow(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::andEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        andByte(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::subEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        subByte(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::xorEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        xorByte(temp, (byte) decoded.immediate);
+        setModRMByte(mrr, temp);
+    }
+    
+    inline void CPU::cmpEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        subByte(temp, (byte) decoded.immediate);
+    }
+    
+    inline void CPU::addEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        addWord(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::orEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        orWord(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::adcEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        addWordWithCarry(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::sbbEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        subWordWithBorrow(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::andEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        andWord(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::subEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        subWord(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::xorEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        xorWord(temp, decoded.immediate);
+        setModRMWord(mrr, temp);
+    }
+    
+    inline void CPU::cmpEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        subWord(temp, decoded.immediate);
+    }
+    
+    // GRP2 ROL/ROR/RCL/RCR/SHL/SHR/SAR 8 bits 1
+    inline void CPU::group2Eb1(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        (this->*group2ByteHandlers[mrr.reg])(mrr, 1);
+    }
+    
+    // GRP2 ROL/ROR/RCL/RCR/SHL/SHR/SAR 16 bits 1
+    inline void CPU::group2Ev1(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        (this->*group2WordHandlers[mrr.reg])(mrr, 1);
+    }
+    
+    // GRP2 ROL/ROR/RCL/RCR/SHL/SHR/SAR 8 bits CL
+    inline void CPU::group2EbCL(const DecodedInstruction &decoded) {
+        cycleCount += 4 * cl; // per bit
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        (this->*group2ByteHandlers[mrr.reg])(mrr, cl);
+    }
+    
+    // GRP2 ROL/ROR/RCL/RCR/SHL/SHR/SAR 16 bits CL
+    inline void CPU::group2EvCL(const DecodedInstruction &decoded) {
+        cycleCount += 4 * cl; // per bit
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        (this->*group2WordHandlers[mrr.reg])(mrr, cl);
+    }
+    
+    inline void CPU::unusedShift(ModRegRM mrr, byte amount) {
+        cout << "Unused opcode extension 110 for GRP2" << endl;
+    }
+    
+    // GRP3 TEST/NOT/NEG/MUL/IMUL/DIV/IDIV
+    inline void CPU::group3Eb(const DecodedInstruction &decoded) {
+        (this->*group3ByteHandlers[ModRegRM(decoded.modrm).reg])(decoded);
+    }
+    
+    inline void CPU::group3Ev(const DecodedInstruction &decoded) {
+        (this->*group3WordHandlers[ModRegRM(decoded.modrm).reg])(decoded);
+    }
+    
+    // TEST byte rm & immediate
+    inline void CPU::testEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp1 = getModRMByte(mrr);
+        byte temp2 = (byte) decoded.immediate;
+        andByte(temp1, temp2); // just for the flags
+    }
+    
+    // NOT one's complement (invert 1s and 0s) byte
+    inline void CPU::notEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setModRMByte(mrr, ~getModRMByte(mrr));
+    }
+    
+    // NEG two's complement byte
+    inline void CPU::negEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp1 = 0;
+        byte temp2 = getModRMByte(mrr);
+        subByte(temp1, temp2);
+        setModRMByte(mrr, temp1);
+    }
+    
+    // MUL 8 bit to 16 bit
+    inline void CPU::mulEb(const DecodedInstruction &decoded) {
+        materializeFlags();
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        ax = ((word) al) * ((word) temp);
+        if (ah == 0) {
+            carry = false;
+            overflow = false;
+        } else {
+            carry = true;
+            overflow = true;
+        }
+        // not required by documentation (undefined)
+        // but set so bios detect 8088 and cpu tests pass
+        
+        #ifdef CPU_TESTS
+        setSZPFlagsByte((byte)ax);
+        #else
+        setSZPFlagsWord(ax);
+        #endif
+    }
+    
+    // IMUL 8 bit to 16 bit
+    inline void CPU::imulEb(const DecodedInstruction &decoded) {
+        materializeFlags();
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        uint16_t result = ((int8_t) al) * ((int8_t) temp);
+        ax = (word)(result & 0xFFFF);
+        if (((signExtend(al) & 0xFF00) >> 8) == ah) {
+            carry = false;
+            overflow = false;
+        } else {
+            carry = true;
+            overflow = true;
+        }
+        setSZPFlagsByte((byte)result);
+    }
+    
+    // DIV 16 bit by 8 bit
+    inline void CPU::divEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        if (temp == 0) { // division by 0
+            jump = true;
+            performInterrupt(0);
+        } else {
+            word result = ax / temp;
+            if (result > 0xFF) { // overflow interrupt
                 jump = true;
-                break;
-            }
-            
-            // PUSHF
-            case 0x9C:
-                push(flags);
-                break;
-            
-            // POPF
-            case 0x9D:
-            {
-//                word whole = pop();
-//                word first = (whole >> 8) & 0x00FF;
-//                word second = whole & 0x00FF;
-//                flags = (second << 8) | first;
-                flags = pop();
-                setFlagsDefaults();
-                break;
-            }
-            
-            // SAHF store AH in flags
-            case 0x9E:
-                // flags = ((flags & 0xFF00) | ah);
-                sign = ah & 128;
-                zero = ah & 64;
-                auxiliaryCarry = ah & 16;
-                parity = ah & 4;
-                carry = ah & 1;
-                break;
-            
-            // LAHF copy low byte of flags word to AH
-            case 0x9F:
-                ah = ((byte) (flags & 0x00FF));
-//                ah = (ah & ~128) | (sign << 7);
-//                ah = (ah & ~64) | (zero << 6);
-//                ah = (ah & ~16) | (auxiliaryCarry << 4);
-//                ah = (ah & ~4) | (parity << 2);
-//                ah = (ah & ~1) | (carry);
-//                ah = 0;
-//                ah = (ah) | (sign << 7);
-//                ah = (ah) | (zero << 6);
-//                ah = (ah) | (auxiliaryCarry << 4);
-//                ah = (ah) | (parity << 2);
-//                ah = (ah) | (carry);
-                break;
-            
-            // MOV mem byte to AL
-            case 0xA0:
-            {
-                instructionLength = 3;
-                word location = memory.readWord(NEXT_INSTRUCTION + 1);
-                address pa = ((*currentSegment << 4) + location); // physical address
-                al = memory.readByte(pa);
-                break;
-            }
-            
-            // MOV mem word to AX
-            case 0xA1:
-            {
-                instructionLength = 3;
-                word location = memory.readWord(NEXT_INSTRUCTION + 1);
-                address pa = ((*currentSegment << 4) + location); // physical address
-                ax = memory.readWord(pa);
-                break;
-            }
-            
-            // MOV AL to mem byte
-            case 0xA2:
-            {
-                instructionLength = 3;
-                word location = memory.readWord(NEXT_INSTRUCTION + 1);
-                address pa = ((*currentSegment << 4) + location); // physical address
-                memory.setByte(pa, al);
-                break;
+                performInterrupt(0);
+            } else {
+                ah = ax % temp;
+                al = (byte)result;
             }
-            
-            // MOV AX to mem word
-            case 0xA3:
-            {
-                instructionLength = 3;
-                word location = memory.readWord(NEXT_INSTRUCTION + 1);
-                address pa = ((*currentSegment << 4) + location); // physical address
-                memory.setWord(pa, ax);
-                break;
-            }
-                
-            // MOVSB move string byte
-            case 0xA4:
-            {
-                repA4:
-                address fromPlace = (*currentSegment << 4) + si;
-                address toPlace = (es << 4) + di;
-                memory.setByte(toPlace, memory.readByte(fromPlace));
-                if (direction == 0) {
-                    di++;
-                    si++;
-                } else {
-                    di--;
-                    si--;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        goto repA4;
-                    }
-                }
+        }
+    }
+    
+    // IDIV 16 bit by 8 bit
+    inline void CPU::idivEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        int8_t temp = (int8_t)getModRMByte(mrr);
+        if (temp == 0) { // division by 0
+            jump = true;
+            performInterrupt(0);
+        } else {
+            int16_t result = ((int16_t)ax) / ((int16_t)temp);
+            if (result > 0x7F || result < -127) { // overflow interrupt
+                jump = true;
+                performInterrupt(0);
+            } else {
+                ah = ((int16_t)ax) % temp;
+                al = (byte)result;
                 
-                break;
             }
-            
-            // MOVSW move string word
-            case 0xA5:
-            {
-                repA5:
-                address fromPlace = (*currentSegment << 4) + si;
-                address toPlace = (es << 4) + di;
-                memory.setWord(toPlace, memory.readWord(fromPlace));
-                if (direction == 0) {
-                    di += 2;
-                    si += 2;
-                } else {
-                    di -= 2;
-                    si -= 2;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        goto repA5;
-                    }
-                }
-                
-                break;
+        }
+    }
+    
+    // TEST word rm & immediate
+    inline void CPU::testEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp1 = getModRMWord(mrr);
+        word temp2 = decoded.immediate;
+        andWord(temp1, temp2); // just for the flags
+    }
+    
+    // NOT one's complement (invert 1s and 0s) word
+    inline void CPU::notEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setModRMWord(mrr, ~getModRMWord(mrr));
+    }
+    
+    // NEG two's complement word
+    inline void CPU::negEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp1 = 0;
+        word temp2 = getModRMWord(mrr);
+        subWord(temp1, temp2);
+        setModRMWord(mrr, temp1);
+    }
+    
+    // MUL 16 bit to 32 bit
+    inline void CPU::mulEv(const DecodedInstruction &decoded) {
+        materializeFlags();
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        address result = ((address) ax) * ((address) temp);
+        ax = (word)(result & 0xFFFF);
+        Dx = (word)((result >> 16) & 0xFFFF);
+        if (Dx == 0) {
+            carry = false;
+            overflow = false;
+        } else {
+            carry = true;
+            overflow = true;
+        }
+        setSZPFlagsWord((word) result);
+    }
+    
+    // IMUL 16 bit to 32 bit
+    inline void CPU::imulEv(const DecodedInstruction &decoded) {
+        materializeFlags();
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        uint32_t result = ((int16_t) ax) * ((int16_t) temp);
+        ax = (word)(result & 0xFFFF);
+        Dx = (word)((result >> 16) & 0xFFFF);
+        if (((ax & 0x8000) && Dx == 0xFFFF) || (ax >> 15 == 0 && Dx == 0)) {
+            carry = false;
+            overflow = false;
+        } else {
+            carry = true;
+            overflow = true;
+        }
+        setSZPFlagsWord((word)result);
+    }
+    
+    // DIV 32 bit by 16 bit
+    inline void CPU::divEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        if (temp == 0) { // division by 0
+            jump = true;
+            performInterrupt(0);
+        } else {
+            address combined = (((address)Dx) << 16) | ((address)ax);
+            address result = combined / temp;
+            if (result > 0xFFFF) { // overflow interrupt
+                jump = true;
+                performInterrupt(0);
+            } else {
+                ax = (word)result;
+                Dx = combined % temp;
             }
-                
-                // CMPSB compare strings byte
-                case 0xA6:
-                {
-                    repA6:
-                    address place1 = (*currentSegment << 4) + si;
-                    address place2 = (es << 4) + di;
-                    //cout << place <<  " : ";
-                    //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
-                    byte temp1 = memory.readByte(place1);
-                    byte temp2 = memory.readByte(place2);
-                    subByte(temp1, temp2);
-                    if (direction == 0) {
-                        di++;
-                        si++;
-                    } else {
-                        di--;
-                        si--;
-                    }
-                    
-                    if (repeatCX) {
-                        cx--;
-                        if (cx > 0) {
-                            if (!repeatZF && zero == true) {
-                                break;
-                            }
-                            if (repeatZF && zero == false) {
-                                break;
-                            }
-                            goto repA6;
-                        }
-                    }
-                    
-                    break;
-                }
-                
-                // CMPSW compare strings
-                case 0xA7:
-                {
-                    repA7:
-                    address place1 = (*currentSegment << 4) + si;
-                    address place2 = (es << 4) + di;
-                    //cout << place <<  " : ";
-                    //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
-                    word temp1 = memory.readWord(place1);
-                    word temp2 = memory.readWord(place2);
-                    subWord(temp1, temp2);
-                    if (direction == 0) {
-                        di += 2;
-                        si += 2;
-                    } else {
-                        di -= 2;
-                        si -= 2;
-                    }
-                    
-                    if (repeatCX) {
-                        cx--;
-                        if (cx > 0) {
-                            if (!repeatZF && zero == true) {
-                                break;
-                            }
-                            if (repeatZF && zero == false) {
-                                break;
-                            }
-                            goto repA7;
-                        }
-                    }
-                    
-                    break;
-                }
-                
-            // TEST AL & immediate
-            case 0xA8:
-            {
-                byte temp = memory.readByte(NEXT_INSTRUCTION + 1);
-                instructionLength = 2;
-                byte result = al & temp;
-                setSZPFlagsByte(result);
-                carry = false;
-                overflow = false;
-                break;
+        }
+    }
+    
+    // IDIV 32 bit by 16 bit
+    inline void CPU::idivEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        int16_t temp = (int16_t)getModRMWord(mrr);
+        if (temp == 0) { // division by 0
+            jump = true;
+            performInterrupt(0);
+        } else {
+            int32_t combined = (int32_t)((((address)Dx) << 16) | ((address)ax));
+            int32_t result = (int32_t)combined / ((int32_t)temp);
+            if (result > 0x7FFF || result < -32767) { // overflow interrupt
+                jump = true;
+                performInterrupt(0);
+            } else {
+                ax = (word)result;
+                Dx = combined % temp;
             }
-            
-            // TEST AX & immediate
-            case 0xA9:
-            {
-                word temp = memory.readWord(NEXT_INSTRUCTION + 1);
-                instructionLength = 3;
-                word result = ax & temp;
-                setSZPFlagsWord(result);
-                carry = false;
-                overflow = false;
-                break;
+        }
+    }
+    
+    // GRP4 INC/DEC byte
+    inline void CPU::group4Eb(const DecodedInstruction &decoded) {
+        (this->*group4Handlers[ModRegRM(decoded.modrm).reg])(decoded);
+    }
+    
+    // INC increment byte by 1
+    inline void CPU::incEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        incByte(temp);
+        setModRMByte(mrr, temp);
+    }
+    
+    // DEC decrement byte by 1
+    inline void CPU::decEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        decByte(temp);
+        setModRMByte(mrr, temp);
+    }
+    
+    // GRP5 INC/DEC/CALL/JMP/PUSH word
+    inline void CPU::group5Ev(const DecodedInstruction &decoded) {
+        (this->*group5Handlers[ModRegRM(decoded.modrm).reg])(decoded);
+    }
+    
+    // INC increment word by 1
+    inline void CPU::incEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        incWord(temp);
+        setModRMWord(mrr, temp);
+    }
+    
+    // DEC decrement word by 1
+    inline void CPU::decEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        decWord(temp);
+        setModRMWord(mrr, temp);
+    }
+    
+    // CALL within segment indirect
+    inline void CPU::callEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        push(ip + instructionLength);
+        word temp = getModRMWord(mrr);
+        ip = temp;
+        jump = true;
+    }
+    
+    // CALL inter-segment indirect
+    inline void CPU::callMp(const DecodedInstruction &decoded) {
+        push(cs);
+        push(ip + instructionLength);
+        // next two instructions are new ip
+        // can't change ip until after have read CS
+        address pa = calcPhysicalAddress(); // physical address
+        ip = memory.readWord(pa);
+        setCS(memory.readWord(pa + 2));
+        jump = true;
+    }
+    
+    // JMP within segment, indirect
+    inline void CPU::jmpEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        ip = getModRMWord(mrr);
+        jump = true;
+    }
+    
+    // JMP inter-segment, indirect
+    inline void CPU::jmpMp(const DecodedInstruction &decoded) {
+        address temp = calcPhysicalAddress();
+        ip = memory.readWord(temp);
+        setCS(memory.readWord(temp + 2));
+        jump = true;
+    }
+    
+    // PUSH modrm
+    inline void CPU::pushEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        push(getModRMWord(mrr));
+    }
+    
+    // reg field values with nothing behind them in GRP3/4/5
+    inline void CPU::unimplementedGroupOpcode(const DecodedInstruction &decoded) {
+        cout << "unimplemented " << hex << uppercase << (int)decoded.opcode << dec << " opcode" << endl;
+    }
+    
+    // TEST
+    inline void CPU::testGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp1 = getRegByte(mrr.reg);
+        byte temp2 = getModRMByte(mrr);
+        andByte(temp1, temp2); // just for the flags
+    }
+    
+    // TEST
+    inline void CPU::testGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp1 = getRegWord(mrr.reg);
+        word temp2 = getModRMWord(mrr);
+        andWord(temp1, temp2); // just for the flags
+    }
+    
+    // XCHG byte reg to modrm
+    inline void CPU::xchgGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte temp = getModRMByte(mrr);
+        setModRMByte(mrr, getRegByte(mrr.reg));
+        setRegByte(mrr.reg, temp);
+    }
+    
+    // XCHG word reg to modrm
+    inline void CPU::xchgGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word temp = getModRMWord(mrr);
+        setModRMWord(mrr, getRegWord(mrr.reg));
+        setRegWord(mrr.reg, temp);
+    }
+    
+    // MOV byte reg to rm
+    inline void CPU::movEbGb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setModRMByte(mrr, getRegByte(mrr.reg));
+    }
+    
+    // MOV word reg to rm
+    inline void CPU::movEvGv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setModRMWord(mrr, getRegWord(mrr.reg));
+    }
+    
+    // MOV byte rm to reg
+    inline void CPU::movGbEb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setRegByte(mrr.reg, getModRMByte(mrr));
+    }
+    
+    // MOV word rm to reg
+    inline void CPU::movGvEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setRegWord(mrr.reg, getModRMWord(mrr));
+    }
+    
+    // MOV segment register to rm
+    inline void CPU::movEwSw(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setModRMWord(mrr, getSegmentRegWord(mrr.reg));
+    }
+    
+    // LEA
+    inline void CPU::leaGvM(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        address ea = calcEffectiveAddress();
+        setRegWord(mrr.reg, ea);
+    }
+    
+    // MOV rm to segment register
+    inline void CPU::movSwEw(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setSegmentRegWord(mrr.reg, getModRMWord(mrr));
+    }
+    
+    // POP
+    inline void CPU::popEv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        setModRMWord(mrr, pop());
+    }
+    
+    // NOP no op (technically XCHG AX with AX)
+    inline void CPU::nop(const DecodedInstruction &decoded) {
+    }
+    
+    // XCHG AX w/ CX
+    inline void CPU::xchgCXAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = cx;
+        cx = temp;
+    }
+    
+    // XCHG AX w/ DX
+    inline void CPU::xchgDXAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = Dx;
+        Dx = temp;
+    }
+    
+    // XCHG AX w/ BX
+    inline void CPU::xchgBXAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = bx;
+        bx = temp;
+    }
+    
+    // XCHG AX w/ SP
+    inline void CPU::xchgSPAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = sp;
+        sp = temp;
+    }
+    
+    // XCHG AX w/ BP
+    inline void CPU::xchgBPAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = bp;
+        bp = temp;
+    }
+    
+    // XCHG AX w/ SI
+    inline void CPU::xchgSIAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = si;
+        si = temp;
+    }
+    
+    // XCHG AX w/ DI
+    inline void CPU::xchgDIAX(const DecodedInstruction &decoded) {
+        word temp = ax;
+        ax = di;
+        di = temp;
+    }
+    
+    // CBW Convert Byte to Word
+    inline void CPU::cbw(const DecodedInstruction &decoded) {
+        if ((al & 0x80) == 0x80) {
+            ah = 0xFF;
+        } else {
+            ah = 0;
+        }
+    }
+    
+    // CWD Convert Word to Doubleword
+    inline void CPU::cwd(const DecodedInstruction &decoded) {
+        if ((ax & 0x8000) == 0x8000) {
+            Dx = 0xFFFF;
+        } else {
+            Dx = 0;
+        }
+    }
+    
+    // CALL direct
+    inline void CPU::callAp(const DecodedInstruction &decoded) {
+        push(cs);
+        push(ip + instructionLength);
+        // next two instructions are new ip
+        // can't change ip until after have read CS
+        word nextIp = decoded.immediate;
+        // next two after that are new cs
+        word nextCs = decoded.immediate2;
+        ip = nextIp;
+        setCS(nextCs);
+        jump = true;
+    }
+    
+    // PUSHF
+    inline void CPU::pushf(const DecodedInstruction &decoded) {
+        materializeFlags();
+        push(flags);
+    }
+    
+    // POPF
+    inline void CPU::popf(const DecodedInstruction &decoded) {
+        //                word whole = pop();
+        //                word first = (whole >> 8) & 0x00FF;
+        //                word second = whole & 0x00FF;
+        //                flags = (second << 8) | first;
+        flags = pop();
+        lazyOp = LAZY_NONE;
+        setFlagsDefaults();
+    }
+    
+    // SAHF store AH in flags
+    inline void CPU::sahf(const DecodedInstruction &decoded) {
+        materializeFlags();
+        // flags = ((flags & 0xFF00) | ah);
+        sign = ah & 128;
+        zero = ah & 64;
+        auxiliaryCarry = ah & 16;
+        parity = ah & 4;
+        carry = ah & 1;
+    }
+    
+    // LAHF copy low byte of flags word to AH
+    inline void CPU::lahf(const DecodedInstruction &decoded) {
+        materializeFlags();
+        ah = ((byte) (flags & 0x00FF));
+        //                ah = (ah & ~128) | (sign << 7);
+        //                ah = (ah & ~64) | (zero << 6);
+        //                ah = (ah & ~16) | (auxiliaryCarry << 4);
+        //                ah = (ah & ~4) | (parity << 2);
+        //                ah = (ah & ~1) | (carry);
+        //                ah = 0;
+        //                ah = (ah) | (sign << 7);
+        //                ah = (ah) | (zero << 6);
+        //                ah = (ah) | (auxiliaryCarry << 4);
+        //                ah = (ah) | (parity << 2);
+        //                ah = (ah) | (carry);
+    }
+    
+    // MOV mem byte to AL
+    inline void CPU::movALOb(const DecodedInstruction &decoded) {
+        word location = decoded.immediate;
+        address pa = ((*currentSegment << 4) + location); // physical address
+        al = memory.readByte(pa);
+    }
+    
+    // MOV mem word to AX
+    inline void CPU::movAXOv(const DecodedInstruction &decoded) {
+        word location = decoded.immediate;
+        address pa = ((*currentSegment << 4) + location); // physical address
+        ax = memory.readWord(pa);
+    }
+    
+    // MOV AL to mem byte
+    inline void CPU::movObAL(const DecodedInstruction &decoded) {
+        word location = decoded.immediate;
+        address pa = ((*currentSegment << 4) + location); // physical address
+        memory.setByte(pa, al);
+    }
+    
+    // MOV AX to mem word
+    inline void CPU::movOvAX(const DecodedInstruction &decoded) {
+        word location = decoded.immediate;
+        address pa = ((*currentSegment << 4) + location); // physical address
+        memory.setWord(pa, ax);
+    }
+    
+    // REP string instructions are done in one go where their elements lie in
+    // one run of memory, and one element at a time where they don't. Either
+    // way it's in chunks of at most REPEAT_CHUNK elements, after which the
+    // instruction is suspended and restarted, prefixes and all, the same as
+    // when the 8086 takes an interrupt in the middle of one. That way the
+    // PC gets to run the timer and deliver interrupts during long copies.
+    
+    // Come back to this instruction to carry on with the rest of cx
+    inline void CPU::suspendRepeat() {
+        ip -= prefixCount;
+        jump = true;
+    }
+    
+    // Where count elements of size bytes from segment:offset lie in memory,
+    // or false if they wrap around the segment or off the end of memory, or
+    // aren't all plain memory (RAM, or ROM if just reading)
+    inline bool CPU::stringBlock(word segment, word offset, word count, byte size, bool write, address &start) {
+        const address length = (address) count * size;
+        address low;
+        if (direction == 0) {
+            if ((address) offset + length > 0x10000) {
+                return false;
+            }
+            low = offset;
+        } else {
+            if ((address) offset + size < length) {
+                return false;
             }
-            
-            // STOSB store string byte
-            case 0xAA:
-            {
-                repAA:
-                address place = (es << 4) + di;
-                //cout << place <<  " : ";
-                //cout << hex << uppercase << setfill('0') << setw(2) << al << endl;
-                memory.setByte(place, al);
-                if (direction == 0) {
-                    di++;
-                } else {
-                    di--;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        goto repAA;
-                    }
-                }
-                
-                break;
+            low = (address) offset + size - length;
+        }
+        start = ((address) segment << 4) + low;
+        if (memory.isWatched(start, length, write ? WATCH_WRITE : WATCH_READ)) {
+            return false; // each element has to be looked at
+        }
+        return write ? memory.isWritable(start, length) : memory.isReadable(start, length);
+    }
+    
+    // Whether there's nothing to repeat, in which case the instruction
+    // only takes its set up time
+    inline bool CPU::emptyRepeat() {
+        if (cx != 0) {
+            return false;
+        }
+        cycleCount -= repeatCycles[currentInstruction->opcode - 0xA4];
+        return true;
+    }
+    
+    // Move si and/or di past count elements and take them off of cx
+    inline void CPU::finishRepeat(word count, byte size, bool source, bool destination) {
+        const word distance = count * size;
+        if (direction == 0) {
+            if (source) { si += distance; }
+            if (destination) { di += distance; }
+        } else {
+            if (source) { si -= distance; }
+            if (destination) { di -= distance; }
+        }
+        cycleCount += (count - 1) * repeatCycles[currentInstruction->opcode - 0xA4];
+        cx -= count;
+    }
+    
+    // what's left of cx, up to a chunk
+    static inline word repeatChunk(word cx) {
+        return (cx < REPEAT_CHUNK) ? cx : REPEAT_CHUNK;
+    }
+    
+    // Which of count elements of size bytes at block (lowest first) is the
+    // first one taken on in direction order, nth
+    inline const byte *CPU::stringElement(const byte *block, word count, byte size, word nth) {
+        return block + ((direction == 0) ? nth : (count - 1 - nth)) * size;
+    }
+    
+    // Read an element straight out of memory, little endian
+    static inline word elementValue(const byte *element, byte size) {
+        return (size == 1) ? element[0] : (word) (element[0] | (element[1] << 8));
+    }
+    
+    inline bool CPU::repeatMovs(byte size) {
+        const word count = repeatChunk(cx);
+        address from, to;
+        if (!stringBlock(*currentSegment, si, count, size, false, from) || !stringBlock(es, di, count, size, true, to)) {
+            return false;
+        }
+        const address length = (address) count * size;
+        if (from < to + length && to < from + length) {
+            return false; // overlapping copies repeat a pattern one element at a time
+        }
+        memory.copyBlock(to, from, length);
+        finishRepeat(count, size, true, true);
+        if (cx != 0) {
+            suspendRepeat();
+        }
+        return true;
+    }
+    
+    inline bool CPU::repeatStos(byte size) {
+        const word count = repeatChunk(cx);
+        address to;
+        if (!stringBlock(es, di, count, size, true, to)) {
+            return false;
+        }
+        memory.fillBlock(to, (address) count * size, al, (size == 1) ? al : ah);
+        finishRepeat(count, size, false, true);
+        if (cx != 0) {
+            suspendRepeat();
+        }
+        return true;
+    }
+    
+    // only the last element loaded matters
+    inline bool CPU::repeatLods(byte size) {
+        const word count = repeatChunk(cx);
+        address from;
+        if (!stringBlock(*currentSegment, si, count, size, false, from)) {
+            return false;
+        }
+        const word last = elementValue(stringElement(memory.readBlock(from), count, size, count - 1), size);
+        if (size == 1) {
+            al = (byte) last;
+        } else {
+            ax = last;
+        }
+        finishRepeat(count, size, true, false);
+        if (cx != 0) {
+            suspendRepeat();
+        }
+        return true;
+    }
+    
+    inline bool CPU::repeatScas(const DecodedInstruction &decoded, byte size) {
+        const word count = repeatChunk(cx);
+        address place;
+        if (!stringBlock(es, di, count, size, false, place)) {
+            return false;
+        }
+        const byte *block = memory.readBlock(place);
+        const word target = (size == 1) ? al : ax;
+        word done = count;
+        bool stopped = false; // by the zero flag
+        if (size == 1 && direction == 0 && !decoded.repeatZF) {
+            // REPNE SCASB forward, the usual strlen, is just memchr
+            const void *found = memchr(block, al, count);
+            if (found != nullptr) {
+                done = (word) ((const byte *) found - block) + 1;
+                stopped = true;
             }
-            
-            // STOSW store string word
-            case 0xAB:
-            {
-                repAB:
-                address place = (es << 4) + di;
-                //cout << place <<  " : ";
-                //cout << hex << uppercase << setfill('0') << setw(4) << ax << endl;
-                memory.setWord(place, ax);
-                if (direction == 0) {
-                    di += 2;
-                } else {
-                    di -= 2;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        goto repAB;
-                    }
+        } else {
+            for (word nth = 0; nth < count; nth++) {
+                if ((elementValue(stringElement(block, count, size, nth), size) == target) != decoded.repeatZF) {
+                    done = nth + 1;
+                    stopped = true;
+                    break;
                 }
-                
-                break;
             }
-            
-            // LODSB load string byte
-            case 0xAC:
-            {
-                repAC:
-                address place = (*currentSegment << 4) + si;
-                //cout << place <<  " : ";
-                //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
-                al = memory.readByte(place);
-                if (direction == 0) {
-                    si++;
-                } else {
-                    si--;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        goto repAC;
-                    }
-                }
-                
+        }
+        // flags from the last comparison
+        const word last = elementValue(stringElement(block, count, size, done - 1), size);
+        if (size == 1) {
+            byte temp = al;
+            subByte(temp, (byte) last);
+        } else {
+            word temp = ax;
+            subWord(temp, last);
+        }
+        finishRepeat(done, size, false, true);
+        if (!stopped && cx != 0) {
+            suspendRepeat();
+        }
+        return true;
+    }
+    
+    inline bool CPU::repeatCmps(const DecodedInstruction &decoded, byte size) {
+        const word count = repeatChunk(cx);
+        address place1, place2;
+        if (!stringBlock(*currentSegment, si, count, size, false, place1) || !stringBlock(es, di, count, size, false, place2)) {
+            return false;
+        }
+        const byte *block1 = memory.readBlock(place1);
+        const byte *block2 = memory.readBlock(place2);
+        word done = count;
+        bool stopped = false; // by the zero flag
+        for (word nth = 0; nth < count; nth++) {
+            if ((elementValue(stringElement(block1, count, size, nth), size) == elementValue(stringElement(block2, count, size, nth), size)) != decoded.repeatZF) {
+                done = nth + 1;
+                stopped = true;
                 break;
             }
-            
-            // LODSW load string word
-            case 0xAD:
-            {
-                repAD:
-                address place = (*currentSegment << 4) + si;
-                ax = memory.readWord(place);
-                if (direction == 0) {
-                    si += 2;
-                } else {
-                    si -= 2;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        goto repAD;
-                    }
+        }
+        // flags from the last comparison
+        const word last1 = elementValue(stringElement(block1, count, size, done - 1), size);
+        const word last2 = elementValue(stringElement(block2, count, size, done - 1), size);
+        if (size == 1) {
+            byte temp = (byte) last1;
+            subByte(temp, (byte) last2);
+        } else {
+            word temp = last1;
+            subWord(temp, last2);
+        }
+        finishRepeat(done, size, true, true);
+        if (!stopped && cx != 0) {
+            suspendRepeat();
+        }
+        return true;
+    }
+    
+    // MOVSB move string byte
+    inline void CPU::movsb(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatMovs(1))) {
+            return;
+        }
+        repA4:
+        address fromPlace = (*currentSegment << 4) + si;
+        address toPlace = (es << 4) + di;
+        memory.setByte(toPlace, memory.readByte(fromPlace));
+        if (direction == 0) {
+            di++;
+            si++;
+        } else {
+            di--;
+            si--;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                
-                break;
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repA4;
             }
-            
-            // SCASB scan string byte
-            case 0xAE:
-            {
-                repAE:
-                address place = (es << 4) + di;
-                //cout << place <<  " : ";
-                //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
-                byte temp1 = al;
-                byte temp2 = memory.readByte(place);
-                subByte(temp1, temp2);
-                if (direction == 0) {
-                    di++;
-                } else {
-                    di--;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        if (!repeatZF && zero == true) {
-                            break;
-                        }
-                        if (repeatZF && zero == false) {
-                            break;
-                        }
-                        goto repAE;
-                    }
+        }
+    }
+    
+    // MOVSW move string word
+    inline void CPU::movsw(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatMovs(2))) {
+            return;
+        }
+        repA5:
+        address fromPlace = (*currentSegment << 4) + si;
+        address toPlace = (es << 4) + di;
+        memory.setWord(toPlace, memory.readWord(fromPlace));
+        if (direction == 0) {
+            di += 2;
+            si += 2;
+        } else {
+            di -= 2;
+            si -= 2;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                
-                break;
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repA5;
             }
-            
-            // SCASW scan string word
-            case 0xAF:
-            {
-                repAF:
-                address place = (es << 4) + di;
-                word temp1 = ax;
-                word temp2 = memory.readWord(place);
-                subWord(temp1, temp2);
-                if (direction == 0) {
-                    di += 2;
-                } else {
-                    di -= 2;
-                }
-                
-                if (repeatCX) {
-                    cx--;
-                    if (cx > 0) {
-                        if (!repeatZF && zero == true) {
-                            break;
-                        }
-                        if (repeatZF && zero == false) {
-                            break;
-                        }
-                        goto repAF;
-                    }
+        }
+    }
+    
+    // CMPSB compare strings byte
+    inline void CPU::cmpsb(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatCmps(decoded, 1))) {
+            return;
+        }
+        repA6:
+        address place1 = (*currentSegment << 4) + si;
+        address place2 = (es << 4) + di;
+        //cout << place <<  " : ";
+        //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
+        byte temp1 = memory.readByte(place1);
+        byte temp2 = memory.readByte(place2);
+        subByte(temp1, temp2);
+        if (direction == 0) {
+            di++;
+            si++;
+        } else {
+            di--;
+            si--;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (!decoded.repeatZF && getZero() == true) {
+                    return;
                 }
-                
-                break;
-            }
-                
-            // MOV Byte move data to register
-            case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB6: case 0xB7:
-                setReg(lowNibble(opcode), memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                break;
-            
-            // MOV Word move data to register
-            case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBE: case 0xBF:
-                setReg(lowNibble(opcode), memory.readWord(NEXT_INSTRUCTION + 1));
-                instructionLength = 3;
-                break;
-                
-            // RET intrasegment and add displacement
-            case 0xC2:
-            {
-                word displacement = memory.readWord(NEXT_INSTRUCTION + 1);
-                jump = true;
-                ip = pop();
-                sp += displacement;
-                break;
-            }
-            
-            // RET intra-segment
-            case 0xC3:
-                jump = true;
-                ip = pop();
-                // cout << ip << endl;
-                break;
-                
-            // LES ES
-            case 0xC4:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                address temp = calcPhysicalAddress(mrr);
-                word operand1 = memory.readWord(temp);
-                word operand2 = memory.readWord(temp + 2);
-                setRegWord(mrr.reg, operand1);
-                es = operand2;
-                break;
-            }
-                
-            // LES DS
-            case 0xC5:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                address temp = calcPhysicalAddress(mrr);
-                word operand1 = memory.readWord(temp);
-                word operand2 = memory.readWord(temp + 2);
-                setRegWord(mrr.reg, operand1);
-                ds = operand2;
-                break;
-            }
-            
-            // MOV immediate byte to rm
-            case 0xC6:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                byte data = memory.readByte(NEXT_INSTRUCTION + instructionLength);
-                instructionLength += 1;
-                setModRMByte(mrr, data);
-                break;
-            }
-            
-            // MOV immediate word to rm
-            case 0xC7:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                word data = memory.readWord(NEXT_INSTRUCTION + instructionLength);
-                instructionLength += 2;
-                setModRMWord(mrr, data);
-                break;
-            }
-            
-            // RET intersegment and add displacement
-            case 0xCA:
-            {
-                word displacement = memory.readWord(NEXT_INSTRUCTION + 1);
-                jump = true;
-                ip = pop();
-                cs = pop();
-                sp += displacement;
-                break;
-            }
-            
-            // RET intra-segment
-            case 0xCB:
-                jump = true;
-                ip = pop();
-                cs = pop();
-                break;
-            
-            // INT (always 3)
-            case 0xCC:
-                jump = true;
-                ip += instructionLength; // iret just past here
-                performInterrupt(3);
-                break;
-            
-            // INT type
-            case 0xCD:
-            {
-                instructionLength = 2;
-                byte type = memory.readByte(NEXT_INSTRUCTION + 1);
-                jump = true;
-                ip += instructionLength; // iret just past here
-                performInterrupt(type);
-                break;
-            }
-                
-            // INTO overflow interrupt
-            case 0xCE:
-                if (overflow) {
-                    jump=true;
-                    ip += instructionLength; // iret just past here
-                    performInterrupt(4);
+                if (decoded.repeatZF && getZero() == false) {
+                    return;
                 }
-                break;
-                
-                
-            // IRET
-            case 0xCF:
-                jump = true;
-                ip = pop();
-                cs = pop();
-                flags = pop();
-                setFlagsDefaults();
-                break;
-            
-            // ROL/ROR/RCL/RCR/SHL/SHR/SAR/ROL 8 bits 1
-            case 0xD0:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000:
-                        rolByte(mrr, 1);
-                        break;
-                    case 0b001:
-                        rorByte(mrr, 1);
-                        break;
-                    case 0b010:
-                        rclByte(mrr, 1);
-                        break;
-                    case 0b011:
-                        rcrByte(mrr, 1);
-                        break;
-                    case 0b100:
-                        shlByte(mrr, 1);
-                        break;
-                    case 0b101:
-                        shrByte(mrr, 1);
-                        break;
-                    case 0b110:
-                        cout << "Unused opcode extension 110 for 0xD2" << endl;
-                        break;
-                    case 0b111:
-                        sarByte(mrr, 1);
-                        break;
-                        
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                break;
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repA6;
             }
-                
-                // ROL/ROR/RCL/RCR/SHL/SHR/SAR/ROL 16 bits 1
-            case 0xD1:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000:
-                        rolWord(mrr, 1);
-                        break;
-                    case 0b001:
-                        rorWord(mrr, 1);
-                        break;
-                    case 0b010:
-                        rclWord(mrr, 1);
-                        break;
-                    case 0b011:
-                        rcrWord(mrr, 1);
-                        break;
-                    case 0b100:
-                        shlWord(mrr, 1);
-                        break;
-                    case 0b101:
-                        shrWord(mrr, 1);
-                        break;
-                    case 0b110:
-                        cout << "Unused opcode extension 110 for 0xD3" << endl;
-                        break;
-                    case 0b111:
-                        sarWord(mrr, 1);
-                        break;
-                        
+        }
+    }
+    
+    // CMPSW compare strings
+    inline void CPU::cmpsw(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatCmps(decoded, 2))) {
+            return;
+        }
+        repA7:
+        address place1 = (*currentSegment << 4) + si;
+        address place2 = (es << 4) + di;
+        //cout << place <<  " : ";
+        //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
+        word temp1 = memory.readWord(place1);
+        word temp2 = memory.readWord(place2);
+        subWord(temp1, temp2);
+        if (direction == 0) {
+            di += 2;
+            si += 2;
+        } else {
+            di -= 2;
+            si -= 2;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (!decoded.repeatZF && getZero() == true) {
+                    return;
                 }
-                break;
-            }
-                
-            // ROL/ROR/RCL/RCR/SHL/SHR/SAR/ROL 8 bits CL
-            case 0xD2:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000:
-                        rolByte(mrr, cl);
-                        break;
-                    case 0b001:
-                        rorByte(mrr, cl);
-                        break;
-                    case 0b010:
-                        rclByte(mrr, cl);
-                        break;
-                    case 0b011:
-                        rcrByte(mrr, cl);
-                        break;
-                    case 0b100:
-                        shlByte(mrr, cl);
-                        break;
-                    case 0b101:
-                        shrByte(mrr, cl);
-                        break;
-                    case 0b110:
-                        cout << "Unused opcode extension 110 for 0xD2" << endl;
-                        break;
-                    case 0b111:
-                        sarByte(mrr, cl);
-                        break;
-                    
+                if (decoded.repeatZF && getZero() == false) {
+                    return;
                 }
-                break;
-            }
-                
-            // ROL/ROR/RCL/RCR/SHL/SHR/SAR/ROL 16 bits CL
-            case 0xD3:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000:
-                        rolWord(mrr, cl);
-                        break;
-                    case 0b001:
-                        rorWord(mrr, cl);
-                        break;
-                    case 0b010:
-                        rclWord(mrr, cl);
-                        break;
-                    case 0b011:
-                        rcrWord(mrr, cl);
-                        break;
-                    case 0b100:
-                        shlWord(mrr, cl);
-                        break;
-                    case 0b101:
-                        shrWord(mrr, cl);
-                        break;
-                    case 0b110:
-                        cout << "Unused opcode extension 110 for 0xD3" << endl;
-                        break;
-                    case 0b111:
-                        sarWord(mrr, cl);
-                        break;
-                        
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                break;
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repA7;
             }
-                
-            // AAM ASCII Adjust for Multiplication (long opcode usually, D4, 0A - two bytes)
-            // technically other second bytes will work, may be used by some obscure software
-            case 0xD4:
-            {
-                instructionLength = 2;
-                // next byte is usually 10 but can be used otherwise
-                byte operand = memory.readByte(NEXT_INSTRUCTION + 1);
-                if (operand == 0) { // division by 0
-                    jump = true;
-                    performInterrupt(0);
-                } else {
-                    byte oldAL = al;
-                    ah = al / operand;
-                    al = oldAL % operand;
-                    setSZPFlagsByte(al);
+        }
+    }
+    
+    // TEST AL & immediate
+    inline void CPU::testALIb(const DecodedInstruction &decoded) {
+        byte temp = (byte) decoded.immediate;
+        byte result = al;
+        andByte(result, temp); // just for the flags
+    }
+    
+    // TEST AX & immediate
+    inline void CPU::testAXIv(const DecodedInstruction &decoded) {
+        word temp = decoded.immediate;
+        word result = ax;
+        andWord(result, temp); // just for the flags
+    }
+    
+    // STOSB store string byte
+    inline void CPU::stosb(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatStos(1))) {
+            return;
+        }
+        repAA:
+        address place = (es << 4) + di;
+        //cout << place <<  " : ";
+        //cout << hex << uppercase << setfill('0') << setw(2) << al << endl;
+        memory.setByte(place, al);
+        if (direction == 0) {
+            di++;
+        } else {
+            di--;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                break;
-            }
-            
-            // AAD ASCII Adjust for Division (long opcode usually, D5, 0A - two bytes)
-            // technically other second bytes will work, may be used by some obscure software
-            case 0xD5:
-            {
-                instructionLength = 2;
-                // next byte is usually 10 but can be used otherwise
-                byte operand = memory.readByte(NEXT_INSTRUCTION + 1);
-                al = ((word)al + ((word)ah * (word)operand)) & 0xFF;
-                
-                ah = 0;
-                setSZPFlagsByte(al);
-                //sign = 0;
-                overflow = false;
-                carry = false;
-                break;
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repAA;
             }
-                
-            // XLAT
-            case 0xD7:
-                al = memory.readByte((*currentSegment << 4) + bx + al);
-                break;
-                
-            // LOOPNE, LOOPNZ branch if CX non-zero and ZF = 0
-            case 0xE0:
-                cx--;
-                if (cx != 0 && zero == false) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // LOOPE, LOOPZ branch if CX non-zero and ZF = 1
-            case 0xE1:
-                cx--;
-                if (cx != 0 && zero == true) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-            
-            // LOOP branch if CX non-zero
-            case 0xE2:
-                cx--;
-                if (cx != 0) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
-                }
-                instructionLength = 2;
-                break;
-                
-            
-            // JCXZ Jump if CX is zero
-            case 0xE3:
-                if (cx == 0) {
-                    ip = (ip + 2) + signExtend(memory.readByte(NEXT_INSTRUCTION + 1));
-                    jump = true;
+        }
+    }
+    
+    // STOSW store string word
+    inline void CPU::stosw(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatStos(2))) {
+            return;
+        }
+        repAB:
+        address place = (es << 4) + di;
+        //cout << place <<  " : ";
+        //cout << hex << uppercase << setfill('0') << setw(4) << ax << endl;
+        memory.setWord(place, ax);
+        if (direction == 0) {
+            di += 2;
+        } else {
+            di -= 2;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                instructionLength = 2;
-                break;
-            
-            // IN fixed port to AL
-            case 0xE4:
-                instructionLength = 2;
-                al = portInterface.readPort(memory.readByte(NEXT_INSTRUCTION + 1));
-                break;
-            
-            // IN fixed port to AX
-            case 0xE5:
-                instructionLength = 2;
-                ax = portInterface.readPort(memory.readByte(NEXT_INSTRUCTION + 1));
-                break;
-            
-            // OUT from al
-            case 0xE6:
-                instructionLength = 2;
-                portInterface.writePort(memory.readByte(NEXT_INSTRUCTION + 1), al);
-                break;
-            
-            // OUT from ax
-            case 0xE7:
-                instructionLength = 2;
-                portInterface.writePort(memory.readByte(NEXT_INSTRUCTION + 1), ax);
-                break;
-                
-            // CALL within segment or group, ip relative; 16 bit displacement
-            case 0xE8:
-            {
-                instructionLength = 3;
-                push(ip + instructionLength);
-                // cout << (ip + instructionLength) << endl;
-                word displacement = memory.readWord(NEXT_INSTRUCTION + 1);
-                ip += (displacement + instructionLength);
-                jump = true;
-                break;
-            }
-                
-            // JMP within segment or group, ip relative; 16 bit displacement
-            case 0xE9:
-            {
-                instructionLength = 3;
-                word displacement = memory.readWord(NEXT_INSTRUCTION + 1);
-                ip += (displacement + instructionLength);
-                jump = true;
-                break;
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repAB;
             }
-                
-            // JMP direct
-            case 0xEA:
-            { // scope for new variables
-                // next two instructions are new ip
-                // can't change ip until after have read CS
-                word nextIp = memory.readWord(NEXT_INSTRUCTION + 1);
-                // next two after that are new cs
-                word nextCs = memory.readWord(NEXT_INSTRUCTION + 3);
-                ip = nextIp;
-                cs = nextCs;
-                jump = true;
-                instructionLength = 5;
-                break;
-            }
-                
-            // JMP within segment or group, ip relative; 8 bit displacement sign extend
-            case 0xEB:
-            {
-                instructionLength = 2;
-                byte displacement = memory.readByte(NEXT_INSTRUCTION + 1);
-                ip += signExtend(displacement);
-                break;
+        }
+    }
+    
+    // LODSB load string byte
+    inline void CPU::lodsb(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatLods(1))) {
+            return;
+        }
+        repAC:
+        address place = (*currentSegment << 4) + si;
+        //cout << place <<  " : ";
+        //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
+        al = memory.readByte(place);
+        if (direction == 0) {
+            si++;
+        } else {
+            si--;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
+                }
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repAC;
             }
-            
-            // IN variable port (DX) to al
-            case 0xEC:
-                al = portInterface.readPort(Dx);
-                break;
-            
-            // IN variable port (DX) to ax
-            case 0xED:
-                ax = portInterface.readPort(Dx);
-                break;
-                
-            // OUT to Dx from al
-            case 0xEE:
-                portInterface.writePort(Dx, al);
-                break;
-            
-            // OUT to Dx from ax
-            case 0xEF:
-                portInterface.writePort(Dx, ax);
-                break;
-            
-            // HLT
-            case 0xF4:
-                halted = true;
-                break;
-                
-            // CMC Complement Carry Flag
-            case 0xF5:
-                carry = !carry;
-                break;
-            
-            
-            case 0xF6:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000: // TEST
-                    {
-                        byte temp1 = getModRMByte(mrr);
-                        byte temp2 = memory.readByte(NEXT_INSTRUCTION + instructionLength);
-                        instructionLength += 1;
-                        byte result = temp1 & temp2;
-                        setSZPFlagsByte(result);
-                        carry = false;
-                        overflow = false;
-                        break;
-                    }
-                    
-                    case 0b010: // // NOT one's complement (invert 1s and 0s) byte
-                    {
-                        setModRMByte(mrr, ~getModRMByte(mrr));
-                        break;
-                    }
-                    
-                    case 0b011: //NEG two's complement
-                    {
-                        byte temp1 = 0;
-                        byte temp2 = getModRMByte(mrr);
-                        subByte(temp1, temp2);
-                        setModRMByte(mrr, temp1);
-                        if (temp2 == 0) {
-                            carry = 0;
-                        } else {
-                            carry = 1;
-                        }
-                        break;
-                    }
-                    case 0b100: // MUL 8 bit to 16 bit
-                    {
-                        byte temp = getModRMByte(mrr);
-                        ax = ((word) al) * ((word) temp);
-                        if (ah == 0) {
-                            carry = false;
-                            overflow = false;
-                        } else {
-                            carry = true;
-                            overflow = true;
-                        }
-                        // not required by documentation (undefined)
-                        // but set so bios detect 8088 and cpu tests pass
-                        
-                        #ifdef CPU_TESTS
-                        setSZPFlagsByte((byte)ax);
-                        #else
-                        setSZPFlagsWord(ax);
-                        #endif
-                        
-                        break;
-                    }
-                    case 0b101: // IMUL 8 bit to 16 bit
-                    {
-                        byte temp = getModRMByte(mrr);
-                        uint16_t result = ((int8_t) al) * ((int8_t) temp);
-                        ax = (word)(result & 0xFFFF);
-                        if (((signExtend(al) & 0xFF00) >> 8) == ah) {
-                            carry = false;
-                            overflow = false;
-                        } else {
-                            carry = true;
-                            overflow = true;
-                        }
-                        setSZPFlagsByte((byte)result);
-                        break;
-                    }
-                    case 0b110: // DIV 16 bit by 8 bit
-                    {
-                        byte temp = getModRMByte(mrr);
-                        if (temp == 0) { // division by 0
-                            jump = true;
-                            performInterrupt(0);
-                        } else {
-                            word result = ax / temp;
-                            if (result > 0xFF) { // overflow interrupt
-                                jump = true;
-                                performInterrupt(0);
-                            } else {
-                                ah = ax % temp;
-                                al = (byte)result;
-                            }
-                        }
-                        break;
-                    }
-                    case 0b111: // IDIV 16 bit by 8 bit
-                    {
-                        
-                        int8_t temp = (int8_t)getModRMByte(mrr);
-                        if (temp == 0) { // division by 0
-                            jump = true;
-                            performInterrupt(0);
-                        } else {
-                            int16_t result = ((int16_t)ax) / ((int16_t)temp);
-                            if (result > 0x7F || result < -127) { // overflow interrupt
-                                jump = true;
-                                performInterrupt(0);
-                            } else {
-                                ah = ((int16_t)ax) % temp;
-                                al = (byte)result;
-                                
-                            }
-                        }
-                        break;
-                    }
-                    default:
-                    {
-                        cout << "unimplemented F6 opcode" << endl;
-                        break;
-                    }
+        }
+    }
+    
+    // LODSW load string word
+    inline void CPU::lodsw(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatLods(2))) {
+            return;
+        }
+        repAD:
+        address place = (*currentSegment << 4) + si;
+        ax = memory.readWord(place);
+        if (direction == 0) {
+            si += 2;
+        } else {
+            si -= 2;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
                 }
-                break;
-                
-                
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repAD;
             }
-            
-            case 0xF7:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000: // TEST word
-                    {
-                        word temp1 = getModRMWord(mrr);
-                        word temp2 = memory.readWord(NEXT_INSTRUCTION + instructionLength);
-                        instructionLength += 2;
-                        word result = temp1 & temp2;
-                        setSZPFlagsWord(result);
-                        carry = false;
-                        overflow = false;
-                        break;
-                    }
-                    case 0b010: // // NOT one's complement (invert 1s and 0s) word
-                    {
-                        setModRMWord(mrr, ~getModRMWord(mrr));
-                        break;
-                    }
-                    case 0b011: //NEG two's complement
-                    {
-                        word temp1 = 0;
-                        word temp2 = getModRMWord(mrr);
-                        subWord(temp1, temp2);
-                        setModRMWord(mrr, temp1);
-                        if (temp2 == 0) {
-                            carry = 0;
-                        } else {
-                            carry = 1;
-                        }
-                        break;
-                    }
-                    case 0b100: // MUL 16 bit to 32 bit
-                    {
-                        word temp = getModRMWord(mrr);
-                        address result = ((address) ax) * ((address) temp);
-                        ax = (word)(result & 0xFFFF);
-                        Dx = (word)((result >> 16) & 0xFFFF);
-                        if (Dx == 0) {
-                            carry = false;
-                            overflow = false;
-                        } else {
-                            carry = true;
-                            overflow = true;
-                        }
-                        setSZPFlagsWord((word) result);
-                        break;
-                    }
-                    case 0b101: // IMUL 16 bit to 32 bit
-                    {
-                        word temp = getModRMWord(mrr);
-                        uint32_t result = ((int16_t) ax) * ((int16_t) temp);
-                        ax = (word)(result & 0xFFFF);
-                        Dx = (word)((result >> 16) & 0xFFFF);
-                        if (((ax & 0x8000) && Dx == 0xFFFF) || (ax >> 15 == 0 && Dx == 0)) {
-                            carry = false;
-                            overflow = false;
-                        } else {
-                            carry = true;
-                            overflow = true;
-                        }
-                        setSZPFlagsWord((word)result);
-                        break;
-                    }
-                    case 0b110: // DIV 32 bit by 16 bit
-                    {
-                        word temp = getModRMWord(mrr);
-                        if (temp == 0) { // division by 0
-                            jump = true;
-                            performInterrupt(0);
-                        } else {
-                            address combined = (((address)Dx) << 16) | ((address)ax);
-                            address result = combined / temp;
-                            if (result > 0xFFFF) { // overflow interrupt
-                                jump = true;
-                                performInterrupt(0);
-                            } else {
-                                ax = (word)result;
-                                Dx = combined % temp;
-                            }
-                        }
-                        break;
-                    }
-                    case 0b111: // IDIV 32 bit by 16 bit
-                    {
-                        int16_t temp = (int16_t)getModRMWord(mrr);
-                        if (temp == 0) { // division by 0
-                            jump = true;
-                            performInterrupt(0);
-                        } else {
-                            int32_t combined = (int32_t)((((address)Dx) << 16) | ((address)ax));
-                            int32_t result = (int32_t)combined / ((int32_t)temp);
-                            if (result > 0x7FFF || result < -32767) { // overflow interrupt
-                                jump = true;
-                                performInterrupt(0);
-                            } else {
-                                ax = (word)result;
-                                Dx = combined % temp;
-                            }
-                        }
-                        break;
-                    }
-                    default:
-                    {
-                        cout << "unimplemented F7 opcode" << endl;
-                        break;
-                    }
+        }
+    }
+    
+    // SCASB scan string byte
+    inline void CPU::scasb(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatScas(decoded, 1))) {
+            return;
+        }
+        repAE:
+        address place = (es << 4) + di;
+        //cout << place <<  " : ";
+        //cout << hex << uppercase << setfill('0') << setw(2) << memory.readByte(place) << endl;
+        byte temp1 = al;
+        byte temp2 = memory.readByte(place);
+        subByte(temp1, temp2);
+        if (direction == 0) {
+            di++;
+        } else {
+            di--;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (!decoded.repeatZF && getZero() == true) {
+                    return;
                 }
-                break;
-                
-                
+                if (decoded.repeatZF && getZero() == false) {
+                    return;
+                }
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
+                }
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repAE;
             }
-                
-            // CLC clear carry flag
-            case 0xF8:
-                carry = false;
-                break;
-            
-            // STC set carry flag
-            case 0xF9:
-                carry = true;
-                break;
-            
-            //
-            
-            // CLI clear interrupt
-            case 0xFA:
-                interrupt = false;
-                break;
-            
-            // STI set interrupt flag
-            case 0xFB:
-                if (!interrupt) {
-                    delayInterrupt = true; // delaying interrupt breaks basic interpreter with weird behavior
+        }
+    }
+    
+    // SCASW scan string word
+    inline void CPU::scasw(const DecodedInstruction &decoded) {
+        word chunkLeft = REPEAT_CHUNK;
+        if (decoded.repeatCX && (emptyRepeat() || repeatScas(decoded, 2))) {
+            return;
+        }
+        repAF:
+        address place = (es << 4) + di;
+        word temp1 = ax;
+        word temp2 = memory.readWord(place);
+        subWord(temp1, temp2);
+        if (direction == 0) {
+            di += 2;
+        } else {
+            di -= 2;
+        }
+    
+        if (decoded.repeatCX) {
+            cx--;
+            if (cx > 0) {
+                if (!decoded.repeatZF && getZero() == true) {
+                    return;
                 }
-                //interrupt = true;
-                break;
-            
-            // CLD clear direction flag
-            case 0xFC:
-                direction = false;
-                break;
-            
-            // STD set direction flag
-            case 0xFD:
-                direction = true;
-                break;
-                
-            
-            case 0xFE:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000: // INC increment byte by 1
-                    {
-                        byte temp = getModRMByte(mrr);
-                        incByte(temp);
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    case 0b001: // DEC decrement byte by 1
-                    {
-                        byte temp = getModRMByte(mrr);
-                        decByte(temp);
-                        setModRMByte(mrr, temp);
-                        break;
-                    }
-                    default:
-                    {
-                        cout << "unimplemented FE opcode" << endl;
-                        break;
-                    }
+                if (decoded.repeatZF && getZero() == false) {
+                    return;
                 }
-                break;
+                if (--chunkLeft == 0) {
+                    suspendRepeat();
+                    return;
+                }
+                cycleCount += repeatCycles[decoded.opcode - 0xA4];
+                goto repAF;
             }
-            
-            case 0xFF:
-            {
-                ModRegRM mrr = ModRegRM(memory.readByte(NEXT_INSTRUCTION + 1));
-                instructionLength = 2;
-                modInstructionLength(mrr, instructionLength);
-                switch (mrr.reg) {
-                    case 0b000: // INC increment word by 1
-                    {
-                        word temp = getModRMWord(mrr);
-                        incWord(temp);
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b001: // DEC decrement word by 1
-                    {
-                        word temp = getModRMWord(mrr);
-                        decWord(temp);
-                        setModRMWord(mrr, temp);
-                        break;
-                    }
-                    case 0b010: // CALL within segment indirect
-                    {
-                        push(ip + instructionLength);
-                        word temp = getModRMWord(mrr);
-                        ip = temp;
-                        jump = true;
-                        break;
-                    }
-                    case 0b011: // CALL inter-segment indirect
-                    {
-                        push(cs);
-                        push(ip + instructionLength);
-                        // next two instructions are new ip
-                        // can't change ip until after have read CS
-                        address pa = calcPhysicalAddress(mrr); // physical address
-                        ip = memory.readWord(pa);
-                        cs = memory.readWord(pa + 2);
-                        jump = true;
-                        break;
-                    }
-                    case 0b100: // JMP within segment, indirect
-                        ip = getModRMWord(mrr);
-                        jump = true;
-                        break;
-                    case 0b101: // JMP inter-segment, indirect
-                        {
-                            address temp = calcPhysicalAddress(mrr);
-                            ip = memory.readWord(temp);
-                            cs = memory.readWord(temp + 2);
-                            jump = true;
-                            break;
-                        }
-                    case 0b110: // PUSH modrm
-                        push(getModRMWord(mrr));
-                        break;
-                    default:
-                    {
-                        cout << "unimplemented FF opcode" << endl;
-                        break;
+        }
+    }
+    
+    // MOV Byte move data to register
+    inline void CPU::movRegIb(const DecodedInstruction &decoded) {
+        setReg(lowNibble(decoded.opcode), (byte) decoded.immediate);
+    }
+    
+    // MOV Word move data to register
+    inline void CPU::movRegIv(const DecodedInstruction &decoded) {
+        setReg(lowNibble(decoded.opcode), decoded.immediate);
+    }
+    
+    // RET intrasegment and add displacement
+    inline void CPU::retIw(const DecodedInstruction &decoded) {
+        word displacement = decoded.immediate;
+        jump = true;
+        ip = pop();
+        sp += displacement;
+    }
+    
+    // RET intra-segment
+    inline void CPU::ret(const DecodedInstruction &decoded) {
+        jump = true;
+        ip = pop();
+        // cout << ip << endl;
+    }
+    
+    // LES ES
+    inline void CPU::lesGvMp(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        address temp = calcPhysicalAddress();
+        word operand1 = memory.readWord(temp);
+        word operand2 = memory.readWord(temp + 2);
+        setRegWord(mrr.reg, operand1);
+        es = operand2;
+    }
+    
+    // LES DS
+    inline void CPU::ldsGvMp(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        address temp = calcPhysicalAddress();
+        word operand1 = memory.readWord(temp);
+        word operand2 = memory.readWord(temp + 2);
+        setRegWord(mrr.reg, operand1);
+        ds = operand2;
+    }
+    
+    // MOV immediate byte to rm
+    inline void CPU::movEbIb(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte data = (byte) decoded.immediate;
+        setModRMByte(mrr, data);
+    }
+    
+    // MOV immediate word to rm
+    inline void CPU::movEvIv(const DecodedInstruction &decoded) {
+        ModRegRM mrr = ModRegRM(decoded.modrm);
+        word data = decoded.immediate;
+        setModRMWord(mrr, data);
+    }
+    
+    // RET intersegment and add displacement
+    inline void CPU::retfIw(const DecodedInstruction &decoded) {
+        word displacement = decoded.immediate;
+        jump = true;
+        ip = pop();
+        setCS(pop());
+        sp += displacement;
+    }
+    
+    // RET intra-segment
+    inline void CPU::retf(const DecodedInstruction &decoded) {
+        jump = true;
+        ip = pop();
+        setCS(pop());
+    }
+    
+    // INT (always 3)
+    inline void CPU::int3(const DecodedInstruction &decoded) {
+        jump = true;
+        ip += instructionLength; // iret just past here
+        performInterrupt(3);
+    }
+    
+    // INT type
+    inline void CPU::intIb(const DecodedInstruction &decoded) {
+        byte type = (byte) decoded.immediate;
+        jump = true;
+        ip += instructionLength; // iret just past here
+        performInterrupt(type);
+    }
+    
+    // INTO overflow interrupt
+    inline void CPU::into(const DecodedInstruction &decoded) {
+        if (getOverflow()) {
+            jump=true;
+            ip += instructionLength; // iret just past here
+            performInterrupt(4);
+            cycleCount += 69; // 73 taken, 4 not
+        }
+    }
+    
+    // IRET
+    inline void CPU::iret(const DecodedInstruction &decoded) {
+        jump = true;
+        ip = pop();
+        setCS(pop());
+        flags = pop();
+        lazyOp = LAZY_NONE;
+        setFlagsDefaults();
+    }
+    
+    // AAM ASCII Adjust for Multiplication (long opcode usually, D4, 0A - two bytes)
+    // technically other second bytes will work, may be used by some obscure software
+    inline void CPU::aam(const DecodedInstruction &decoded) {
+        materializeFlags();
+        // next byte is usually 10 but can be used otherwise
+        byte operand = (byte) decoded.immediate;
+        if (operand == 0) { // division by 0
+            jump = true;
+            performInterrupt(0);
+        } else {
+            byte oldAL = al;
+            ah = al / operand;
+            al = oldAL % operand;
+            setSZPFlagsByte(al);
+        }
+    }
+    
+    // AAD ASCII Adjust for Division (long opcode usually, D5, 0A - two bytes)
+    // technically other second bytes will work, may be used by some obscure software
+    inline void CPU::aad(const DecodedInstruction &decoded) {
+        materializeFlags();
+        // next byte is usually 10 but can be used otherwise
+        byte operand = (byte) decoded.immediate;
+        al = ((word)al + ((word)ah * (word)operand)) & 0xFF;
+    
+        ah = 0;
+        setSZPFlagsByte(al);
+        //sign = 0;
+        overflow = false;
+        carry = false;
+    }
+    
+    // XLAT
+    inline void CPU::xlat(const DecodedInstruction &decoded) {
+        al = memory.readByte((*currentSegment << 4) + bx + al);
+    }
+    
+    // Delay loops, LOOP $ and DEC reg / JNZ back to it, don't do anything but
+    // count a register down, so they're skipped straight to where they come
+    // out with the clocks they would have taken added on. At most
+    // FAST_FORWARD_LIMIT iterations are skipped at a time, leaving ip on the
+    // loop, so the PC can still run the timer and interrupts in between.
+    // Like fusion, they're left alone while observed or with breakpoints set,
+    // so each time around still gets its executing() check and observer call.
+    inline bool CPU::canFastForward() {
+        return observer == nullptr && !memory.hasBreakpoints();
+    }
+    
+    // LOOP $, or LOOPZ/LOOPNZ $ when their condition holds, since nothing in
+    // the loop can change ZF; taken is what a taken jump costs over not taken
+    inline bool CPU::skipSelfLoop(byte taken) {
+        if (!canFastForward()) {
+            return false;
+        }
+        const byte notTaken = registerCycles[currentInstruction->opcode];
+        const uint32_t remaining = (cx == 0) ? 0x10000 : cx;
+        if (remaining > FAST_FORWARD_LIMIT) {
+            cx -= FAST_FORWARD_LIMIT;
+            jump = true;
+            cycleCount += FAST_FORWARD_LIMIT * (notTaken + taken) - notTaken;
+        } else {
+            cx = 0;
+            cycleCount += (remaining - 1) * (notTaken + taken);
+        }
+        return true;
+    }
+    
+    // A taken JNZ back to a DEC reg right before it; each time around costs
+    // the DEC plus a taken JNZ, and the last time the JNZ falls through
+    inline bool CPU::skipDecJnz() {
+        if (!canFastForward()) {
+            return false;
+        }
+        // fetched as code, so it isn't taken for a data read by watchpoints or observers
+        byte window[FETCH_WINDOW];
+        memory.fetchWindow((NEXT_INSTRUCTION - 1) & ADDRESS_MASK, window);
+        const byte previous = window[0];
+        if (previous < 0x48 || previous > 0x4F || previous == 0x4C) { // DEC reg16, but not SP
+            return false;
+        }
+        word &counter = registers[previous & 0b111];
+        const uint32_t perIteration = registerCycles[previous] + registerCycles[0x75] + JUMP_TAKEN_CYCLES;
+        const uint32_t remaining = (counter == 0) ? 0x10000 : counter; // DECs until it hits 0
+        if (remaining > FAST_FORWARD_LIMIT) {
+            // stop back on this JNZ, about to be taken again
+            counter -= FAST_FORWARD_LIMIT - 1;
+            decWord(counter);
+            jump = true;
+            cycleCount += FAST_FORWARD_LIMIT * perIteration - registerCycles[0x75];
+        } else {
+            counter = 1;
+            decWord(counter);
+            cycleCount += remaining * perIteration;
+        }
+        return true;
+    }
+    
+    // LOOPNE, LOOPNZ branch if CX non-zero and ZF = 0
+    inline void CPU::loopnz(const DecodedInstruction &decoded) {
+        if ((byte) decoded.immediate == 0xFE && getZero() == false && skipSelfLoop(JUMP_TAKEN_CYCLES + 2)) {
+            return;
+        }
+        cx--;
+        if (cx != 0 && getZero() == false) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES + 2;
+        }
+    }
+    
+    // LOOPE, LOOPZ branch if CX non-zero and ZF = 1
+    inline void CPU::loopz(const DecodedInstruction &decoded) {
+        if ((byte) decoded.immediate == 0xFE && getZero() == true && skipSelfLoop(JUMP_TAKEN_CYCLES)) {
+            return;
+        }
+        cx--;
+        if (cx != 0 && getZero() == true) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // LOOP branch if CX non-zero
+    inline void CPU::loop(const DecodedInstruction &decoded) {
+        if ((byte) decoded.immediate == 0xFE && skipSelfLoop(JUMP_TAKEN_CYCLES)) { // LOOP $
+            return;
+        }
+        cx--;
+        if (cx != 0) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // JCXZ Jump if CX is zero
+    inline void CPU::jcxz(const DecodedInstruction &decoded) {
+        if (cx == 0) {
+            ip = (ip + 2) + signExtend((byte) decoded.immediate);
+            jump = true;
+            cycleCount += JUMP_TAKEN_CYCLES;
+        }
+    }
+    
+    // IN fixed port to AL
+    inline void CPU::inALIb(const DecodedInstruction &decoded) {
+        al = portInterface.readPort((byte) decoded.immediate);
+    }
+    
+    // IN fixed port to AX
+    inline void CPU::inAXIb(const DecodedInstruction &decoded) {
+        ax = portInterface.readPort((byte) decoded.immediate);
+    }
+    
+    // OUT from al
+    inline void CPU::outIbAL(const DecodedInstruction &decoded) {
+        portInterface.writePort((byte) decoded.immediate, al);
+    }
+    
+    // OUT from ax
+    inline void CPU::outIbAX(const DecodedInstruction &decoded) {
+        portInterface.writePort((byte) decoded.immediate, ax);
+    }
+    
+    // CALL within segment or group, ip relative; 16 bit displacement
+    inline void CPU::callJv(const DecodedInstruction &decoded) {
+        push(ip + instructionLength);
+        // cout << (ip + instructionLength) << endl;
+        word displacement = decoded.immediate;
+        ip += (displacement + instructionLength);
+        jump = true;
+    }
+    
+    // JMP within segment or group, ip relative; 16 bit displacement
+    inline void CPU::jmpJv(const DecodedInstruction &decoded) {
+        word displacement = decoded.immediate;
+        ip += (displacement + instructionLength);
+        jump = true;
+    }
+    
+    // JMP direct
+    inline void CPU::jmpAp(const DecodedInstruction &decoded) {
+        // next two instructions are new ip
+        // can't change ip until after have read CS
+        word nextIp = decoded.immediate;
+        // next two after that are new cs
+        word nextCs = decoded.immediate2;
+        ip = nextIp;
+        setCS(nextCs);
+        jump = true;
+    }
+    
+    // JMP within segment or group, ip relative; 8 bit displacement sign extend
+    inline void CPU::jmpJb(const DecodedInstruction &decoded) {
+        byte displacement = (byte) decoded.immediate;
+        ip += signExtend(displacement);
+    }
+    
+    // IN variable port (DX) to al
+    inline void CPU::inALDX(const DecodedInstruction &decoded) {
+        al = portInterface.readPort(Dx);
+    }
+    
+    // IN variable port (DX) to ax
+    inline void CPU::inAXDX(const DecodedInstruction &decoded) {
+        ax = portInterface.readPort(Dx);
+    }
+    
+    // OUT to Dx from al
+    inline void CPU::outDXAL(const DecodedInstruction &decoded) {
+        portInterface.writePort(Dx, al);
+    }
+    
+    // OUT to Dx from ax
+    inline void CPU::outDXAX(const DecodedInstruction &decoded) {
+        portInterface.writePort(Dx, ax);
+    }
+    
+    // HLT
+    inline void CPU::hlt(const DecodedInstruction &decoded) {
+        halted = true;
+    }
+    
+    // CMC Complement Carry Flag
+    inline void CPU::complementCarry(const DecodedInstruction &decoded) {
+        materializeFlags();
+        carry = !carry;
+    }
+    
+    // CLC clear carry flag
+    inline void CPU::clearCarry(const DecodedInstruction &decoded) {
+        materializeFlags();
+        carry = false;
+    }
+    
+    // STC set carry flag
+    inline void CPU::setCarry(const DecodedInstruction &decoded) {
+        materializeFlags();
+        carry = true;
+    }
+    
+    //
+    // CLI clear interrupt
+    inline void CPU::clearInterrupt(const DecodedInstruction &decoded) {
+        interrupt = false;
+    }
+    
+    // STI set interrupt flag
+    inline void CPU::setInterrupt(const DecodedInstruction &decoded) {
+        if (!interrupt) {
+            delayInterrupt = true; // delaying interrupt breaks basic interpreter with weird behavior
+        }
+        //interrupt = true;
+    }
+    
+    // CLD clear direction flag
+    inline void CPU::clearDirection(const DecodedInstruction &decoded) {
+        direction = false;
+    }
+    
+    // STD set direction flag
+    inline void CPU::setDirection(const DecodedInstruction &decoded) {
+        direction = true;
+    }
+    
+    // D8-DF ESC, which all belong to the 8087
+    inline void CPU::escape(const DecodedInstruction &decoded) {
+        const ModRegRM mrr = ModRegRM(decoded.modrm);
+        fpu.execute(decoded.opcode, decoded.modrm, mrr.mod == 0b11 ? FPU::NO_FPU_OPERAND : calcPhysicalAddress(), decoded.location);
+    }
+    
+    // WAIT, a no-op since the 8087 here finishes each instruction right away
+    inline void CPU::fwait(const DecodedInstruction &decoded) {
+    }
+    
+    // F1 call a host service, see Hypercalls.hpp
+    inline void CPU::hypercall(const DecodedInstruction &decoded) {
+        if (hypercalls == nullptr) {
+            unknownOpcode(decoded);
+            return;
+        }
+        materializeFlags();
+        HypercallRegisters guest = {ax, bx, cx, Dx, si, di, ds, es, carry};
+        hypercalls->call(guest, memory);
+        ax = guest.ax;
+        bx = guest.bx;
+        cx = guest.cx;
+        Dx = guest.dx;
+        carry = guest.carry;
+        if (hypercalls->exitRequested()) {
+            halted = true;
+        }
+    }
+    
+    // Unknown Opcode
+    inline void CPU::unknownOpcode(const DecodedInstruction &decoded) {
+        cout << "Unknown opcode!" << endl;
+    }
+    
+    #ifdef TABLE_DISPATCH
+    const OpcodeHandler CPU::opcodeHandlers[256] = {
+        &CPU::addEbGb, &CPU::addEvGv, &CPU::addGbEb, &CPU::addGvEv, // 00-03
+        &CPU::addALIb, &CPU::addAXIv, &CPU::pushES, &CPU::popES, // 04-07
+        &CPU::orEbGb, &CPU::orEvGv, &CPU::orGbEb, &CPU::orGvEv, // 08-0B
+        &CPU::orALIb, &CPU::orAXIv, &CPU::pushCS, &CPU::unknownOpcode, // 0C-0F
+        &CPU::adcEbGb, &CPU::adcEvGv, &CPU::adcGbEb, &CPU::adcGvEv, // 10-13
+        &CPU::adcALIb, &CPU::adcAXIv, &CPU::pushSS, &CPU::popSS, // 14-17
+        &CPU::sbbEbGb, &CPU::sbbEvGv, &CPU::sbbGbEb, &CPU::sbbGvEv, // 18-1B
+        &CPU::sbbALIb, &CPU::sbbAXIv, &CPU::pushDS, &CPU::popDS, // 1C-1F
+        &CPU::andEbGb, &CPU::andEvGv, &CPU::andGbEb, &CPU::andGvEv, // 20-23
+        &CPU::andALIb, &CPU::andAXIv, &CPU::unknownOpcode, &CPU::daa, // 24-27
+        &CPU::subEbGb, &CPU::subEvGv, &CPU::subGbEb, &CPU::subGvEv, // 28-2B
+        &CPU::subALIb, &CPU::subAXIv, &CPU::unknownOpcode, &CPU::das, // 2C-2F
+        &CPU::xorEbGb, &CPU::xorEvGv, &CPU::xorGbEb, &CPU::xorGvEv, // 30-33
+        &CPU::xorALIb, &CPU::xorAXIv, &CPU::unknownOpcode, &CPU::aaa, // 34-37
+        &CPU::cmpEbGb, &CPU::cmpEvGv, &CPU::cmpGbEb, &CPU::cmpGvEv, // 38-3B
+        &CPU::cmpALIb, &CPU::cmpAXIv, &CPU::unknownOpcode, &CPU::aas, // 3C-3F
+        &CPU::incAX, &CPU::incCX, &CPU::incDX, &CPU::incBX, // 40-43
+        &CPU::incSP, &CPU::incBP, &CPU::incSI, &CPU::incDI, // 44-47
+        &CPU::decAX, &CPU::decCX, &CPU::decDX, &CPU::decBX, // 48-4B
+        &CPU::decSP, &CPU::decBP, &CPU::decSI, &CPU::decDI, // 4C-4F
+        &CPU::pushAX, &CPU::pushCX, &CPU::pushDX, &CPU::pushBX, // 50-53
+        &CPU::pushSP, &CPU::pushBP, &CPU::pushSI, &CPU::pushDI, // 54-57
+        &CPU::popAX, &CPU::popCX, &CPU::popDX, &CPU::popBX, // 58-5B
+        &CPU::popSP, &CPU::popBP, &CPU::popSI, &CPU::popDI, // 5C-5F
+        &CPU::jo, &CPU::jno, &CPU::jb, &CPU::jnb, // 60-63, same as 70-73
+        &CPU::jz, &CPU::jnz, &CPU::jbe, &CPU::ja, // 64-67, same as 74-77
+        &CPU::js, &CPU::jns, &CPU::jpe, &CPU::jpo, // 68-6B, same as 78-7B
+        &CPU::jl, &CPU::jge, &CPU::jle, &CPU::jg, // 6C-6F, same as 7C-7F
+        &CPU::jo, &CPU::jno, &CPU::jb, &CPU::jnb, // 70-73
+        &CPU::jz, &CPU::jnz, &CPU::jbe, &CPU::ja, // 74-77
+        &CPU::js, &CPU::jns, &CPU::jpe, &CPU::jpo, // 78-7B
+        &CPU::jl, &CPU::jge, &CPU::jle, &CPU::jg, // 7C-7F
+        &CPU::group1Eb, &CPU::group1Ev, &CPU::unknownOpcode, &CPU::group1Ev, // 80-83
+        &CPU::testGbEb, &CPU::testGvEv, &CPU::xchgGbEb, &CPU::xchgGvEv, // 84-87
+        &CPU::movEbGb, &CPU::movEvGv, &CPU::movGbEb, &CPU::movGvEv, // 88-8B
+        &CPU::movEwSw, &CPU::leaGvM, &CPU::movSwEw, &CPU::popEv, // 8C-8F
+        &CPU::nop, &CPU::xchgCXAX, &CPU::xchgDXAX, &CPU::xchgBXAX, // 90-93
+        &CPU::xchgSPAX, &CPU::xchgBPAX, &CPU::xchgSIAX, &CPU::xchgDIAX, // 94-97
+        &CPU::cbw, &CPU::cwd, &CPU::callAp, &CPU::fwait, // 98-9B
+        &CPU::pushf, &CPU::popf, &CPU::sahf, &CPU::lahf, // 9C-9F
+        &CPU::movALOb, &CPU::movAXOv, &CPU::movObAL, &CPU::movOvAX, // A0-A3
+        &CPU::movsb, &CPU::movsw, &CPU::cmpsb, &CPU::cmpsw, // A4-A7
+        &CPU::testALIb, &CPU::testAXIv, &CPU::stosb, &CPU::stosw, // A8-AB
+        &CPU::lodsb, &CPU::lodsw, &CPU::scasb, &CPU::scasw, // AC-AF
+        &CPU::movRegIb, &CPU::movRegIb, &CPU::movRegIb, &CPU::movRegIb, // B0-B3
+        &CPU::movRegIb, &CPU::movRegIb, &CPU::movRegIb, &CPU::movRegIb, // B4-B7
+        &CPU::movRegIv, &CPU::movRegIv, &CPU::movRegIv, &CPU::movRegIv, // B8-BB
+        &CPU::movRegIv, &CPU::movRegIv, &CPU::movRegIv, &CPU::movRegIv, // BC-BF
+        &CPU::unknownOpcode, &CPU::unknownOpcode, &CPU::retIw, &CPU::ret, // C0-C3
+        &CPU::lesGvMp, &CPU::ldsGvMp, &CPU::movEbIb, &CPU::movEvIv, // C4-C7
+        &CPU::unknownOpcode, &CPU::unknownOpcode, &CPU::retfIw, &CPU::retf, // C8-CB
+        &CPU::int3, &CPU::intIb, &CPU::into, &CPU::iret, // CC-CF
+        &CPU::group2Eb1, &CPU::group2Ev1, &CPU::group2EbCL, &CPU::group2EvCL, // D0-D3
+        &CPU::aam, &CPU::aad, &CPU::unknownOpcode, &CPU::xlat, // D4-D7
+        &CPU::escape, &CPU::escape, &CPU::escape, &CPU::escape, // D8-DB
+        &CPU::escape, &CPU::escape, &CPU::escape, &CPU::escape, // DC-DF
+        &CPU::loopnz, &CPU::loopz, &CPU::loop, &CPU::jcxz, // E0-E3
+        &CPU::inALIb, &CPU::inAXIb, &CPU::outIbAL, &CPU::outIbAX, // E4-E7
+        &CPU::callJv, &CPU::jmpJv, &CPU::jmpAp, &CPU::jmpJb, // E8-EB
+        &CPU::inALDX, &CPU::inAXDX, &CPU::outDXAL, &CPU::outDXAX, // EC-EF
+        &CPU::unknownOpcode, &CPU::hypercall, &CPU::unknownOpcode, &CPU::unknownOpcode, // F0-F3
+        &CPU::hlt, &CPU::complementCarry, &CPU::group3Eb, &CPU::group3Ev, // F4-F7
+        &CPU::clearCarry, &CPU::setCarry, &CPU::clearInterrupt, &CPU::setInterrupt, // F8-FB
+        &CPU::clearDirection, &CPU::setDirection, &CPU::group4Eb, &CPU::group5Ev // FC-FF
+    };
+    #endif
+    
+    const OpcodeHandler CPU::group1ByteHandlers[8] = {
+        &CPU::addEbIb, &CPU::orEbIb, &CPU::adcEbIb, &CPU::sbbEbIb,
+        &CPU::andEbIb, &CPU::subEbIb, &CPU::xorEbIb, &CPU::cmpEbIb
+    };
+    
+    const OpcodeHandler CPU::group1WordHandlers[8] = {
+        &CPU::addEvIv, &CPU::orEvIv, &CPU::adcEvIv, &CPU::sbbEvIv,
+        &CPU::andEvIv, &CPU::subEvIv, &CPU::xorEvIv, &CPU::cmpEvIv
+    };
+    
+    const ShiftHandler CPU::group2ByteHandlers[8] = {
+        &CPU::rolByte, &CPU::rorByte, &CPU::rclByte, &CPU::rcrByte,
+        &CPU::shlByte, &CPU::shrByte, &CPU::unusedShift, &CPU::sarByte
+    };
+    
+    const ShiftHandler CPU::group2WordHandlers[8] = {
+        &CPU::rolWord, &CPU::rorWord, &CPU::rclWord, &CPU::rcrWord,
+        &CPU::shlWord, &CPU::shrWord, &CPU::unusedShift, &CPU::sarWord
+    };
+    
+    const OpcodeHandler CPU::group3ByteHandlers[8] = {
+        &CPU::testEbIb, &CPU::unimplementedGroupOpcode, &CPU::notEb, &CPU::negEb,
+        &CPU::mulEb, &CPU::imulEb, &CPU::divEb, &CPU::idivEb
+    };
+    
+    const OpcodeHandler CPU::group3WordHandlers[8] = {
+        &CPU::testEvIv, &CPU::unimplementedGroupOpcode, &CPU::notEv, &CPU::negEv,
+        &CPU::mulEv, &CPU::imulEv, &CPU::divEv, &CPU::idivEv
+    };
+    
+    const OpcodeHandler CPU::group4Handlers[8] = {
+        &CPU::incEb, &CPU::decEb, &CPU::unimplementedGroupOpcode, &CPU::unimplementedGroupOpcode,
+        &CPU::unimplementedGroupOpcode, &CPU::unimplementedGroupOpcode, &CPU::unimplementedGroupOpcode, &CPU::unimplementedGroupOpcode
+    };
+    
+    const OpcodeHandler CPU::group5Handlers[8] = {
+        &CPU::incEv, &CPU::decEv, &CPU::callEv, &CPU::callMp,
+        &CPU::jmpEv, &CPU::jmpMp, &CPU::pushEv, &CPU::unimplementedGroupOpcode
+    };
+    
+    // Run one instruction, or with the recompiler possibly a whole block of them
+    void CPU::step() {
+        if (observer == nullptr) {
+            stepWith<Unobserved>();
+        } else {
+            stepWith<Observed>();
+        }
+    }
+    
+    template <class Policy>
+    inline void CPU::stepWith() {
+        beginStep();
+        
+        // blocks start wherever a jump lands; translated and compiled code
+        // isn't observed and doesn't stop for breakpoints
+        if (!Policy::enabled && jump && !memory.hasBreakpoints() && runBlock(NEXT_INSTRUCTION)) {
+            return;
+        }
+        
+        execute<Policy>(fetchDecoded(NEXT_INSTRUCTION));
+    }
+    
+    // Run the translated ROM block or compiled block starting at location.
+    // Returns false if there's neither and the interpreter should step instead.
+    inline bool CPU::runBlock(address location) {
+        if (translatedImages != 0 && runTranslatedBlock(location)) {
+            return true;
+        }
+        #ifdef RECOMPILER_AVAILABLE
+        return recompiler.run(location);
+        #else
+        return false;
+        #endif
+    }
+    
+    inline void CPU::beginStep() {
+        // Make sure interrupt after STI is only enabled one instruction later
+        if (delayInterrupt) {
+            interrupt = true;
+            delayInterrupt = false;
+        }
+    }
+    
+    // Keep stepping until cycleBudget cycles have gone by, or until something
+    // outside the CPU needs a look in: a HLT, interrupts being turned on, or
+    // a port access the devices have to be caught up for first. Such a port
+    // access ends the batch just before it, unless it's the first instruction,
+    // in which case it ends the batch just after it.
+    RunExit CPU::run(uint64_t cycleBudget) {
+        if (observer == nullptr) {
+            return runWith<Unobserved>(cycleBudget);
+        }
+        return runWith<Observed>(cycleBudget);
+    }
+    
+    template <class Policy>
+    RunExit CPU::runWith(uint64_t cycleBudget) {
+        const uint64_t start = cycleCount;
+        const uint64_t end = cycleCount + cycleBudget;
+        while (cycleCount < end) {
+            if (halted) {
+                return EXIT_HALTED;
+            }
+            const bool couldInterrupt = interrupt;
+            const bool wasDelayed = delayInterrupt;
+            beginStep();
+            
+            if (!Policy::enabled && jump && !memory.hasBreakpoints() && runBlock(NEXT_INSTRUCTION)) {
+                if (!couldInterrupt && interrupt) {
+                    return EXIT_INTERRUPT;
+                }
+                continue;
+            }
+            
+            const DecodedInstruction &decoded = fetchDecoded(NEXT_INSTRUCTION);
+            if ((decoded.opcode & 0xF4) == 0xE4) { // IN/OUT
+                const word port = (decoded.opcode & 0x08) ? Dx : (byte) decoded.immediate;
+                if (portInterface.requiresSync(port)) {
+                    if (cycleCount != start) {
+                        // it runs first thing next time, so put back any STI delay
+                        interrupt = couldInterrupt;
+                        delayInterrupt = wasDelayed;
+                        return EXIT_PORT;
                     }
+                    execute<Policy>(decoded);
+                    return EXIT_PORT;
                 }
-                break;
             }
-            
-            case 0xDB:
-            case 0xD9:
-            case 0x64:
-                instructionLength = 2;
-                cout << "Unimplemented floating point opcode!" << endl;
-                break;
-                
-                
-            // Unknown Opcode
-            default:
-                cout << "Unknown opcode!" << endl;
+            execute<Policy>(decoded);
+            if (!couldInterrupt && interrupt) {
+                return EXIT_INTERRUPT;
+            }
+        }
+        return EXIT_BUDGET;
+    }
+    
+    #ifdef RECOMPILER_AVAILABLE
+    // Called from compiled blocks for each instruction they don't do natively.
+    // Returns whether the block should carry on with its next instruction.
+    bool CPU::executeTranslated(CPU *cpu, const DecodedInstruction *decoded) {
+        // blocks have the follower of a fused pair as their own next instruction
+        cpu->executeOne(*decoded);
+        return !cpu->jump && cpu->memory.codeVersion(decoded->location) == decoded->version;
+    }
+    
+    // And for the memory accesses and flags of the instructions they do natively,
+    // whenever they can't be done inline
+    word CPU::readTranslated(CPU *cpu, address location, bool wide) {
+        return wide ? cpu->memory.readWord(location) : cpu->memory.readByte(location);
+    }
+    
+    // Returns whether the code at block, version when it was compiled, is still there
+    bool CPU::writeTranslated(CPU *cpu, address location, word value, bool wide, address block, uint32_t version) {
+        if (wide) {
+            cpu->memory.setWord(location, value);
+        } else {
+            cpu->memory.setByte(location, (byte) value);
+        }
+        return cpu->memory.codeVersion(block) == version;
+    }
+    
+    void CPU::materializeTranslated(CPU *cpu) {
+        cpu->materializeFlags();
+    }
+    #endif
+    
+    // Run an instruction, along with the one after it if the two were fused at
+    // decode time. Nothing (an interrupt included) comes between a fused pair,
+    // except when tracing or observed. The follower is fetched like any other
+    // instruction, so the first writing over it is seen, and it's only run as a
+    // pair if it's still what the pair was made with.
+    template <class Policy>
+    inline void CPU::execute(const DecodedInstruction &decoded) {
+        memory.executing(NEXT_INSTRUCTION);
+        if (Policy::enabled) {
+            observer->instruction(*this, decoded);
+        }
+        executeOne(decoded);
+        if (Policy::enabled && (decoded.opcode & 0xF4) == 0xE4) { // IN/OUT
+            const word port = (decoded.opcode & 0x08) ? Dx : (byte) decoded.immediate;
+            const word value = (decoded.opcode & 1) ? ax : al;
+            if (decoded.opcode & 0x02) {
+                observer->portWrite(port, value);
+            } else {
+                observer->portRead(port, value);
+            }
+        }
+        if (decoded.fuse == FUSE_NONE || jump || trace || Policy::enabled) {
+            return;
+        }
+        const DecodedInstruction &next = fetchDecoded(NEXT_INSTRUCTION);
+        if (next.prefixCount != 0 || fuseKind(decoded, next.opcode) != decoded.fuse) {
+            return;
         }
+        memory.executing(NEXT_INSTRUCTION);
+        if (decoded.fuse == FUSE_JUMP) {
+            fusedJump(next);
+        } else {
+            executeOne(next);
+        }
+    }
+    
+    inline void CPU::executeOne(const DecodedInstruction &decoded) {
+        startInstruction(decoded);
+        const byte opcode = decoded.opcode;
         
-        // if we didn't jump, move the instruction pointer forward
-        if (!jump) { ip += instructionLength; }
+        #ifdef TABLE_DISPATCH
+        (this->*opcodeHandlers[opcode])(decoded);
+        #else
+        switch (opcode) {
+            case 0x00: addEbGb(decoded); break;
+            case 0x01: addEvGv(decoded); break;
+            case 0x02: addGbEb(decoded); break;
+            case 0x03: addGvEv(decoded); break;
+            case 0x04: addALIb(decoded); break;
+            case 0x05: addAXIv(decoded); break;
+            case 0x06: pushES(decoded); break;
+            case 0x07: popES(decoded); break;
+            case 0x08: orEbGb(decoded); break;
+            case 0x09: orEvGv(decoded); break;
+            case 0x0A: orGbEb(decoded); break;
+            case 0x0B: orGvEv(decoded); break;
+            case 0x0C: orALIb(decoded); break;
+            case 0x0D: orAXIv(decoded); break;
+            case 0x0E: pushCS(decoded); break;
+            case 0x10: adcEbGb(decoded); break;
+            case 0x11: adcEvGv(decoded); break;
+            case 0x12: adcGbEb(decoded); break;
+            case 0x13: adcGvEv(decoded); break;
+            case 0x14: adcALIb(decoded); break;
+            case 0x15: adcAXIv(decoded); break;
+            case 0x16: pushSS(decoded); break;
+            case 0x17: popSS(decoded); break;
+            case 0x18: sbbEbGb(decoded); break;
+            case 0x19: sbbEvGv(decoded); break;
+            case 0x1A: sbbGbEb(decoded); break;
+            case 0x1B: sbbGvEv(decoded); break;
+            case 0x1C: sbbALIb(decoded); break;
+            case 0x1D: sbbAXIv(decoded); break;
+            case 0x1E: pushDS(decoded); break;
+            case 0x1F: popDS(decoded); break;
+            case 0x20: andEbGb(decoded); break;
+            case 0x21: andEvGv(decoded); break;
+            case 0x22: andGbEb(decoded); break;
+            case 0x23: andGvEv(decoded); break;
+            case 0x24: andALIb(decoded); break;
+            case 0x25: andAXIv(decoded); break;
+            case 0x27: daa(decoded); break;
+            case 0x28: subEbGb(decoded); break;
+            case 0x29: subEvGv(decoded); break;
+            case 0x2A: subGbEb(decoded); break;
+            case 0x2B: subGvEv(decoded); break;
+            case 0x2C: subALIb(decoded); break;
+            case 0x2D: subAXIv(decoded); break;
+            case 0x2F: das(decoded); break;
+            case 0x30: xorEbGb(decoded); break;
+            case 0x31: xorEvGv(decoded); break;
+            case 0x32: xorGbEb(decoded); break;
+            case 0x33: xorGvEv(decoded); break;
+            case 0x34: xorALIb(decoded); break;
+            case 0x35: xorAXIv(decoded); break;
+            case 0x37: aaa(decoded); break;
+            case 0x38: cmpEbGb(decoded); break;
+            case 0x39: cmpEvGv(decoded); break;
+            case 0x3A: cmpGbEb(decoded); break;
+            case 0x3B: cmpGvEv(decoded); break;
+            case 0x3C: cmpALIb(decoded); break;
+            case 0x3D: cmpAXIv(decoded); break;
+            case 0x3F: aas(decoded); break;
+            case 0x40: incAX(decoded); break;
+            case 0x41: incCX(decoded); break;
+            case 0x42: incDX(decoded); break;
+            case 0x43: incBX(decoded); break;
+            case 0x44: incSP(decoded); break;
+            case 0x45: incBP(decoded); break;
+            case 0x46: incSI(decoded); break;
+            case 0x47: incDI(decoded); break;
+            case 0x48: decAX(decoded); break;
+            case 0x49: decCX(decoded); break;
+            case 0x4A: decDX(decoded); break;
+            case 0x4B: decBX(decoded); break;
+            case 0x4C: decSP(decoded); break;
+            case 0x4D: decBP(decoded); break;
+            case 0x4E: decSI(decoded); break;
+            case 0x4F: decDI(decoded); break;
+            case 0x50: pushAX(decoded); break;
+            case 0x51: pushCX(decoded); break;
+            case 0x52: pushDX(decoded); break;
+            case 0x53: pushBX(decoded); break;
+            case 0x54: pushSP(decoded); break;
+            case 0x55: pushBP(decoded); break;
+            case 0x56: pushSI(decoded); break;
+            case 0x57: pushDI(decoded); break;
+            case 0x58: popAX(decoded); break;
+            case 0x59: popCX(decoded); break;
+            case 0x5A: popDX(decoded); break;
+            case 0x5B: popBX(decoded); break;
+            case 0x5C: popSP(decoded); break;
+            case 0x5D: popBP(decoded); break;
+            case 0x5E: popSI(decoded); break;
+            case 0x5F: popDI(decoded); break;
+            // 60-6F are undocumented aliases of the 70-7F conditional jumps on the 8086/8088
+            case 0x60: jo(decoded); break;
+            case 0x61: jno(decoded); break;
+            case 0x62: jb(decoded); break;
+            case 0x63: jnb(decoded); break;
+            case 0x64: jz(decoded); break;
+            case 0x65: jnz(decoded); break;
+            case 0x66: jbe(decoded); break;
+            case 0x67: ja(decoded); break;
+            case 0x68: js(decoded); break;
+            case 0x69: jns(decoded); break;
+            case 0x6A: jpe(decoded); break;
+            case 0x6B: jpo(decoded); break;
+            case 0x6C: jl(decoded); break;
+            case 0x6D: jge(decoded); break;
+            case 0x6E: jle(decoded); break;
+            case 0x6F: jg(decoded); break;
+            case 0x70: jo(decoded); break;
+            case 0x71: jno(decoded); break;
+            case 0x72: jb(decoded); break;
+            case 0x73: jnb(decoded); break;
+            case 0x74: jz(decoded); break;
+            case 0x75: jnz(decoded); break;
+            case 0x76: jbe(decoded); break;
+            case 0x77: ja(decoded); break;
+            case 0x78: js(decoded); break;
+            case 0x79: jns(decoded); break;
+            case 0x7A: jpe(decoded); break;
+            case 0x7B: jpo(decoded); break;
+            case 0x7C: jl(decoded); break;
+            case 0x7D: jge(decoded); break;
+            case 0x7E: jle(decoded); break;
+            case 0x7F: jg(decoded); break;
+            case 0x80: group1Eb(decoded); break;
+            case 0x81: group1Ev(decoded); break;
+            case 0x83: group1Ev(decoded); break;
+            case 0x84: testGbEb(decoded); break;
+            case 0x85: testGvEv(decoded); break;
+            case 0x86: xchgGbEb(decoded); break;
+            case 0x87: xchgGvEv(decoded); break;
+            case 0x88: movEbGb(decoded); break;
+            case 0x89: movEvGv(decoded); break;
+            case 0x8A: movGbEb(decoded); break;
+            case 0x8B: movGvEv(decoded); break;
+            case 0x8C: movEwSw(decoded); break;
+            case 0x8D: leaGvM(decoded); break;
+            case 0x8E: movSwEw(decoded); break;
+            case 0x8F: popEv(decoded); break;
+            case 0x90: nop(decoded); break;
+            case 0x91: xchgCXAX(decoded); break;
+            case 0x92: xchgDXAX(decoded); break;
+            case 0x93: xchgBXAX(decoded); break;
+            case 0x94: xchgSPAX(decoded); break;
+            case 0x95: xchgBPAX(decoded); break;
+            case 0x96: xchgSIAX(decoded); break;
+            case 0x97: xchgDIAX(decoded); break;
+            case 0x98: cbw(decoded); break;
+            case 0x99: cwd(decoded); break;
+            case 0x9A: callAp(decoded); break;
+            case 0x9B: fwait(decoded); break;
+            case 0x9C: pushf(decoded); break;
+            case 0x9D: popf(decoded); break;
+            case 0x9E: sahf(decoded); break;
+            case 0x9F: lahf(decoded); break;
+            case 0xA0: movALOb(decoded); break;
+            case 0xA1: movAXOv(decoded); break;
+            case 0xA2: movObAL(decoded); break;
+            case 0xA3: movOvAX(decoded); break;
+            case 0xA4: movsb(decoded); break;
+            case 0xA5: movsw(decoded); break;
+            case 0xA6: cmpsb(decoded); break;
+            case 0xA7: cmpsw(decoded); break;
+            case 0xA8: testALIb(decoded); break;
+            case 0xA9: testAXIv(decoded); break;
+            case 0xAA: stosb(decoded); break;
+            case 0xAB: stosw(decoded); break;
+            case 0xAC: lodsb(decoded); break;
+            case 0xAD: lodsw(decoded); break;
+            case 0xAE: scasb(decoded); break;
+            case 0xAF: scasw(decoded); break;
+            case 0xB0: movRegIb(decoded); break;
+            case 0xB1: movRegIb(decoded); break;
+            case 0xB2: movRegIb(decoded); break;
+            case 0xB3: movRegIb(decoded); break;
+            case 0xB4: movRegIb(decoded); break;
+            case 0xB5: movRegIb(decoded); break;
+            case 0xB6: movRegIb(decoded); break;
+            case 0xB7: movRegIb(decoded); break;
+            case 0xB8: movRegIv(decoded); break;
+            case 0xB9: movRegIv(decoded); break;
+            case 0xBA: movRegIv(decoded); break;
+            case 0xBB: movRegIv(decoded); break;
+            case 0xBC: movRegIv(decoded); break;
+            case 0xBD: movRegIv(decoded); break;
+            case 0xBE: movRegIv(decoded); break;
+            case 0xBF: movRegIv(decoded); break;
+            case 0xC2: retIw(decoded); break;
+            case 0xC3: ret(decoded); break;
+            case 0xC4: lesGvMp(decoded); break;
+            case 0xC5: ldsGvMp(decoded); break;
+            case 0xC6: movEbIb(decoded); break;
+            case 0xC7: movEvIv(decoded); break;
+            case 0xCA: retfIw(decoded); break;
+            case 0xCB: retf(decoded); break;
+            case 0xCC: int3(decoded); break;
+            case 0xCD: intIb(decoded); break;
+            case 0xCE: into(decoded); break;
+            case 0xCF: iret(decoded); break;
+            case 0xD0: group2Eb1(decoded); break;
+            case 0xD1: group2Ev1(decoded); break;
+            case 0xD2: group2EbCL(decoded); break;
+            case 0xD3: group2EvCL(decoded); break;
+            case 0xD4: aam(decoded); break;
+            case 0xD5: aad(decoded); break;
+            case 0xD7: xlat(decoded); break;
+            case 0xD8: case 0xD9: case 0xDA: case 0xDB:
+            case 0xDC: case 0xDD: case 0xDE: case 0xDF: escape(decoded); break;
+            case 0xE0: loopnz(decoded); break;
+            case 0xE1: loopz(decoded); break;
+            case 0xE2: loop(decoded); break;
+            case 0xE3: jcxz(decoded); break;
+            case 0xE4: inALIb(decoded); break;
+            case 0xE5: inAXIb(decoded); break;
+            case 0xE6: outIbAL(decoded); break;
+            case 0xE7: outIbAX(decoded); break;
+            case 0xE8: callJv(decoded); break;
+            case 0xE9: jmpJv(decoded); break;
+            case 0xEA: jmpAp(decoded); break;
+            case 0xEB: jmpJb(decoded); break;
+            case 0xEC: inALDX(decoded); break;
+            case 0xED: inAXDX(decoded); break;
+            case 0xEE: outDXAL(decoded); break;
+            case 0xEF: outDXAX(decoded); break;
+            case 0xF1: hypercall(decoded); break;
+            case 0xF4: hlt(decoded); break;
+            case 0xF5: complementCarry(decoded); break;
+            case 0xF6: group3Eb(decoded); break;
+            case 0xF7: group3Ev(decoded); break;
+            case 0xF8: clearCarry(decoded); break;
+            case 0xF9: setCarry(decoded); break;
+            case 0xFA: clearInterrupt(decoded); break;
+            case 0xFB: setInterrupt(decoded); break;
+            case 0xFC: clearDirection(decoded); break;
+            case 0xFD: setDirection(decoded); break;
+            case 0xFE: group4Eb(decoded); break;
+            case 0xFF: group5Ev(decoded); break;
+            default: unknownOpcode(decoded);
+        }
+        #endif
         
-        // dummy for now until we have accurate cycle counts
-        cycleCount += 1;
+        finishInstruction(decoded);
         
         // sanity check
         //cout << hex << uppercase << (int)memory.readByte(90095) << dec << endl;
     }
     
+    // What every instruction does around its handler, here and in ROMBlocks.h
+    inline void CPU::startInstruction(const DecodedInstruction &decoded) {
+        jump = false;
+        currentInstruction = &decoded;
+        instructionLength = decoded.length;
+        // ip sits on the opcode itself while executing, like it always has
+        prefixCount = decoded.prefixCount;
+        ip += prefixCount;
+        segmentOverride = decoded.segmentOverride;
+        currentSegment = segmentOverride ? segmentRegister(decoded.segment) : &ds;
+    }
+    
+    inline void CPU::finishInstruction(const DecodedInstruction &decoded) {
+        // if we didn't jump, move the instruction pointer forward
+        if (!jump) { ip += instructionLength; }
+        
+        cycleCount += decoded.cycles;
+    }
+    
+    // The Jcc of a FUSE_JUMP pair, without going back through the dispatch
+    inline void CPU::fusedJump(const DecodedInstruction &decoded) {
+        cycleCount += decoded.cycles;
+        if (!jumpCondition(decoded.opcode & 0x0F)) {
+            ip += 2;
+            return;
+        }
+        if (decoded.opcode == 0x75 && (byte) decoded.immediate == 0xFD && skipDecJnz()) {
+            if (!jump) {
+                ip += 2;
+            }
+            return;
+        }
+        ip = (ip + 2) + signExtend((byte) decoded.immediate);
+        jump = true;
+        cycleCount += JUMP_TAKEN_CYCLES;
+    }
+    
+    // A ROM image with blocks in ROMBlocks.h, and its Memory::checksum() so
+    // some other ROM loaded in its place isn't taken for it
+    struct TranslatedROM {
+        address location;
+        address size;
+        uint32_t checksum;
+    };
+    
+}
+
+// the translated blocks call the handlers above directly
+#include "ROMBlocks.h"
+
+namespace DK86PC {
+    
+    void CPU::translateROMs() {
+        translatedImages = 0;
+        for (size_t i = 0; i < sizeof(translatedROMs) / sizeof(TranslatedROM); i++) {
+            const TranslatedROM &rom = translatedROMs[i];
+            if (memory.checksum(rom.location, rom.size) == rom.checksum) {
+                translatedImages |= 1 << i;
+            }
+        }
+    }
+    
 }
@@ -20,11 +20,16 @@
 #ifndef CPU_hpp
 #define CPU_hpp
 
+#include "FPU.hpp"
 #include "Memory.hpp"
+#include "Observer.hpp"
 #include "PortInterface.hpp"
+#include "Recompiler.hpp"
 
 namespace DK86PC {
 
+    class Hypercalls;
+
     union ModRegRM {
         struct {
             byte rm: 3; //0-2
@@ -35,24 +40,112 @@ namespace DK86PC {
         ModRegRM(byte thing) : full(thing) { }
     };
     
+    #define NO_LOCATION 0xFFFFFFFF
+    #define DECODE_CACHE_SIZE 16384 // must be a power of 2
+    #define FAST_FORWARD_LIMIT 4096 // most delay loop iterations skipped in one go
+    #define REPEAT_CHUNK 128 // most elements a REP string instruction does before it's suspended
+    #define JUMP_TAKEN_CYCLES 12 // on top of the not taken time for Jcc, LOOP and JCXZ
+    
+    class CPU;
+    struct DecodedInstruction;
+    // Works out a memory operand's offset for one particular mod/rm combination
+    typedef word (*AddressKernel)(const CPU &cpu, const DecodedInstruction &decoded);
+    
+    // An instruction with its prefixes and operands already pulled out of memory.
+    // These are cached by physical address so hot code isn't decoded over and over.
+    struct DecodedInstruction {
+        address location = NO_LOCATION; // physical address of first byte, including prefixes
+        uint32_t version = 0; // Memory::codeVersion() of its page when decoded
+        byte opcode = 0;
+        byte modrm = 0;
+        byte prefixCount = 0;
+        byte length = 1; // from the opcode on, not including prefixes
+        byte segment = 0; // segment register override, only valid if segmentOverride
+        bool segmentOverride = false;
+        bool lock = false;
+        bool repeatCX = false;
+        bool repeatZF = false;
+        word displacement = 0; // sign extended if it was only 8 bits, or direct address
+        word immediate = 0;
+        word immediate2 = 0; // segment half of a far pointer
+        word cycles = 0; // 8088 clocks, not counting taken jumps, repeats, or shifts by CL
+        AddressKernel addressKernel = nullptr; // chosen from the ModRM byte
+        byte addressSegment = 0b11; // segment register for a memory operand, after defaults and overrides
+        byte fuse = 0; // FusedPair, whether execute() runs the instruction after it right along with it
+    };
+    
+    // Common instruction pairs that execute() runs back to back in one go
+    enum FusedPair : byte {
+        FUSE_NONE = 0,
+        FUSE_JUMP, // CMP/TEST/SUB/INC/DEC then a Jcc, which tests the operands directly
+        FUSE_NEXT // LODS then STOS, or runs of PUSH reg or POP reg
+    };
+    
+    // The last flag setting ALU operation, whose flags haven't been worked out yet.
+    // The 16 bit kinds are all odd so LAZY_WORD tells the width.
+    enum LazyFlags : byte {
+        LAZY_NONE = 0, // flags word is up to date
+        LAZY_WORD = 1,
+        LAZY_ADD8 = 2, LAZY_ADD16 = 3,
+        LAZY_SUB8 = 4, LAZY_SUB16 = 5,
+        LAZY_INC8 = 6, LAZY_INC16 = 7,
+        LAZY_DEC8 = 8, LAZY_DEC16 = 9,
+        LAZY_LOGIC8 = 10, LAZY_LOGIC16 = 11
+    };
+    
+    // Why CPU::run() stopped
+    enum RunExit : byte {
+        EXIT_BUDGET, // used up its cycles
+        EXIT_HALTED, // sitting at a HLT until an interrupt
+        EXIT_INTERRUPT, // interrupts were just enabled, so one may be deliverable
+        EXIT_PORT // at or just after a port access that needs devices caught up
+    };
+    
+    // How the execution loop is built: once with no hooks at all, and once
+    // reporting to an Observer. run() and step() pick one per call, so a run
+    // nobody is watching pays nothing per instruction.
+    struct Unobserved {
+        static constexpr bool enabled = false;
+    };
+    struct Observed {
+        static constexpr bool enabled = true;
+    };
+    
+    typedef void (CPU::*OpcodeHandler)(const DecodedInstruction &decoded);
+    typedef void (CPU::*ShiftHandler)(ModRegRM mrr, byte amount);
+    
     class CPU {
     public:
-        CPU(PortInterface &p, Memory &mem) : portInterface(p), memory(mem) {
+        CPU(PortInterface &p, Memory &mem) : portInterface(p), memory(mem), decodeCache(DECODE_CACHE_SIZE) {
             reset();
         };
         void reset();
         void hardwareInterrupt(byte info);
         void step();
+        RunExit run(uint64_t cycleBudget);
+        uint64_t getCycleCount() { return cycleCount; };
         bool isHalted() { return halted; };
+        // instructions, interrupts and port accesses are reported to it, nullptr for none
+        void setObserver(Observer *o) {
+            observer = o;
+        };
+        // services for opcode F1, nullptr to leave it an unknown opcode
+        void setHypercalls(Hypercalls *h) {
+            hypercalls = h;
+        };
+        // Call once ROMs are loaded, to run the blocks in ROMBlocks.h of any
+        // that are the images they were translated from
+        void translateROMs();
         bool canInterrupt() {
             return interrupt;
         };
         #ifdef DEBUG
         void setTestingFlags(word testFlags) {
             flags = testFlags;
+            lazyOp = LAZY_NONE;
         };
         void setCSIP(word cs, word ip) {
-            this->cs = cs;
+            setCS(cs);
             this->ip = ip;
         }
         #endif
@@ -74,9 +167,21 @@ namespace DK86PC {
         
         inline void setFlagsDefaults();
         
+        // Lazy Flag Methods
+        inline bool getCarry();
+        inline bool getParity();
+        inline bool getAuxiliaryCarry();
+        inline bool getZero();
+        inline bool getSign();
+        inline bool getOverflow();
+        inline void materializeFlags();
+        
         // Get & Change Reg/Memory Methods
-        inline address calcEffectiveAddress(ModRegRM mrr);
-        inline address calcPhysicalAddress(ModRegRM mrr);
+        template <byte MOD, byte RM>
+        static word effectiveAddress(const CPU &cpu, const DecodedInstruction &decoded);
+        static const AddressKernel addressKernels[4][8];
+        inline address calcEffectiveAddress();
+        inline address calcPhysicalAddress();
         inline word getModRMWord(ModRegRM mrr);
         inline word getRegWord(byte reg);
         inline byte getModRMByte(ModRegRM mrr);
@@ -87,9 +192,38 @@ namespace DK86PC {
         inline void setRegWord(byte reg, word data);
         inline void setModRMByte(ModRegRM mrr, byte data);
         inline void setModRMWord(ModRegRM mrr, word data);
-        inline void modInstructionLength(ModRegRM mrr, byte &il);
         inline word getSegmentRegWord(byte reg);
         inline void setSegmentRegWord(byte reg, word data);
+        inline word *segmentRegister(byte reg);
+        
+        // Decoding
+        void decode(address location, DecodedInstruction &decoded);
+        inline const DecodedInstruction &fetchDecoded(address location);
+        template <class Policy>
+        RunExit runWith(uint64_t cycleBudget);
+        template <class Policy>
+        inline void stepWith();
+        template <class Policy>
+        inline void execute(const DecodedInstruction &decoded);
+        inline void executeOne(const DecodedInstruction &decoded);
+        inline void startInstruction(const DecodedInstruction &decoded);
+        inline void finishInstruction(const DecodedInstruction &decoded);
+        inline void fusedJump(const DecodedInstruction &decoded);
+        inline bool jumpCondition(byte condition);
+        inline void beginStep();
+        inline bool runBlock(address location);
+        // ROM blocks translated ahead of time into ROMBlocks.h, one specialization each
+        template <address LOCATION>
+        void translatedBlock();
+        bool runTranslatedBlock(address location);
+        byte translatedImages = 0; // bit for each image in ROMBlocks.h that's loaded
+        #ifdef RECOMPILER_AVAILABLE
+        friend class Recompiler;
+        static bool executeTranslated(CPU *cpu, const DecodedInstruction *decoded);
+        static word readTranslated(CPU *cpu, address location, bool wide);
+        static bool writeTranslated(CPU *cpu, address location, word value, bool wide, address block, uint32_t version);
+        static void materializeTranslated(CPU *cpu);
+        #endif
         
         //ROL/ROR/RCL/RCR/SHL/SHR/SAR
         inline void rolByte(ModRegRM mrr, byte amount);
@@ -132,39 +266,330 @@ namespace DK86PC {
         inline word pop();
         inline void performInterrupt(byte type);
         
+        // Opcode handlers, one per opcode (or run of opcodes that only differ by register)
+        // step() reaches these through a switch, or through opcodeHandlers with TABLE_DISPATCH
+        inline void addEbGb(const DecodedInstruction &decoded);
+        inline void addEvGv(const DecodedInstruction &decoded);
+        inline void addGbEb(const DecodedInstruction &decoded);
+        inline void addGvEv(const DecodedInstruction &decoded);
+        inline void addALIb(const DecodedInstruction &decoded);
+        inline void addAXIv(const DecodedInstruction &decoded);
+        inline void pushES(const DecodedInstruction &decoded);
+        inline void popES(const DecodedInstruction &decoded);
+        inline void orEbGb(const DecodedInstruction &decoded);
+        inline void orEvGv(const DecodedInstruction &decoded);
+        inline void orGbEb(const DecodedInstruction &decoded);
+        inline void orGvEv(const DecodedInstruction &decoded);
+        inline void orALIb(const DecodedInstruction &decoded);
+        inline void orAXIv(const DecodedInstruction &decoded);
+        inline void pushCS(const DecodedInstruction &decoded);
+        inline void adcEbGb(const DecodedInstruction &decoded);
+        inline void adcEvGv(const DecodedInstruction &decoded);
+        inline void adcGbEb(const DecodedInstruction &decoded);
+        inline void adcGvEv(const DecodedInstruction &decoded);
+        inline void adcALIb(const DecodedInstruction &decoded);
+        inline void adcAXIv(const DecodedInstruction &decoded);
+        inline void pushSS(const DecodedInstruction &decoded);
+        inline void popSS(const DecodedInstruction &decoded);
+        inline void sbbEbGb(const DecodedInstruction &decoded);
+        inline void sbbEvGv(const DecodedInstruction &decoded);
+        inline void sbbGbEb(const DecodedInstruction &decoded);
+        inline void sbbGvEv(const DecodedInstruction &decoded);
+        inline void sbbALIb(const DecodedInstruction &decoded);
+        inline void sbbAXIv(const DecodedInstruction &decoded);
+        inline void pushDS(const DecodedInstruction &decoded);
+        inline void popDS(const DecodedInstruction &decoded);
+        inline void andEbGb(const DecodedInstruction &decoded);
+        inline void andEvGv(const DecodedInstruction &decoded);
+        inline void andGbEb(const DecodedInstruction &decoded);
+        inline void andGvEv(const DecodedInstruction &decoded);
+        inline void andALIb(const DecodedInstruction &decoded);
+        inline void andAXIv(const DecodedInstruction &decoded);
+        inline void daa(const DecodedInstruction &decoded);
+        inline void subEbGb(const DecodedInstruction &decoded);
+        inline void subEvGv(const DecodedInstruction &decoded);
+        inline void subGbEb(const DecodedInstruction &decoded);
+        inline void subGvEv(const DecodedInstruction &decoded);
+        inline void subALIb(const DecodedInstruction &decoded);
+        inline void subAXIv(const DecodedInstruction &decoded);
+        inline void das(const DecodedInstruction &decoded);
+        inline void xorEbGb(const DecodedInstruction &decoded);
+        inline void xorEvGv(const DecodedInstruction &decoded);
+        inline void xorGbEb(const DecodedInstruction &decoded);
+        inline void xorGvEv(const DecodedInstruction &decoded);
+        inline void xorALIb(const DecodedInstruction &decoded);
+        inline void xorAXIv(const DecodedInstruction &decoded);
+        inline void aaa(const DecodedInstruction &decoded);
+        inline void cmpEbGb(const DecodedInstruction &decoded);
+        inline void cmpEvGv(const DecodedInstruction &decoded);
+        inline void cmpGbEb(const DecodedInstruction &decoded);
+        inline void cmpGvEv(const DecodedInstruction &decoded);
+        inline void cmpALIb(const DecodedInstruction &decoded);
+        inline void cmpAXIv(const DecodedInstruction &decoded);
+        inline void aas(const DecodedInstruction &decoded);
+        inline void incAX(const DecodedInstruction &decoded);
+        inline void incCX(const DecodedInstruction &decoded);
+        inline void incDX(const DecodedInstruction &decoded);
+        inline void incBX(const DecodedInstruction &decoded);
+        inline void incSP(const DecodedInstruction &decoded);
+        inline void incBP(const DecodedInstruction &decoded);
+        inline void incSI(const DecodedInstruction &decoded);
+        inline void incDI(const DecodedInstruction &decoded);
+        inline void decAX(const DecodedInstruction &decoded);
+        inline void decCX(const DecodedInstruction &decoded);
+        inline void decDX(const DecodedInstruction &decoded);
+        inline void decBX(const DecodedInstruction &decoded);
+        inline void decSP(const DecodedInstruction &decoded);
+        inline void decBP(const DecodedInstruction &decoded);
+        inline void decSI(const DecodedInstruction &decoded);
+        inline void decDI(const DecodedInstruction &decoded);
+        inline void pushAX(const DecodedInstruction &decoded);
+        inline void pushCX(const DecodedInstruction &decoded);
+        inline void pushDX(const DecodedInstruction &decoded);
+        inline void pushBX(const DecodedInstruction &decoded);
+        inline void pushSP(const DecodedInstruction &decoded);
+        inline void pushBP(const DecodedInstruction &decoded);
+        inline void pushSI(const DecodedInstruction &decoded);
+        inline void pushDI(const DecodedInstruction &decoded);
+        inline void popAX(const DecodedInstruction &decoded);
+        inline void popCX(const DecodedInstruction &decoded);
+        inline void popDX(const DecodedInstruction &decoded);
+        inline void popBX(const DecodedInstruction &decoded);
+        inline void popSP(const DecodedInstruction &decoded);
+        inline void popBP(const DecodedInstruction &decoded);
+        inline void popSI(const DecodedInstruction &decoded);
+        inline void popDI(const DecodedInstruction &decoded);
+        inline void jo(const DecodedInstruction &decoded);
+        inline void jno(const DecodedInstruction &decoded);
+        inline void jb(const DecodedInstruction &decoded);
+        inline void jnb(const DecodedInstruction &decoded);
+        inline void jz(const DecodedInstruction &decoded);
+        inline void jnz(const DecodedInstruction &decoded);
+        inline void jbe(const DecodedInstruction &decoded);
+        inline void ja(const DecodedInstruction &decoded);
+        inline void js(const DecodedInstruction &decoded);
+        inline void jns(const DecodedInstruction &decoded);
+        inline void jpe(const DecodedInstruction &decoded);
+        inline void jpo(const DecodedInstruction &decoded);
+        inline void jl(const DecodedInstruction &decoded);
+        inline void jge(const DecodedInstruction &decoded);
+        inline void jle(const DecodedInstruction &decoded);
+        inline void jg(const DecodedInstruction &decoded);
+        inline void testGbEb(const DecodedInstruction &decoded);
+        inline void testGvEv(const DecodedInstruction &decoded);
+        inline void xchgGbEb(const DecodedInstruction &decoded);
+        inline void xchgGvEv(const DecodedInstruction &decoded);
+        inline void movEbGb(const DecodedInstruction &decoded);
+        inline void movEvGv(const DecodedInstruction &decoded);
+        inline void movGbEb(const DecodedInstruction &decoded);
+        inline void movGvEv(const DecodedInstruction &decoded);
+        inline void movEwSw(const DecodedInstruction &decoded);
+        inline void leaGvM(const DecodedInstruction &decoded);
+        inline void movSwEw(const DecodedInstruction &decoded);
+        inline void popEv(const DecodedInstruction &decoded);
+        inline void nop(const DecodedInstruction &decoded);
+        inline void xchgCXAX(const DecodedInstruction &decoded);
+        inline void xchgDXAX(const DecodedInstruction &decoded);
+        inline void xchgBXAX(const DecodedInstruction &decoded);
+        inline void xchgSPAX(const DecodedInstruction &decoded);
+        inline void xchgBPAX(const DecodedInstruction &decoded);
+        inline void xchgSIAX(const DecodedInstruction &decoded);
+        inline void xchgDIAX(const DecodedInstruction &decoded);
+        inline void cbw(const DecodedInstruction &decoded);
+        inline void cwd(const DecodedInstruction &decoded);
+        inline void callAp(const DecodedInstruction &decoded);
+        inline void pushf(const DecodedInstruction &decoded);
+        inline void popf(const DecodedInstruction &decoded);
+        inline void sahf(const DecodedInstruction &decoded);
+        inline void lahf(const DecodedInstruction &decoded);
+        inline void movALOb(const DecodedInstruction &decoded);
+        inline void movAXOv(const DecodedInstruction &decoded);
+        inline void movObAL(const DecodedInstruction &decoded);
+        inline void movOvAX(const DecodedInstruction &decoded);
+        inline bool stringBlock(word segment, word offset, word count, byte size, bool write, address &start);
+        inline bool emptyRepeat();
+        inline void finishRepeat(word count, byte size, bool source, bool destination);
+        inline void suspendRepeat();
+        inline bool canFastForward();
+        inline bool skipSelfLoop(byte taken);
+        inline bool skipDecJnz();
+        inline const byte *stringElement(const byte *block, word count, byte size, word nth);
+        inline bool repeatMovs(byte size);
+        inline bool repeatStos(byte size);
+        inline bool repeatLods(byte size);
+        inline bool repeatScas(const DecodedInstruction &decoded, byte size);
+        inline bool repeatCmps(const DecodedInstruction &decoded, byte size);
+        inline void movsb(const DecodedInstruction &decoded);
+        inline void movsw(const DecodedInstruction &decoded);
+        inline void cmpsb(const DecodedInstruction &decoded);
+        inline void cmpsw(const DecodedInstruction &decoded);
+        inline void testALIb(const DecodedInstruction &decoded);
+        inline void testAXIv(const DecodedInstruction &decoded);
+        inline void stosb(const DecodedInstruction &decoded);
+        inline void stosw(const DecodedInstruction &decoded);
+        inline void lodsb(const DecodedInstruction &decoded);
+        inline void lodsw(const DecodedInstruction &decoded);
+        inline void scasb(const DecodedInstruction &decoded);
+        inline void scasw(const DecodedInstruction &decoded);
+        inline void movRegIb(const DecodedInstruction &decoded);
+        inline void movRegIv(const DecodedInstruction &decoded);
+        inline void retIw(const DecodedInstruction &decoded);
+        inline void ret(const DecodedInstruction &decoded);
+        inline void lesGvMp(const DecodedInstruction &decoded);
+        inline void ldsGvMp(const DecodedInstruction &decoded);
+        inline void movEbIb(const DecodedInstruction &decoded);
+        inline void movEvIv(const DecodedInstruction &decoded);
+        inline void retfIw(const DecodedInstruction &decoded);
+        inline void retf(const DecodedInstruction &decoded);
+        inline void int3(const DecodedInstruction &decoded);
+        inline void intIb(const DecodedInstruction &decoded);
+        inline void into(const DecodedInstruction &decoded);
+        inline void iret(const DecodedInstruction &decoded);
+        inline void aam(const DecodedInstruction &decoded);
+        inline void aad(const DecodedInstruction &decoded);
+        inline void xlat(const DecodedInstruction &decoded);
+        inline void loopnz(const DecodedInstruction &decoded);
+        inline void loopz(const DecodedInstruction &decoded);
+        inline void loop(const DecodedInstruction &decoded);
+        inline void jcxz(const DecodedInstruction &decoded);
+        inline void inALIb(const DecodedInstruction &decoded);
+        inline void inAXIb(const DecodedInstruction &decoded);
+        inline void outIbAL(const DecodedInstruction &decoded);
+        inline void outIbAX(const DecodedInstruction &decoded);
+        inline void callJv(const DecodedInstruction &decoded);
+        inline void jmpJv(const DecodedInstruction &decoded);
+        inline void jmpAp(const DecodedInstruction &decoded);
+        inline void jmpJb(const DecodedInstruction &decoded);
+        inline void inALDX(const DecodedInstruction &decoded);
+        inline void inAXDX(const DecodedInstruction &decoded);
+        inline void outDXAL(const DecodedInstruction &decoded);
+        inline void outDXAX(const DecodedInstruction &decoded);
+        inline void hlt(const DecodedInstruction &decoded);
+        inline void complementCarry(const DecodedInstruction &decoded);
+        inline void clearCarry(const DecodedInstruction &decoded);
+        inline void setCarry(const DecodedInstruction &decoded);
+        inline void clearInterrupt(const DecodedInstruction &decoded);
+        inline void setInterrupt(const DecodedInstruction &decoded);
+        inline void clearDirection(const DecodedInstruction &decoded);
+        inline void setDirection(const DecodedInstruction &decoded);
+        inline void escape(const DecodedInstruction &decoded);
+        inline void fwait(const DecodedInstruction &decoded);
+        inline void hypercall(const DecodedInstruction &decoded);
+        inline void unknownOpcode(const DecodedInstruction &decoded);
+        // GRP1-GRP5, dispatched on the reg field of ModRegRM
+        inline void group1Eb(const DecodedInstruction &decoded);
+        inline void group1Ev(const DecodedInstruction &decoded);
+        inline void addEbIb(const DecodedInstruction &decoded);
+        inline void orEbIb(const DecodedInstruction &decoded);
+        inline void adcEbIb(const DecodedInstruction &decoded);
+        inline void sbbEbIb(const DecodedInstruction &decoded);
+        inline void andEbIb(const DecodedInstruction &decoded);
+        inline void subEbIb(const DecodedInstruction &decoded);
+        inline void xorEbIb(const DecodedInstruction &decoded);
+        inline void cmpEbIb(const DecodedInstruction &decoded);
+        inline void addEvIv(const DecodedInstruction &decoded);
+        inline void orEvIv(const DecodedInstruction &decoded);
+        inline void adcEvIv(const DecodedInstruction &decoded);
+        inline void sbbEvIv(const DecodedInstruction &decoded);
+        inline void andEvIv(const DecodedInstruction &decoded);
+        inline void subEvIv(const DecodedInstruction &decoded);
+        inline void xorEvIv(const DecodedInstruction &decoded);
+        inline void cmpEvIv(const DecodedInstruction &decoded);
+        inline void group2Eb1(const DecodedInstruction &decoded);
+        inline void group2Ev1(const DecodedInstruction &decoded);
+        inline void group2EbCL(const DecodedInstruction &decoded);
+        inline void group2EvCL(const DecodedInstruction &decoded);
+        inline void group3Eb(const DecodedInstruction &decoded);
+        inline void group3Ev(const DecodedInstruction &decoded);
+        inline void testEbIb(const DecodedInstruction &decoded);
+        inline void notEb(const DecodedInstruction &decoded);
+        inline void negEb(const DecodedInstruction &decoded);
+        inline void mulEb(const DecodedInstruction &decoded);
+        inline void imulEb(const DecodedInstruction &decoded);
+        inline void divEb(const DecodedInstruction &decoded);
+        inline void idivEb(const DecodedInstruction &decoded);
+        inline void testEvIv(const DecodedInstruction &decoded);
+        inline void notEv(const DecodedInstruction &decoded);
+        inline void negEv(const DecodedInstruction &decoded);
+        inline void mulEv(const DecodedInstruction &decoded);
+        inline void imulEv(const DecodedInstruction &decoded);
+        inline void divEv(const DecodedInstruction &decoded);
+        inline void idivEv(const DecodedInstruction &decoded);
+        inline void group4Eb(const DecodedInstruction &decoded);
+        inline void incEb(const DecodedInstruction &decoded);
+        inline void decEb(const DecodedInstruction &decoded);
+        inline void group5Ev(const DecodedInstruction &decoded);
+        inline void incEv(const DecodedInstruction &decoded);
+        inline void decEv(const DecodedInstruction &decoded);
+        inline void callEv(const DecodedInstruction &decoded);
+        inline void callMp(const DecodedInstruction &decoded);
+        inline void jmpEv(const DecodedInstruction &decoded);
+        inline void jmpMp(const DecodedInstruction &decoded);
+        inline void pushEv(const DecodedInstruction &decoded);
+        inline void unimplementedGroupOpcode(const DecodedInstruction &decoded);
+        inline void unusedShift(ModRegRM mrr, byte amount);
+        
+        #ifdef TABLE_DISPATCH
+        static const OpcodeHandler opcodeHandlers[256];
+        #endif
+        static const OpcodeHandler group1ByteHandlers[8];
+        static const OpcodeHandler group1WordHandlers[8];
+        static const ShiftHandler group2ByteHandlers[8];
+        static const ShiftHandler group2WordHandlers[8];
+        static const OpcodeHandler group3ByteHandlers[8];
+        static const OpcodeHandler group3WordHandlers[8];
+        static const OpcodeHandler group4Handlers[8];
+        static const OpcodeHandler group5Handlers[8];
+        
         // Debug
-        inline void debugPrint(byte opcode);
+        friend class TraceObserver;
+        friend class IdleDetector;
+        void debugPrint(const DecodedInstruction &decoded);
+        Observer *observer = nullptr;
         
         // External Constructs
         PortInterface &portInterface;
+        Hypercalls *hypercalls = nullptr;
         Memory &memory;
+        FPU fpu{memory};
+        
+        // Decoded instruction cache
+        vector<DecodedInstruction> decodeCache;
+        const DecodedInstruction *currentInstruction;
+        bool jump; // the current instruction set ip itself
+        byte instructionLength; // of the current instruction, not including prefixes
+        
+        #ifdef RECOMPILER_AVAILABLE
+        Recompiler recompiler{*this};
+        #endif
         
         // Registers
-        union generalRegister {
+        // Indexed by their ModRM reg encoding, with the byte halves laid over
+        // them (assumes a little endian host, as the flags union does)
+        union {
+            word registers[8];
+            byte registerBytes[16];
+            struct {
+                word ax, cx, Dx, bx; // general purpose registers
+                word sp, bp, si, di; // stack pointer, base pointer, source index, destination index
+            };
             struct {
-                byte low;
-                byte high;
-            } inner;
-            word main;
+                byte al, ah, cl, Ch, dl, dh, bl, bh;
+            };
         };
-        generalRegister ar, br, cr, dr; // general purpose registers
-        
-        // this would be a lot easier if c++ supported anonymous structs like c11
-        #define ax ar.main
-        #define al ar.inner.low
-        #define ah ar.inner.high
-        #define bx br.main
-        #define bl br.inner.low
-        #define bh br.inner.high
-        #define cx cr.main
-        #define cl cr.inner.low
-        #define Ch cr.inner.high
-        #define Dx dr.main
-        #define dl dr.inner.low
-        #define dh dr.inner.high
-        
-        word sp, bp, si, di; // stack pointer, base pointer, source index, destination index
-        word cs, ds, es, ss; // code segment, data segment, extra, stack
+        // where AL, CL, DL, BL, AH, CH, DH, BH are in registerBytes
+        static constexpr byte byteRegisterIndex[8] = {0, 2, 4, 6, 1, 3, 5, 7};
+        union {
+            word segments[4];
+            struct {
+                word es, cs, ss, ds; // extra, code segment, stack, data segment
+            };
+        };
+        address csBase; // cs << 4, kept up to date by setCS() for fetching
+        inline void setCS(word data) {
+            cs = data;
+            csBase = ((address) data) << 4;
+        }
         word *currentSegment;
         bool segmentOverride = false;
         word ip; // instruction pointer
@@ -189,6 +614,11 @@ namespace DK86PC {
             word flags;
         };
         
+        // Lazy flags, see materializeFlags()
+        byte lazyOp = LAZY_NONE;
+        word lazyLeft, lazyRight, lazyResult;
+        bool lazyCarryIn; // ADC/SBB
+        bool lazyKept; // carry for INC/DEC, auxiliary carry for logic ops
 
     };
 
@@ -20,6 +20,7 @@
 #include "catch.hpp"
 #include "Memory.hpp"
 #include "CPU.hpp"
+#include "Hypercalls.hpp"
 #include "DummyPortInterface.hpp"
 #include "Types.h"
 #include <vector>
@@ -27,6 +28,10 @@
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace DK86PC;
@@ -47,11 +52,51 @@ vector<uint8_t> loadBin(string filename) {
     return buffer;
 }
 
+// A CPU and its memory with nothing else attached, for running short programs
+struct TestMachine {
+    Memory memory;
+    DummyPortInterface dpi;
+    CPU cpu;
+    TestMachine() : cpu(dpi, memory) { }
+    // put program at 0000:ip and reset the CPU to start there
+    template <size_t N>
+    void load(const uint8_t (&program)[N], word ip = 0x100) {
+        memory.writeBlock(ip, program, N);
+        cpu.reset();
+        cpu.setCSIP(0x0000, ip);
+    }
+    // carry on until it halts
+    void run() {
+        while (cpu.run(1000) != EXIT_HALTED) { }
+    }
+    template <size_t N>
+    void run(const uint8_t (&program)[N], word ip = 0x100) {
+        load(program, ip);
+        run();
+    }
+};
+
+// Counts what it's told about, to check the observed CPU gets the same results
+class CountingObserver : public Observer {
+public:
+    int instructions = 0;
+    int memoryAccesses = 0;
+    void instruction(CPU &cpu, const DecodedInstruction &decoded) override {
+        instructions++;
+    }
+    void memoryRead(address location, word value, bool wide) override {
+        memoryAccesses++;
+    }
+    void memoryWrite(address location, word value, bool wide) override {
+        memoryAccesses++;
+    }
+};
 
 TEST_CASE( "artlav CPU Tests" ) {
     auto name = GENERATE(as<std::string>{}, "rotate", "add", "sub", "jump1", "jump2", "bitwise", "control", "cmpneg", "rep", "shifts", "strings", "interrupt", "jmpmov", "datatrnf", "segpr", "bcdcnv", "mul", "div");
+    auto observed = GENERATE(false, true);
     
-    DYNAMIC_SECTION( "Instructions: " << name ) {
+    DYNAMIC_SECTION( "Instructions: " << name << (observed ? " (observed)" : "") ) {
         Memory memory = Memory();
         memory.loadBIOS("80186_tests/" + name + ".bin");
         DummyPortInterface dpi = DummyPortInterface();
@@ -60,8 +105,19 @@ TEST_CASE( "artlav CPU Tests" ) {
         cpu.setTestingFlags(0b0000000000000010);
         // tests otherwise go off the end of the 1 MB of memory with first reset vector jmp
         cpu.setCSIP(0xF000, 0xFFF0);
-        while (!cpu.isHalted()) {
-            cpu.step();
+        CountingObserver counter;
+        if (observed) {
+            cpu.setObserver(&counter);
+            memory.setObserver(&counter);
+        }
+        while (cpu.run(1000) != EXIT_HALTED) { }
+        if (observed) {
+            CHECK(counter.instructions > 0);
+            CHECK(counter.memoryAccesses > 0);
+            memory.setObserver(nullptr);
+            const int accesses = counter.memoryAccesses;
+            memory.readByte(0);
+            CHECK(counter.memoryAccesses == accesses);
         }
         // special test case without result
         if (name == "jmpmov") {
@@ -79,3 +135,455 @@ TEST_CASE( "artlav CPU Tests" ) {
         }
     }
 }
+
+// A directory of its own for a test's files, gone again when the test ends
+struct TemporaryDirectory {
+    filesystem::path path;
+    TemporaryDirectory(const string &name) {
+        path = filesystem::temp_directory_path() / (name + "-" + to_string(getpid()));
+        filesystem::create_directories(path);
+    }
+    ~TemporaryDirectory() {
+        filesystem::remove_all(path);
+    }
+};
+
+TEST_CASE( "Hypercalls" ) {
+    TemporaryDirectory directory("dk86pc-hypercalls");
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    Hypercalls hypercalls = Hypercalls(directory.path.string());
+    machine.cpu.setHypercalls(&hypercalls);
+    const uint8_t program[] = {
+        0xB4, 0x00, 0xF1, 0xA3, 0x00, 0x02, // detect, mov [0200], ax
+        0xB4, 0x01, 0xBE, 0x00, 0x04, 0xBF, 0x00, 0x03, 0xB9, 0x04, 0x00, 0xF1, // export 4 bytes at 0400
+        0xB4, 0x02, 0xBE, 0x00, 0x05, 0xF1, 0xA3, 0x02, 0x02, // import them to 0500, mov [0202], ax
+        0xB8, 0x07, 0x04, 0xF1, // exit with status 7
+        0xF4,
+    };
+    const uint8_t name[] = "hypercall.bin";
+    const uint8_t data[] = {0xDE, 0xAD, 0xBE, 0xEF};
+    memory.writeBlock(0x300, name, sizeof(name));
+    memory.writeBlock(0x400, data, sizeof(data));
+    machine.run(program);
+    CHECK(filesystem::file_size(directory.path / "hypercall.bin") == 4);
+    CHECK(memory.readWord(0x200) == HYPERCALL_SIGNATURE);
+    CHECK(memory.readWord(0x202) == 4);
+    CHECK(memory.readWord(0x500) == 0xADDE);
+    CHECK(memory.readWord(0x502) == 0xEFBE);
+    CHECK(hypercalls.exitRequested());
+    CHECK(hypercalls.exitStatus() == 7);
+    
+    // names that would leave the directory are refused
+    HypercallRegisters registers = {0x0100, 0, 4, 0, 0x0400, 0x0300, 0, 0, false};
+    const uint8_t escape[] = "../hypercall.bin";
+    memory.writeBlock(0x300, escape, sizeof(escape));
+    hypercalls.call(registers, memory);
+    CHECK(registers.carry);
+}
+
+TEST_CASE( "8087" ) {
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    const uint8_t program[] = {
+        0x9B, 0xDB, 0xE3, // FINIT
+        0xD9, 0xE8, 0xD9, 0xE8, 0xDE, 0xC1, // FLD1, FLD1, FADDP ST(1), ST
+        0xD9, 0xFA, 0xDD, 0x16, 0x00, 0x02, // FSQRT, FST QWORD [0200]
+        0xD8, 0xC8, 0xDF, 0x1E, 0x10, 0x02, // FMUL ST, ST(0), FISTP WORD [0210]
+        0xDF, 0x06, 0x20, 0x02, 0xDE, 0x36, 0x22, 0x02, // FILD WORD [0220], FIDIV WORD [0222]
+        0xDF, 0x1E, 0x12, 0x02, // FISTP WORD [0212]
+        0xD9, 0xEB, 0xD9, 0xE8, 0xDE, 0xD9, // FLDPI, FLD1, FCOMPP
+        0xDD, 0x3E, 0x14, 0x02, // FSTSW [0214]
+        0xDF, 0x06, 0x20, 0x02, 0xDF, 0x36, 0x30, 0x02, // FILD WORD [0220], FBSTP [0230]
+        0xDD, 0x06, 0x00, 0x02, 0xDB, 0x3E, 0x40, 0x02, // FLD QWORD [0200], FSTP TBYTE [0240]
+        0xDB, 0x2E, 0x40, 0x02, 0xDD, 0x1E, 0x50, 0x02, // FLD TBYTE [0240], FSTP QWORD [0250]
+        0xF4,
+    };
+    const uint8_t operands[] = {10, 0, 4, 0};
+    memory.writeBlock(0x220, operands, sizeof(operands));
+    machine.run(program);
+    double root;
+    memcpy(&root, memory.readBlock(0x200), sizeof(root));
+    CHECK(root == Approx(1.41421356237));
+    CHECK(memory.readWord(0x210) == 2);
+    CHECK(memory.readWord(0x212) == 2); // 2.5 rounds to even
+    CHECK(memory.readWord(0x214) == 0x0120); // C0 for less than, precision from rounding, stack empty again
+    CHECK(memory.readWord(0x230) == 0x0010); // packed BCD
+    CHECK(memcmp(memory.readBlock(0x200), memory.readBlock(0x250), 8) == 0);
+}
+
+TEST_CASE( "Undocumented opcodes" ) {
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    const uint8_t program[] = {
+        0x31, 0xC0, 0x64, 0x02, 0xB0, 0x01, 0xA2, 0x00, 0x02, // xor ax, ax, 64 is jz, mov [0200], al
+        0x40, 0x64, 0x02, 0xB0, 0x02, 0xA2, 0x01, 0x02, // inc ax, 64 isn't taken, mov [0201], al
+        0xF4,
+    };
+    machine.run(program);
+    CHECK(memory.readByte(0x200) == 0);
+    CHECK(memory.readByte(0x201) == 2);
+}
+
+TEST_CASE( "Self-modifying code" ) {
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    const uint8_t program[] = {
+        0xB9, 0x02, 0x00, // mov cx, 2
+        0xB0, 0x11, 0x00, 0x06, 0x00, 0x02, // mov al, 11, add [0200], al
+        0xC6, 0x06, 0x04, 0x01, 0x22, // mov byte [0104], 22 (the mov al's immediate)
+        0xE2, 0xF3, // loop back to the mov al
+        0xC6, 0x06, 0x17, 0x01, 0x90, // mov byte [0117], 90 (the hlt after the jmp)
+        0xEB, 0x00, // jmp $+2, which empties the 8088's prefetch queue
+        0xF4, 0xA2, 0x01, 0x02, // hlt, now nop, mov [0201], al
+        0xF4,
+    };
+    machine.run(program);
+    CHECK(memory.readByte(0x200) == 0x33); // the second time round was decoded again
+    CHECK(memory.readByte(0x201) == 0x22);
+}
+
+TEST_CASE( "Cycle counts" ) {
+    TestMachine machine;
+    const uint8_t program[] = {
+        0xB9, 0x03, 0x00, 0xBE, 0x00, 0x02, // mov cx, 3, mov si, 0200: 4 + 4
+        0xBF, 0x00, 0x03, 0xB8, 0x34, 0x12, // mov di, 0300, mov ax, 1234: 4 + 4
+        0x01, 0x06, 0x00, 0x04, // add [0400], ax: 16 + 6 EA + 8 for two words over the 8 bit bus
+        0x02, 0x00, // add al, [bx+si]: 9 + 7 EA
+        0xF3, 0xA4, // rep movsb: 9 + 17 * 3
+        0xB9, 0x02, 0x00, 0xE2, 0xFE, // mov cx, 2, loop $: 4 + 17 taken + 5 not
+        0xF3, 0xAA, // rep stosb with cx 0: 9
+        0xF4, // hlt: 2
+    };
+    machine.run(program);
+    CHECK(machine.cpu.getCycleCount() == 16 + 30 + 16 + 60 + 26 + 9 + 2);
+}
+
+TEST_CASE( "Interrupted REP" ) {
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    const uint8_t program[] = {
+        0xB8, 0x00, 0x01, 0x8E, 0xC0, 0xBC, 0x00, 0x08, // mov ax, 0100, mov es, ax, mov sp, 0800
+        0xB9, 0x2C, 0x01, 0xBE, 0x00, 0x10, 0xBF, 0x00, 0x20, // mov cx, 300, mov si, 1000, mov di, 2000
+        0xFB, 0x26, 0xF3, 0xA4, // sti, rep movsb from es:si at 0112
+        0x89, 0x0E, 0x14, 0x02, // mov [0214], cx
+        0xF4,
+    };
+    const uint8_t handler[] = {
+        0x58, 0x50, 0xA3, 0x10, 0x02, // pop ax, push ax, mov [0210], ax (the return ip)
+        0x89, 0x0E, 0x12, 0x02, 0xCF, // mov [0212], cx, iret
+    };
+    const uint8_t vector[] = {0x00, 0x04, 0x00, 0x00};
+    uint8_t source[300];
+    for (int i = 0; i < 300; i++) {
+        source[i] = (uint8_t) (i ^ 0x5A);
+    }
+    memory.writeBlock(0x400, handler, sizeof(handler));
+    memory.writeBlock(8 * 4, vector, sizeof(vector));
+    memory.writeBlock(0x2000, source, sizeof(source)); // es:1000, where ds:1000 is all 0
+    machine.load(program);
+    for (int i = 0; i < 8; i++) { // up to and including the first chunk of the REP
+        machine.cpu.step();
+    }
+    machine.cpu.hardwareInterrupt(8);
+    machine.run();
+    CHECK(memory.readWord(0x210) == 0x112); // back to the segment override, not the REP or the MOVSB
+    CHECK(memory.readWord(0x212) == 300 - REPEAT_CHUNK);
+    CHECK(memory.readWord(0x214) == 0);
+    CHECK(memcmp(memory.readBlock(0x3000), source, sizeof(source)) == 0); // still from es after resuming
+}
+
+TEST_CASE( "Delay loops" ) {
+    // both more than FAST_FORWARD_LIMIT times round, then store the flags and cx
+    const int times = 10000;
+    const int store = 14 + 12 + 14 + 19 + 2; // pushf, pop ax, mov [0200], ax, mov [0202], cx, hlt
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    
+    SECTION( "LOOP $" ) {
+        const uint8_t program[] = {
+            0xB9, 0x10, 0x27, 0x3C, 0x01, // mov cx, 10000, cmp al, 1 (CF, PF, AF and SF)
+            0xE2, 0xFE, // loop $
+            0x9C, 0x58, 0xA3, 0x00, 0x02, 0x89, 0x0E, 0x02, 0x02, 0xF4,
+        };
+        machine.run(program);
+        CHECK(memory.readWord(0x202) == 0);
+        CHECK((memory.readWord(0x200) & 0x8D5) == 0x95); // untouched
+        CHECK(machine.cpu.getCycleCount() == 4 + 4 + (times - 1) * 17 + 5 + store);
+    }
+    
+    SECTION( "DEC/JNZ" ) {
+        const uint8_t program[] = {
+            0xB9, 0x10, 0x27, 0xF9, // mov cx, 10000, stc
+            0x49, 0x75, 0xFD, // dec cx, jnz back to it
+            0x9C, 0x58, 0xA3, 0x00, 0x02, 0x89, 0x0E, 0x02, 0x02, 0xF4,
+        };
+        machine.run(program);
+        CHECK(memory.readWord(0x202) == 0);
+        CHECK((memory.readWord(0x200) & 0x8D5) == 0x45); // ZF and PF from the last DEC, CF kept
+        CHECK(machine.cpu.getCycleCount() == 4 + 2 + times * 3 + (times - 1) * 16 + 4 + store);
+    }
+    
+    SECTION( "Breakpoints and observers" ) {
+        // every time round still stops at the breakpoint and gets observed
+        const uint8_t program[] = {
+            0xB9, 0x10, 0x27, 0x49, 0x75, 0xFD, // mov cx, 10000, dec cx, jnz back to it
+            0xB9, 0x10, 0x27, 0xE2, 0xFE, 0xF4, // mov cx, 10000, loop $, hlt
+        };
+        memory.watch(0x103, 1, WATCH_EXECUTE);
+        machine.run(program);
+        CHECK(memory.watchHits() == times);
+        CHECK(machine.cpu.getCycleCount() == 4 + times * 3 + (times - 1) * 16 + 4 + 4 + (times - 1) * 17 + 5 + 2);
+        memory.unwatch(0x103, 1, WATCH_EXECUTE);
+        CountingObserver observer;
+        machine.cpu.setObserver(&observer);
+        machine.run(program);
+        machine.cpu.setObserver(nullptr);
+        CHECK(observer.instructions == 1 + times * 2 + 1 + times + 1);
+    }
+}
+
+TEST_CASE( "Fused jumps" ) {
+    // Each FUSE_JUMP kind, then the jump over an STI, logging the flags (IF
+    // being whether it fell through) and the register changed to es:di.
+    // Observed runs never fuse, so they're what running each one at a time gets.
+    const uint8_t program[] = {
+        0xBB, 0x05, 0x00, 0xB9, 0x07, 0x00, 0xFA, 0xBF, 0x00, 0x02, // mov bx, 5, mov cx, 7, cli, mov di, 0200
+        0x39, 0xCB, 0x7C, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // cmp bx, cx, jl
+        0x3A, 0xD9, 0x77, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // cmp bl, cl, ja
+        0xB8, 0x00, 0x80, 0x3D, 0x01, 0x00, 0x70, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // mov ax, 8000, cmp ax, 1, jo
+        0x29, 0xCB, 0x78, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, 0x89, 0xD8, 0xAB, // sub bx, cx, js
+        0xB0, 0x03, 0x2C, 0x03, 0x75, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // mov al, 3, sub al, 3, jnz
+        0x85, 0xCB, 0x7A, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // test bx, cx, jpe
+        0xB0, 0x80, 0xA8, 0x80, 0x79, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // mov al, 80, test al, 80, jns
+        0x41, 0x7F, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, 0x89, 0xC8, 0xAB, // inc cx, jg
+        0x4A, 0x76, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, 0x89, 0xD0, 0xAB, // dec dx, jbe
+        0x83, 0xFB, 0xFE, 0x74, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // cmp bx, -2, jz
+        0x81, 0xE9, 0x00, 0x10, 0x72, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, 0x89, 0xC8, 0xAB, // sub cx, 1000, jb
+        0x80, 0xFB, 0xFE, 0x7D, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // cmp bl, fe, jge
+        0x80, 0xEB, 0x7F, 0x71, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, 0x89, 0xD8, 0xAB, // sub bl, 7f, jno
+        0x39, 0xD1, 0x73, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // cmp cx, dx, jnb
+        0x84, 0xDB, 0x7B, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // test bl, bl, jpo
+        0x3B, 0xCB, 0x7E, 0x01, 0xFB, 0x9C, 0xFA, 0x58, 0xAB, // cmp cx, bx, jle
+        0x89, 0x3E, 0xFE, 0x01, 0xF4, // mov [01FE], di
+    };
+    TestMachine fused, separate;
+    CountingObserver counter;
+    separate.cpu.setObserver(&counter);
+    fused.run(program);
+    separate.run(program);
+    const word end = fused.memory.readWord(0x1FE);
+    CHECK(end == 0x200 + 2 * (16 + 5));
+    CHECK(separate.memory.readWord(0x1FE) == end);
+    for (word place = 0x200; place < end; place += 2) {
+        INFO("Log word at " << hex << place);
+        CHECK(fused.memory.readWord(place) == separate.memory.readWord(place));
+    }
+    CHECK(fused.cpu.getCycleCount() == separate.cpu.getCycleCount());
+}
+
+TEST_CASE( "Memory operands" ) {
+    // twice round, so the second time is compiled code where there's a recompiler
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    const uint8_t program[] = {
+        0xB9, 0x02, 0x00, // mov cx, 2
+        0xA1, 0xFF, 0x0F, 0x00, 0xCC, 0xA3, 0xFF, 0x1F, // mov ax, [0FFF], add ah, cl, mov [1FFF], ax (across pages)
+        0x8B, 0x1E, 0x00, 0x30, 0x89, 0x1E, 0x02, 0x30, // mov bx, [3000], mov [3002], bx (watched)
+        0x50, 0x5A, 0x89, 0x16, 0x04, 0x30, // push ax, pop dx, mov [3004], dx
+        0xE2, 0xE8, // loop back to the mov ax
+        0xF4,
+    };
+    const uint8_t across[] = {0x34, 0x12};
+    const uint8_t watched[] = {0x78, 0x56};
+    memory.writeBlock(0xFFF, across, sizeof(across));
+    memory.writeBlock(0x3000, watched, sizeof(watched));
+    memory.watch(0x3000, 2, WATCH_READ);
+    memory.watch(0x3002, 2, WATCH_WRITE);
+    machine.load(program);
+    const uint64_t writes = memory.writes();
+    machine.run();
+    CHECK(memory.readWord(0x1FFF) == 0x1334);
+    CHECK(memory.readWord(0x3004) == 0x1334);
+    CHECK(memory.writes() - writes == 8);
+    CHECK(memory.watchHits() == 4);
+    CHECK(memory.readWord(0x3002) == 0x5678);
+}
+
+TEST_CASE( "Translated ROM blocks" ) {
+    // The BIOS booting with the blocks in ROMBlocks.h, and observed so it's
+    // stepped an instruction at a time; wherever the first stops, the second
+    // gets to the same cycle count with the same low memory (vectors, BIOS
+    // data and stack)
+    const uint64_t cycles = 30000000;
+    TestMachine plain;
+    TestMachine translated;
+    for (TestMachine *machine : {&plain, &translated}) {
+        machine->memory.loadBIOS("../BIOS/pcxtbios.bin");
+        machine->cpu.reset();
+    }
+    translated.cpu.translateROMs();
+    CountingObserver observer;
+    plain.cpu.setObserver(&observer);
+    vector<pair<uint64_t, uint32_t>> stops;
+    while (translated.cpu.getCycleCount() < cycles) {
+        translated.cpu.step();
+        stops.push_back({translated.cpu.getCycleCount(), translated.memory.checksum(0, 0x800)});
+    }
+    size_t steps = 0;
+    size_t matched = 0;
+    size_t differing = 0;
+    while (plain.cpu.getCycleCount() < cycles) {
+        plain.cpu.step();
+        steps++;
+        if (matched < stops.size() && stops[matched].first == plain.cpu.getCycleCount()) {
+            differing += stops[matched].second != plain.memory.checksum(0, 0x800);
+            matched++;
+        }
+    }
+    CHECK(matched == stops.size());
+    CHECK(differing == 0);
+    CHECK(stops.size() < steps);
+
+    // a BIOS that isn't the one they were translated from is just interpreted
+    TestMachine patched;
+    vector<uint8_t> bios = loadBin("../BIOS/pcxtbios.bin");
+    bios[0x5B] = 0xF4; // HLT where the reset vector jumps to, in place of CLI
+    patched.memory.loadData(bios, 0xFE000);
+    patched.memory.mapROM(0xFE000, 0x2000);
+    patched.cpu.translateROMs();
+    patched.cpu.reset();
+    CHECK(patched.cpu.run(1000) == EXIT_HALTED);
+}
+
+TEST_CASE( "Memory map" ) {
+    Memory memory = Memory(0x10000);
+    vector<uint8_t> rom = {0x12, 0x34};
+    memory.loadData(rom, 0xFFFFE);
+    memory.mapROM(0xFF000, 0x1000);
+    memory.setByte(0xFFFFF, 0x56);
+    CHECK(memory.readByte(0xFFFFF) == 0x34); // write protected
+    memory.setByte(0x00000, 0x78);
+    CHECK(memory.readWord(0xFFFFF) == 0x7834); // wraps around at 1 MB
+    CHECK(memory.readByte(0x10000) == 0xFF); // open bus past the RAM
+    Memory partial = Memory(0x10800);
+    partial.setByte(0x10FFF, 0x9A);
+    CHECK(partial.readByte(0x10FFF) == 0x9A); // RAM goes up to a whole page
+    CHECK(partial.readByte(0x11000) == 0xFF);
+    CHECK(memory.isReadable(0xFF000, 0x1000));
+    CHECK(!memory.isWritable(0xFF000, 0x1000));
+    CHECK(!memory.isReadable(0x0F000, 0x2000));
+    
+    // ROMs mapped from their files read the same and stay write protected
+    Memory first = Memory(0x10000);
+    Memory second = Memory(0x10000);
+    first.loadBIOS("80186_tests/add.bin");
+    second.loadBIOS("80186_tests/add.bin");
+    CHECK(first.checksum(0xF0000, 0x10000) == second.checksum(0xF0000, 0x10000));
+    CHECK(!second.isWritable(0xF0000, 0x10000));
+    second.setByte(0xFFFF0, ~second.readByte(0xFFFF0));
+    CHECK(first.readByte(0xFFFF0) == second.readByte(0xFFFF0));
+    first.loadBIOS("80186_tests/sub.bin");
+    CHECK(first.checksum(0xF0000, 0x10000) != second.checksum(0xF0000, 0x10000));
+}
+
+struct RecordingListener : public WatchListener {
+    vector<WatchHit> hits;
+    void hit(const WatchHit &hit) override {
+        hits.push_back(hit);
+    }
+};
+
+TEST_CASE( "Watchpoints" ) {
+    TestMachine machine;
+    Memory &memory = machine.memory;
+    const uint8_t program[] = {
+        0xA1, 0xFF, 0x0F, // mov ax, [0FFF], a word across into the watched page
+        0xB9, 0x04, 0x00, 0xBF, 0x00, 0x20, 0xF3, 0xAA, // mov cx, 4, mov di, 2000, rep stosb
+        0xF4,
+    };
+    memory.setByte(0x1000, 0x42);
+    RecordingListener listener;
+    memory.setWatchListener(&listener);
+    memory.watch(0x1000, 1, WATCH_READ);
+    memory.watch(0x2002, 1, WATCH_WRITE);
+    memory.watch(0x10B, 1, WATCH_EXECUTE);
+    CHECK(memory.hasBreakpoints());
+    machine.run(program);
+    REQUIRE(listener.hits.size() == 3);
+    CHECK(listener.hits[0].kind == WATCH_READ);
+    CHECK(listener.hits[0].location == 0x1000);
+    CHECK(listener.hits[0].wide);
+    CHECK(listener.hits[1].kind == WATCH_WRITE);
+    CHECK(listener.hits[1].location == 0x2002);
+    CHECK(listener.hits[1].value == 0x00); // al from the word at 0FFF
+    CHECK(memory.watchHits() == 3);
+    CHECK(memory.lastWatchHit().kind == WATCH_EXECUTE);
+    CHECK(memory.lastWatchHit().location == 0x10B);
+    CHECK(memory.readByte(0x2003) == 0x00);
+    
+    // breakpoints in two pages, taken away one at a time
+    memory.watch(0x5000, 1, WATCH_EXECUTE);
+    memory.unwatch(0x10B, 1, WATCH_EXECUTE);
+    CHECK(memory.hasBreakpoints());
+    memory.unwatch(0x0, 0x100000, WATCH_READ | WATCH_WRITE | WATCH_EXECUTE);
+    CHECK(!memory.hasBreakpoints());
+    CHECK(!memory.isWatched(0x0, 0x100000, WATCH_WRITE));
+    memory.readByte(0x1000);
+    CHECK(memory.watchHits() == 3);
+    
+    // fast-forwarding DEC/JNZ looks back at the DEC as code, not data
+    const uint8_t delay[] = {0xB9, 0x0A, 0x00, 0x49, 0x75, 0xFD, 0xF4}; // mov cx, 10, dec cx, jnz $-1, hlt
+    memory.watch(0x303, 1, WATCH_READ);
+    machine.run(delay, 0x300);
+    CHECK(memory.watchHits() == 3);
+}
+
+// Cleans up after the shared memory test however it ends
+struct SharedMemoryGuard {
+    string name;
+    int descriptor = -1;
+    void *view = MAP_FAILED;
+    ~SharedMemoryGuard() {
+        if (view != MAP_FAILED) {
+            munmap(view, 0x100000);
+        }
+        if (descriptor != -1) {
+            close(descriptor);
+        }
+        shm_unlink(name.c_str());
+    }
+};
+
+TEST_CASE( "Shared memory" ) {
+    SharedMemoryGuard guard;
+    guard.name = "/dk86pc-test-" + to_string(getpid());
+    Memory memory = Memory(0x10000, guard.name);
+    REQUIRE(memory.getSharedName() == guard.name);
+    REQUIRE(memory.getSharedDescriptor() != -1);
+    // another process would do the same to look in
+    guard.descriptor = shm_open(guard.name.c_str(), O_RDONLY, 0);
+    REQUIRE(guard.descriptor != -1);
+    guard.view = mmap(nullptr, 0x100000, PROT_READ, MAP_SHARED, guard.descriptor, 0);
+    REQUIRE(guard.view != MAP_FAILED);
+    memory.setWord(0x1234, 0xBEEF);
+    CHECK(((const uint8_t *) guard.view)[0x1234] == 0xEF);
+    CHECK(((const uint8_t *) guard.view)[0x1235] == 0xBE);
+    
+    // a name that's taken isn't taken away without being asked to
+    Memory second = Memory(0x10000, guard.name);
+    CHECK(second.getSharedDescriptor() == -1);
+    second.setWord(0x1234, 0x1111);
+    CHECK(((const uint8_t *) guard.view)[0x1234] == 0xEF);
+    {
+        Memory replacing = Memory(0x10000, guard.name, true);
+        CHECK(replacing.getSharedDescriptor() != -1);
+    }
+    // the replacement cleaned up its own object, and the first still works
+    CHECK(shm_open(guard.name.c_str(), O_RDONLY, 0) == -1);
+    memory.setByte(0x1234, 0x22);
+    CHECK(((const uint8_t *) guard.view)[0x1234] == 0x22);
+    
+    Memory unshared = Memory(0x10000);
+    CHECK(unshared.getSharedDescriptor() == -1);
+}
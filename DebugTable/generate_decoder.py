@@ -0,0 +1,88 @@
+# Writes OperandLayouts.h, the operand layout of every opcode that
+# CPU::decode() works from, out of the operand kinds in 8086_table.txt.
+# Run it from anywhere; CPUTests/Makefile runs it whenever the table changes.
+# translate_roms.py imports it to find instruction lengths.
+
+import csv
+import os
+
+here = os.path.dirname(os.path.abspath(__file__))
+
+MODRM_KINDS = {"Eb", "Ev", "Ew", "Gb", "Gv", "M", "Mp", "Sw"}
+IMM8_KINDS = {"Ib", "I0", "Jb"}
+IMM16_KINDS = {"Iv", "Iw", "Jv", "Ob", "Ov"}
+FARPTR_KINDS = {"Ap"}
+
+def layout(operands):
+	flags = []
+	if MODRM_KINDS & operands:
+		flags.append("MODRM")
+	if IMM8_KINDS & operands:
+		flags.append("IMM8")
+	if IMM16_KINDS & operands:
+		flags.append("IMM16")
+	if FARPTR_KINDS & operands:
+		flags.append("FARPTR")
+	return flags
+
+# flags of every opcode's layout, by opcode
+def read_layouts():
+	with open(os.path.join(here, "8086_table.txt")) as table_file:
+		opcodes = {}
+		group_immediates = set() # groups where only some members have an immediate
+		for line in csv.reader(table_file, dialect="excel-tab"):
+			fields = [field for field in line if field != ""]
+			if len(fields) < 2:
+				continue
+			operands = set(" ".join(fields[2:]).split())
+			if fields[0].startswith("GRP"):
+				if layout(operands - MODRM_KINDS):
+					group_immediates.add(fields[0][:-2])
+			else:
+				opcodes[int(fields[0], 16)] = (fields[1], operands)
+	layouts = []
+	for opcode in range(256):
+		mnemonic, operands = opcodes[opcode]
+		flags = layout(operands)
+		if mnemonic in group_immediates:
+			flags.append("GRP3IMM")
+		layouts.append(flags)
+	return layouts
+
+def write_header(layouts):
+	rows = []
+	for high in range(16):
+		entries = [" | ".join(flags) if flags else "0" for flags in layouts[high * 16:high * 16 + 16]]
+		rows.append(f"        /* {high:X}_ */ " + ", ".join(entries) + ",")
+
+	with open(os.path.join(here, "..", "OperandLayouts.h"), "w") as header:
+		header.write(f"""//
+//  OperandLayouts.h
+//  DK86PC
+//
+//  Generated from DebugTable/8086_table.txt by DebugTable/generate_decoder.py,
+//  don't edit by hand.
+//
+
+#include "Types.h"
+
+#ifndef OperandLayouts_h
+#define OperandLayouts_h
+
+namespace DK86PC {{
+    // Operand layout of each opcode after the opcode byte itself, used by decode()
+    #define MODRM 1 // ModRM byte plus any displacement it calls for
+    #define IMM8 2 // one byte immediate (also 8 bit jump displacements and ports)
+    #define IMM16 4 // two byte immediate (also 16 bit jump displacements and offsets)
+    #define FARPTR 8 // offset followed by segment
+    #define GRP3IMM 16 // F6/F7 TEST is the only member of its group with an immediate
+    
+    static constexpr byte operandLayouts[256] = {{
+""" + "\n".join(rows) + """
+    };
+}
+#endif /* OperandLayouts_h */
+""")
+
+if __name__ == "__main__":
+	write_header(read_layouts())
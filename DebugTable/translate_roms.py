@@ -0,0 +1,295 @@
+# Translates the basic blocks of the ROMs the emulator ships with into C++,
+# writing ROMBlocks.h, which CPU.cpp includes. Each block becomes a function
+# that runs its instructions' handlers one after another on DecodedInstructions
+# worked out here, so none of it is fetched or decoded at run time.
+# Blocks are found by following every direct jump, call and return point from
+# the ROM's entry points; anything only reached through a register, memory or
+# a vector set up at run time is left to the interpreter (or recompiler).
+# The handler for each opcode is read out of CPU::executeOne()'s switch, so
+# the two can't disagree.
+
+import os
+import re
+from collections import namedtuple
+from generate_decoder import read_layouts
+
+here = os.path.dirname(os.path.abspath(__file__))
+
+# (name, files, physical address, entry points as (cs, ip))
+ROMS = [
+	("pcxtbios", ["BIOS/pcxtbios.bin"], 0xFE000, [(0xF000, 0xFFF0), (0xF000, 0xE05B)]),
+	("casetteBASIC", ["CasetteBASIC/5150cb10_1.bin", "CasetteBASIC/5150cb10_2.bin",
+		"CasetteBASIC/5150cb10_3.bin", "CasetteBASIC/5150cb10_4.bin"], 0xF6000, [(0xF600, 0x0000)]),
+]
+BIOS_VECTORS = 0xFEF3 # IBM's table of the offsets of the handlers for INT 8 to 1C (then data for 1D to 1F)
+PREFIXES = {0x26, 0x2E, 0x36, 0x3E, 0xF0, 0xF2, 0xF3}
+UNKNOWN = {0x0F, 0xC0, 0xC1, 0xC8, 0xC9, 0xD6, 0xF1} # treated as data
+RETURNS = {0xC2, 0xC3, 0xCA, 0xCB, 0xCF}
+# left to the interpreter: port I/O has to be able to stop CPU::run() right
+# before it, and HLT to stop it right after
+UNTRANSLATED = {0xE4, 0xE5, 0xE6, 0xE7, 0xEC, 0xED, 0xEE, 0xEF, 0xF4}
+
+layouts = read_layouts()
+
+# Fields of a DecodedInstruction, length being from the opcode on
+Instruction = namedtuple("Instruction", ["location", "prefixes", "opcode", "modrm", "length",
+	"displacement", "immediate", "immediate2"])
+
+# Same as Memory::checksum(), 32 bit FNV-1a
+def checksum(data):
+	hash = 0x811C9DC5
+	for b in data:
+		hash = ((hash ^ b) * 0x01000193) & 0xFFFFFFFF
+	return hash
+
+def signed(value, bits):
+	return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+def sign_extend(value):
+	return value | 0xFF00 if value & 0x80 else value
+
+def word_at(data, place):
+	return int.from_bytes(data[place:place + 2], "little")
+
+def size(instruction):
+	return len(instruction.prefixes) + instruction.length
+
+# The instruction at physical address location, pulled apart the way
+# CPU::decode() does it, or None if it runs off the image or isn't an instruction
+def decode(data, base, location):
+	place = location - base
+	while place < len(data) and data[place] in PREFIXES:
+		place += 1
+	if place >= len(data) or data[place] in UNKNOWN:
+		return None
+	prefixes = data[location - base:place]
+	opcode = data[place]
+	flags = layouts[opcode]
+	length = 1
+	modrm = None
+	displacement = 0
+	if "MODRM" in flags:
+		if place + 1 >= len(data):
+			return None
+		modrm = data[place + 1]
+		mod, reg, rm = modrm >> 6, (modrm >> 3) & 7, modrm & 7
+		length = 2
+		if mod == 1:
+			displacement = sign_extend(data[place + 2]) if place + 2 < len(data) else 0
+			length += 1
+		elif mod == 2 or (mod == 0 and rm == 6):
+			displacement = word_at(data, place + 2)
+			length += 2
+		if "GRP3IMM" in flags and reg == 0:
+			flags = flags + (["IMM16"] if opcode & 1 else ["IMM8"])
+	immediate_size = 1 if "IMM8" in flags else 2 if "IMM16" in flags else 4 if "FARPTR" in flags else 0
+	if place + length + immediate_size > len(data):
+		return None
+	immediate = 0
+	immediate2 = 0
+	if immediate_size == 1:
+		immediate = data[place + length]
+		if opcode == 0x83: # sign extended so it can share 0x81's handlers
+			immediate = sign_extend(immediate)
+	elif immediate_size >= 2:
+		immediate = word_at(data, place + length)
+		if immediate_size == 4:
+			immediate2 = word_at(data, place + length + 2)
+	return Instruction(location, prefixes, opcode, modrm, length + immediate_size, displacement, immediate, immediate2)
+
+# Physical addresses where a jump, call or return can land
+def find_blocks(data, base, entries):
+	blocks = set()
+	seen = set()
+	work = []
+	def target(cs, ip):
+		physical = (cs << 4) + ip
+		if base <= physical < base + len(data):
+			blocks.add(physical)
+			work.append((cs, ip))
+	for cs, ip in entries:
+		target(cs, ip)
+	while work:
+		cs, ip = work.pop()
+		while True:
+			physical = (cs << 4) + ip
+			if physical in seen or not (base <= physical < base + len(data)):
+				break
+			seen.add(physical)
+			instruction = decode(data, base, physical)
+			if instruction is None:
+				break
+			opcode, immediate = instruction.opcode, instruction.immediate
+			next_ip = (ip + size(instruction)) & 0xFFFF
+			reg = (instruction.modrm >> 3) & 7 if instruction.modrm is not None else None
+			if 0x60 <= opcode <= 0x7F or 0xE0 <= opcode <= 0xE3: # Jcc (60-6F alias 70-7F), LOOP, JCXZ
+				target(cs, (next_ip + signed(immediate, 8)) & 0xFFFF)
+			elif opcode == 0xEB:
+				target(cs, (next_ip + signed(immediate, 8)) & 0xFFFF)
+				break
+			elif opcode == 0xE9:
+				target(cs, (next_ip + immediate) & 0xFFFF)
+				break
+			elif opcode == 0xE8:
+				target(cs, (next_ip + immediate) & 0xFFFF)
+				target(cs, next_ip)
+			elif opcode == 0xEA:
+				target(instruction.immediate2, immediate)
+				break
+			elif opcode == 0x9A:
+				target(instruction.immediate2, immediate)
+				target(cs, next_ip)
+			elif opcode in (0xCC, 0xCD, 0xCE) or (opcode == 0xFF and reg in (2, 3)): # INT, indirect CALL
+				target(cs, next_ip)
+			elif opcode in RETURNS or (opcode == 0xFF and reg in (4, 5)): # indirect JMP
+				break
+			ip = next_ip
+	return sorted(blocks)
+
+# Anything that can change cs:ip other than falling through, plus POPF and
+# STI since CPU::run() checks whether they turned interrupts on between steps
+def ends_block(instruction):
+	opcode = instruction.opcode
+	return (0x60 <= opcode <= 0x7F or 0xE0 <= opcode <= 0xE3 or 0xE8 <= opcode <= 0xEB or
+		0xCC <= opcode <= 0xCF or opcode in RETURNS or opcode in (0x9A, 0x9D, 0xFB, 0xFF) or
+		(opcode == 0x8E and (instruction.modrm >> 3) & 7 == 1)) # MOV CS
+
+# The instructions of the block at location, up to and including the one
+# that ends it, and the block it falls through into if it runs into one
+def gather(data, base, location, blocks):
+	instructions = []
+	place = location
+	while base <= place < base + len(data):
+		instruction = decode(data, base, place)
+		if instruction is None or instruction.opcode in UNTRANSLATED:
+			return instructions, None
+		instructions.append(instruction)
+		place += size(instruction)
+		if ends_block(instruction):
+			return instructions, None
+		if place in blocks:
+			return instructions, place
+	return instructions, None
+
+# Name of the handler executeOne() calls for each opcode
+def read_handlers():
+	handlers = {}
+	cases = [] # a run of cases can go on over several lines
+	with open(os.path.join(here, "..", "CPU.cpp")) as source:
+		for line in source:
+			match = re.match(r"\s*((?:case 0x[0-9A-F]{2}:\s*)+)(?:(\w+)\(decoded\); break;)?", line)
+			if not match:
+				cases = []
+				continue
+			cases += re.findall(r"0x([0-9A-F]{2})", match.group(1))
+			if match.group(2):
+				for opcode in cases:
+					handlers.setdefault(int(opcode, 16), match.group(2))
+				cases = []
+	return handlers
+
+# A DecodedInstruction initializer, fields in the order they're declared
+def initializer(instruction):
+	prefixCount = len(instruction.prefixes)
+	segment = 0
+	segmentOverride = lock = repeatCX = repeatZF = False
+	for prefix in instruction.prefixes:
+		if prefix == 0xF0:
+			lock = True
+		elif prefix == 0xF3:
+			repeatCX = repeatZF = True
+		elif prefix == 0xF2:
+			repeatCX = True
+		else:
+			segment = (prefix >> 3) & 3
+			segmentOverride = True
+	modrm = instruction.modrm if instruction.modrm is not None else 0
+	kernel = "nullptr"
+	addressSegment = 3
+	if instruction.modrm is not None:
+		mod, rm = modrm >> 6, modrm & 7
+		kernel = f"&CPU::effectiveAddress<{mod}, {rm}>"
+		if segmentOverride:
+			addressSegment = segment
+		elif rm in (2, 3) or (rm == 6 and mod != 0):
+			addressSegment = 2
+	boolean = lambda value: "true" if value else "false"
+	cycles = f"instructionCycles(0x{instruction.opcode:02X}, 0x{modrm:02X}, {prefixCount}, {boolean(repeatCX)})"
+	fields = [f"0x{instruction.location:05X}", "0", f"0x{instruction.opcode:02X}", f"0x{modrm:02X}",
+		str(prefixCount), str(instruction.length), str(segment), boolean(segmentOverride), boolean(lock),
+		boolean(repeatCX), boolean(repeatZF), f"0x{instruction.displacement:04X}", f"0x{instruction.immediate:04X}",
+		f"0x{instruction.immediate2:04X}", cycles, kernel, str(addressSegment)]
+	return "{" + ", ".join(fields) + "}"
+
+def write_block(source, location, instructions, next_block, handlers):
+	source.write(f"    template <>\n    void CPU::translatedBlock<0x{location:05X}>() {{\n")
+	source.write("        static constexpr DecodedInstruction block[] = {\n")
+	for instruction in instructions:
+		source.write(f"            {initializer(instruction)},\n")
+	source.write("        };\n")
+	for i, instruction in enumerate(instructions):
+		source.write(f"        startInstruction(block[{i}]);\n")
+		source.write(f"        {handlers[instruction.opcode]}(block[{i}]);\n")
+		source.write(f"        finishInstruction(block[{i}]);\n")
+		if i != len(instructions) - 1 or next_block is not None:
+			source.write("        if (jump) {\n            return;\n        }\n")
+	if next_block is not None:
+		source.write(f"        translatedBlock<0x{next_block:05X}>();\n")
+	source.write("    }\n\n")
+
+def translate():
+	handlers = read_handlers()
+	images = []
+	for name, files, base, entries in ROMS:
+		data = b"".join(open(os.path.join(here, "..", file), "rb").read() for file in files)
+		if name == "pcxtbios":
+			vectors = BIOS_VECTORS - (base - 0xF0000)
+			for i in range(0, 42, 2):
+				entries.append((0xF000, word_at(data, vectors + i)))
+		starts = find_blocks(data, base, entries)
+		blocks = {}
+		for location in starts:
+			instructions, next_block = gather(data, base, location, set(starts))
+			if instructions:
+				blocks[location] = (instructions, next_block)
+		images.append((name, files, base, data, blocks))
+
+	with open(os.path.join(here, "..", "ROMBlocks.h"), "w") as source:
+		source.write("""//
+//  ROMBlocks.h
+//  DK86PC
+//
+//  Generated from the ROM images by DebugTable/translate_roms.py,
+//  don't edit by hand.
+//
+
+namespace DK86PC {
+""")
+		# declared up front since a block can fall through into one after it
+		for name, files, base, data, blocks in images:
+			for location in blocks:
+				source.write(f"    template <> void CPU::translatedBlock<0x{location:05X}>();\n")
+		source.write("\n")
+		for name, files, base, data, blocks in images:
+			source.write(f"    // {', '.join(files)}\n\n")
+			for location, (instructions, next_block) in blocks.items():
+				if next_block not in blocks:
+					next_block = None
+				write_block(source, location, instructions, next_block, handlers)
+
+		source.write("    const TranslatedROM translatedROMs[] = {\n")
+		for name, files, base, data, blocks in images:
+			source.write(f"        {{0x{base:05X}, 0x{len(data):X}, 0x{checksum(data):08X}}}, // {name}\n")
+		source.write("    };\n\n")
+
+		source.write("    bool CPU::runTranslatedBlock(address location) {\n")
+		for i, (name, files, base, data, blocks) in enumerate(images):
+			source.write(f"        if ((translatedImages & {1 << i}) && location >= 0x{base:05X} && location < 0x{base + len(data):05X}) {{\n")
+			source.write("            switch (location) {\n")
+			for location in blocks:
+				source.write(f"                case 0x{location:05X}: translatedBlock<0x{location:05X}>(); return true;\n")
+			source.write("                default: return false;\n            }\n        }\n")
+		source.write("        return false;\n    }\n}\n")
+
+if __name__ == "__main__":
+	translate()
@@ -0,0 +1,731 @@
+//
+//  FPU.cpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// implement the intel 8087
+
+#include "FPU.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace DK86PC {
+
+    static const extended INDEFINITE = -numeric_limits<extended>::quiet_NaN();
+    static const extended L2T = 3.32192809488736234787031942948939017586L;
+    static const extended L2E = 1.44269504088896340735992468100189213743L;
+    static const extended PI = 3.14159265358979323846264338327950288420L;
+    static const extended LG2 = 0.301029995663981195213738894724493026768L;
+    static const extended LN2 = 0.693147180559945309417232121458176568076L;
+    
+    static byte classify(extended value) {
+        switch (fpclassify(value)) {
+            case FP_ZERO:
+                return TAG_ZERO;
+            case FP_NORMAL:
+                return TAG_VALID;
+            default:
+                return TAG_SPECIAL;
+        }
+    }
+    
+    void FPU::reset() {
+        control = 0x03FF; // all exceptions masked, extended precision, round to nearest
+        status = 0;
+        top = 0;
+        for (int i = 0; i < 8; i++) {
+            registers[i] = 0;
+            tags[i] = TAG_EMPTY;
+        }
+        lastInstruction = 0;
+        lastOpcode = 0;
+        lastOperand = 0;
+    }
+    
+    void FPU::execute(byte opcode, byte modrm, address operand, address instruction) {
+        const byte reg = (modrm >> 3) & 7;
+        const byte rm = modrm & 7;
+        // the environment keeps the last instruction that wasn't a control instruction
+        const bool controlInstruction = (opcode == 0xD9 && operand != NO_FPU_OPERAND && reg >= 4)
+            || (opcode == 0xDB && operand == NO_FPU_OPERAND && reg == 4)
+            || (opcode == 0xDD && operand != NO_FPU_OPERAND && reg >= 4);
+        if (!controlInstruction) {
+            lastInstruction = instruction;
+            lastOpcode = ((opcode & 7) << 8) | modrm;
+            if (operand != NO_FPU_OPERAND) {
+                lastOperand = operand;
+            }
+        }
+        if (operand == NO_FPU_OPERAND) {
+            registerEscape(opcode, reg, rm);
+        } else {
+            memoryEscape(opcode, reg, operand);
+        }
+    }
+    
+    // Register stack
+    
+    // an empty register reads as the indefinite NaN, after a stack underflow
+    extended FPU::read(int i) {
+        if (tag(i) == TAG_EMPTY) {
+            raise(FPU_INVALID);
+            return INDEFINITE;
+        }
+        return st(i);
+    }
+    
+    void FPU::write(int i, extended value) {
+        st(i) = value;
+        tag(i) = classify(value);
+    }
+    
+    void FPU::push(extended value) {
+        top = (top - 1) & 7;
+        if (tag(0) != TAG_EMPTY) { // stack overflow
+            raise(FPU_INVALID);
+            value = INDEFINITE;
+        }
+        write(0, value);
+    }
+    
+    void FPU::pop() {
+        tag(0) = TAG_EMPTY;
+        top = (top + 1) & 7;
+    }
+    
+    // Exceptions and flags
+    
+    void FPU::raise(word exceptions) {
+        status |= exceptions;
+        if (exceptions & ~control & 0x3F) {
+            status |= FPU_INTERRUPT_REQUEST;
+        }
+    }
+    
+    // Flag what went wrong working out result from a and b
+    extended FPU::checked(extended result, extended a, extended b, bool division) {
+        if (fpclassify(a) == FP_SUBNORMAL || fpclassify(b) == FP_SUBNORMAL) {
+            raise(FPU_DENORMAL);
+        }
+        if (isnan(result)) {
+            if (!isnan(a) && !isnan(b)) {
+                raise(FPU_INVALID);
+                return INDEFINITE;
+            }
+        } else if (isinf(result)) {
+            if (isfinite(a) && isfinite(b)) {
+                raise(division && b == 0 ? FPU_ZERO_DIVIDE : FPU_OVERFLOW);
+            }
+        } else if (fpclassify(result) == FP_SUBNORMAL) {
+            raise(FPU_UNDERFLOW);
+        }
+        return result;
+    }
+    
+    void FPU::compare(extended a, extended b) {
+        if (isnan(a) || isnan(b)) {
+            raise(FPU_INVALID);
+            setCondition(FPU_C3 | FPU_C2 | FPU_C0);
+        } else if (a > b) {
+            setCondition(0);
+        } else if (a < b) {
+            setCondition(FPU_C0);
+        } else {
+            setCondition(FPU_C3);
+        }
+    }
+    
+    // FXAM
+    void FPU::examine() {
+        const word sign = signbit(st(0)) ? FPU_C1 : 0;
+        if (tag(0) == TAG_EMPTY) {
+            setCondition(sign | FPU_C3 | FPU_C0);
+            return;
+        }
+        switch (fpclassify(st(0))) {
+            case FP_NAN:
+                setCondition(sign | FPU_C0);
+                break;
+            case FP_INFINITE:
+                setCondition(sign | FPU_C2 | FPU_C0);
+                break;
+            case FP_ZERO:
+                setCondition(sign | FPU_C3);
+                break;
+            case FP_SUBNORMAL:
+                setCondition(sign | FPU_C3 | FPU_C2);
+                break;
+            default:
+                setCondition(sign | FPU_C2);
+                break;
+        }
+    }
+    
+    // By the rounding control, without touching the host's rounding mode
+    extended FPU::roundToInteger(extended value) {
+        if (!isfinite(value)) {
+            return value;
+        }
+        extended rounded;
+        switch ((control >> 10) & 3) {
+            case 0: // nearest, ties to even
+            {
+                rounded = floorl(value);
+                const extended fraction = value - rounded;
+                if (fraction > 0.5L || (fraction == 0.5L && fmodl(rounded, 2) != 0)) {
+                    rounded += 1;
+                }
+                break;
+            }
+            case 1: // down
+                rounded = floorl(value);
+                break;
+            case 2: // up
+                rounded = ceill(value);
+                break;
+            default: // chop
+                rounded = truncl(value);
+                break;
+        }
+        if (rounded != value) {
+            raise(FPU_PRECISION);
+        }
+        return rounded;
+    }
+    
+    // Groups of instructions
+    
+    // FADD, FMUL, FCOM, FCOMP, FSUB, FSUBR, FDIV, FDIVR by the reg field,
+    // as st(destination) = st(destination) op source
+    void FPU::arithmetic(byte operation, int destination, extended source) {
+        const extended a = read(destination);
+        switch (operation) {
+            case 0:
+                write(destination, checked(a + source, a, source));
+                break;
+            case 1:
+                write(destination, checked(a * source, a, source));
+                break;
+            case 2:
+                compare(a, source);
+                break;
+            case 3:
+                compare(a, source);
+                pop();
+                break;
+            case 4:
+                write(destination, checked(a - source, a, source));
+                break;
+            case 5:
+                write(destination, checked(source - a, source, a));
+                break;
+            case 6:
+                write(destination, checked(a / source, a, source, true));
+                break;
+            case 7:
+                write(destination, checked(source / a, source, a, true));
+                break;
+        }
+    }
+    
+    void FPU::registerEscape(byte opcode, byte reg, byte rm) {
+        switch (opcode) {
+            case 0xD8:
+                arithmetic(reg, 0, read(rm));
+                break;
+            case 0xD9:
+                switch (reg) {
+                    case 0: // FLD st(i)
+                        push(read(rm));
+                        break;
+                    case 1: // FXCH
+                    {
+                        const extended temp = read(0);
+                        write(0, read(rm));
+                        write(rm, temp);
+                        break;
+                    }
+                    case 2: // FNOP
+                        break;
+                    case 3: // FSTP st(i), undocumented
+                        write(rm, read(0));
+                        pop();
+                        break;
+                    case 4:
+                        if (rm == 0) { // FCHS
+                            write(0, -read(0));
+                        } else if (rm == 1) { // FABS
+                            write(0, fabsl(read(0)));
+                        } else if (rm == 4) { // FTST
+                            compare(read(0), 0);
+                        } else if (rm == 5) { // FXAM
+                            examine();
+                        }
+                        break;
+                    default:
+                        constantsAndFunctions(reg, rm);
+                        break;
+                }
+                break;
+            case 0xDB:
+                if (reg == 4) {
+                    switch (rm) {
+                        case 0: // FENI
+                            control &= ~0x0080;
+                            break;
+                        case 1: // FDISI
+                            control |= 0x0080;
+                            break;
+                        case 2: // FCLEX
+                            status &= ~(FPU_INTERRUPT_REQUEST | 0x3F);
+                            break;
+                        case 3: // FINIT
+                            reset();
+                            break;
+                    }
+                }
+                break;
+            case 0xDC: // st(i) as the destination, which swaps the reverse forms
+            case 0xDE: // same, then pop
+                if (opcode == 0xDE && reg == 3) { // FCOMPP
+                    if (rm == 1) {
+                        compare(read(0), read(1));
+                        pop();
+                        pop();
+                    }
+                    break;
+                }
+                if (reg == 2 || reg == 3) {
+                    arithmetic(reg, 0, read(rm));
+                } else {
+                    arithmetic(reg >= 4 ? reg ^ 1 : reg, rm, read(0));
+                    if (opcode == 0xDE) {
+                        pop();
+                    }
+                }
+                break;
+            case 0xDD:
+            case 0xDF:
+                switch (reg) {
+                    case 0: // FFREE, or for DF undocumented FFREEP
+                        tag(rm) = TAG_EMPTY;
+                        if (opcode == 0xDF) {
+                            pop();
+                        }
+                        break;
+                    case 1: // FXCH, undocumented
+                        registerEscape(0xD9, 1, rm);
+                        break;
+                    case 2: // FST st(i)
+                        write(rm, read(0));
+                        if (opcode == 0xDF) { // undocumented FSTP
+                            pop();
+                        }
+                        break;
+                    case 3: // FSTP st(i)
+                        write(rm, read(0));
+                        pop();
+                        break;
+                }
+                break;
+            default: // DA has no register forms on the 8087
+                break;
+        }
+    }
+    
+    void FPU::memoryEscape(byte opcode, byte reg, address operand) {
+        switch (opcode) {
+            case 0xD8:
+                arithmetic(reg, 0, readReal32(operand));
+                break;
+            case 0xD9:
+                switch (reg) {
+                    case 0: // FLD m32real
+                        push(readReal32(operand));
+                        break;
+                    case 2: // FST m32real
+                        writeReal32(operand, read(0));
+                        break;
+                    case 3: // FSTP m32real
+                        writeReal32(operand, read(0));
+                        pop();
+                        break;
+                    case 4: // FLDENV
+                        loadEnvironment(operand);
+                        break;
+                    case 5: // FLDCW
+                        control = (word) readInteger(operand, 2);
+                        break;
+                    case 6: // FSTENV
+                        storeEnvironment(operand);
+                        control |= 0x3F;
+                        break;
+                    case 7: // FSTCW
+                        writeInteger(operand, control, 2);
+                        break;
+                }
+                break;
+            case 0xDA:
+                arithmetic(reg, 0, (int32_t) readInteger(operand, 4));
+                break;
+            case 0xDB:
+                switch (reg) {
+                    case 0: // FILD m32int
+                        push((int32_t) readInteger(operand, 4));
+                        break;
+                    case 2: // FIST m32int
+                        storeInteger(operand, read(0), 4);
+                        break;
+                    case 3: // FISTP m32int
+                        storeInteger(operand, read(0), 4);
+                        pop();
+                        break;
+                    case 5: // FLD m80real
+                        push(readReal80(operand));
+                        break;
+                    case 7: // FSTP m80real
+                        writeReal80(operand, read(0));
+                        pop();
+                        break;
+                }
+                break;
+            case 0xDC:
+                arithmetic(reg, 0, readReal64(operand));
+                break;
+            case 0xDD:
+                switch (reg) {
+                    case 0: // FLD m64real
+                        push(readReal64(operand));
+                        break;
+                    case 2: // FST m64real
+                        writeReal64(operand, read(0));
+                        break;
+                    case 3: // FSTP m64real
+                        writeReal64(operand, read(0));
+                        pop();
+                        break;
+                    case 4: // FRSTOR
+                        loadEnvironment(operand);
+                        for (int i = 0; i < 8; i++) {
+                            st(i) = readReal80(operand + 14 + i * 10);
+                        }
+                        break;
+                    case 6: // FSAVE
+                        storeEnvironment(operand);
+                        for (int i = 0; i < 8; i++) {
+                            writeReal80(operand + 14 + i * 10, st(i));
+                        }
+                        reset();
+                        break;
+                    case 7: // FSTSW
+                        writeInteger(operand, (status & ~0x3800) | (top << 11), 2);
+                        break;
+                }
+                break;
+            case 0xDE:
+                arithmetic(reg, 0, (int16_t) readInteger(operand, 2));
+                break;
+            case 0xDF:
+                switch (reg) {
+                    case 0: // FILD m16int
+                        push((int16_t) readInteger(operand, 2));
+                        break;
+                    case 2: // FIST m16int
+                        storeInteger(operand, read(0), 2);
+                        break;
+                    case 3: // FISTP m16int
+                        storeInteger(operand, read(0), 2);
+                        pop();
+                        break;
+                    case 4: // FBLD
+                        push(readBCD(operand));
+                        break;
+                    case 5: // FILD m64int
+                        push((int64_t) readInteger(operand, 8));
+                        break;
+                    case 6: // FBSTP
+                        writeBCD(operand, read(0));
+                        pop();
+                        break;
+                    case 7: // FISTP m64int
+                        storeInteger(operand, read(0), 8);
+                        pop();
+                        break;
+                }
+                break;
+        }
+    }
+    
+    // D9 E8-FF
+    void FPU::constantsAndFunctions(byte reg, byte rm) {
+        if (reg == 5) {
+            static const extended constants[7] = {1, L2T, L2E, PI, LG2, LN2, 0};
+            if (rm < 7) {
+                push(constants[rm]);
+            }
+            return;
+        }
+        const extended x = read(0);
+        switch ((reg << 3) | rm) {
+            case 060: // F2XM1
+                write(0, checked(expm1l(x * LN2), x, x));
+                break;
+            case 061: // FYL2X
+            {
+                const extended y = read(1);
+                write(1, checked(y * log2l(x), y, x, x == 0));
+                pop();
+                break;
+            }
+            case 062: // FPTAN
+                write(0, checked(tanl(x), x, x));
+                push(1);
+                break;
+            case 063: // FPATAN
+            {
+                const extended y = read(1);
+                write(1, checked(atan2l(y, x), y, x));
+                pop();
+                break;
+            }
+            case 064: // FXTRACT
+                if (x == 0) {
+                    raise(FPU_ZERO_DIVIDE);
+                    write(0, -numeric_limits<extended>::infinity());
+                    push(x);
+                } else if (isfinite(x)) {
+                    const int exponent = ilogbl(x);
+                    write(0, exponent);
+                    push(scalbnl(x, -exponent));
+                } else {
+                    write(0, fabsl(x));
+                    push(x);
+                }
+                break;
+            case 066: // FDECSTP
+                top = (top - 1) & 7;
+                break;
+            case 067: // FINCSTP
+                top = (top + 1) & 7;
+                break;
+            case 070: // FPREM, done in one go rather than 64 bits of quotient at a time
+            {
+                const extended y = read(1);
+                if (y == 0 || isinf(x) || isnan(x) || isnan(y)) {
+                    write(0, checked(fmodl(x, y), x, y));
+                    break;
+                }
+                const extended remainder = fmodl(x, y);
+                const uint64_t quotient = (uint64_t) fmodl(fabsl(truncl((x - remainder) / y)), 8);
+                setCondition(((quotient & 4) ? FPU_C0 : 0) | ((quotient & 2) ? FPU_C3 : 0) | ((quotient & 1) ? FPU_C1 : 0));
+                write(0, remainder);
+                break;
+            }
+            case 071: // FYL2XP1
+            {
+                const extended y = read(1);
+                write(1, checked(y * log1pl(x) * L2E, y, x));
+                pop();
+                break;
+            }
+            case 072: // FSQRT
+                write(0, checked(sqrtl(x), x, x));
+                break;
+            case 074: // FRNDINT
+                write(0, roundToInteger(x));
+                break;
+            case 075: // FSCALE
+            {
+                const extended y = read(1);
+                const extended scale = fmaxl(-65536, fminl(65536, truncl(y)));
+                write(0, checked(scalbnl(x, isnan(scale) ? 0 : (int) scale), x, y));
+                break;
+            }
+            default: // 80387 instructions
+                break;
+        }
+    }
+    
+    // Memory operands, little endian
+    
+    uint64_t FPU::readInteger(address location, int size) {
+        uint64_t value = 0;
+        for (int i = size - 1; i >= 0; i--) {
+            value = (value << 8) | memory.readByte(location + i);
+        }
+        return value;
+    }
+    
+    void FPU::writeInteger(address location, uint64_t value, int size) {
+        for (int i = 0; i < size; i++) {
+            memory.setByte(location + i, (byte) (value >> (i * 8)));
+        }
+    }
+    
+    extended FPU::readReal32(address location) {
+        const uint32_t bits = (uint32_t) readInteger(location, 4);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    
+    extended FPU::readReal64(address location) {
+        const uint64_t bits = readInteger(location, 8);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    
+    void FPU::writeReal32(address location, extended value) {
+        const float narrowed = checked((float) value, value, value);
+        uint32_t bits;
+        memcpy(&bits, &narrowed, sizeof(bits));
+        writeInteger(location, bits, 4);
+    }
+    
+    void FPU::writeReal64(address location, extended value) {
+        const double narrowed = checked((double) value, value, value);
+        uint64_t bits;
+        memcpy(&bits, &narrowed, sizeof(bits));
+        writeInteger(location, bits, 8);
+    }
+    
+    extended FPU::readReal80(address location) {
+        const uint64_t significand = readInteger(location, 8);
+        const word signAndExponent = (word) readInteger(location + 8, 2);
+        #ifdef HOST_EXTENDED
+        extended value = 0;
+        memcpy(&value, &significand, 8);
+        memcpy((byte *) &value + 8, &signAndExponent, 2);
+        return value;
+        #else
+        const int exponent = signAndExponent & 0x7FFF;
+        extended value;
+        if (exponent == 0x7FFF) {
+            value = (significand << 1) == 0 ? numeric_limits<extended>::infinity() : numeric_limits<extended>::quiet_NaN();
+        } else {
+            value = ldexpl((extended) significand, (exponent == 0 ? 1 : exponent) - 16383 - 63);
+        }
+        return (signAndExponent & 0x8000) ? -value : value;
+        #endif
+    }
+    
+    void FPU::writeReal80(address location, extended value) {
+        uint64_t significand;
+        word signAndExponent;
+        #ifdef HOST_EXTENDED
+        memcpy(&significand, &value, 8);
+        memcpy(&signAndExponent, (byte *) &value + 8, 2);
+        #else
+        signAndExponent = signbit(value) ? 0x8000 : 0;
+        if (isnan(value)) {
+            signAndExponent |= 0x7FFF;
+            significand = 0xC000000000000000;
+        } else if (isinf(value)) {
+            signAndExponent |= 0x7FFF;
+            significand = 0x8000000000000000;
+        } else if (value == 0) {
+            significand = 0;
+        } else {
+            int exponent;
+            const extended fraction = frexpl(fabsl(value), &exponent);
+            significand = (uint64_t) ldexpl(fraction, 64);
+            signAndExponent |= (word) (exponent - 1 + 16383);
+        }
+        #endif
+        writeInteger(location, significand, 8);
+        writeInteger(location + 8, signAndExponent, 2);
+    }
+    
+    // FIST and FISTP, storing the integer indefinite if it doesn't fit
+    void FPU::storeInteger(address location, extended value, int size) {
+        const extended rounded = roundToInteger(value);
+        const extended limit = ldexpl(1, size * 8 - 1);
+        if (!(rounded >= -limit && rounded < limit)) {
+            raise(FPU_INVALID);
+            writeInteger(location, 1ULL << (size * 8 - 1), size);
+            return;
+        }
+        writeInteger(location, (uint64_t) (int64_t) rounded, size);
+    }
+    
+    // 18 packed decimal digits, then a sign byte
+    extended FPU::readBCD(address location) {
+        extended value = 0;
+        for (int i = 8; i >= 0; i--) {
+            const byte digits = memory.readByte(location + i);
+            value = value * 100 + (digits >> 4) * 10 + (digits & 0x0F);
+        }
+        return (memory.readByte(location + 9) & 0x80) ? -value : value;
+    }
+    
+    void FPU::writeBCD(address location, extended value) {
+        const extended rounded = roundToInteger(value);
+        if (!(fabsl(rounded) < 1e18L)) { // store the BCD indefinite
+            raise(FPU_INVALID);
+            writeInteger(location, 0xC000000000000000, 8);
+            writeInteger(location + 8, 0xFFFF, 2);
+            return;
+        }
+        uint64_t magnitude = (uint64_t) fabsl(rounded);
+        for (int i = 0; i < 9; i++) {
+            const byte low = magnitude % 10;
+            magnitude /= 10;
+            const byte high = magnitude % 10;
+            magnitude /= 10;
+            memory.setByte(location + i, (high << 4) | low);
+        }
+        memory.setByte(location + 9, signbit(rounded) ? 0x80 : 0);
+    }
+    
+    word FPU::tagWord() {
+        word bits = 0;
+        for (int i = 7; i >= 0; i--) {
+            bits = (bits << 2) | tags[i];
+        }
+        return bits;
+    }
+    
+    // The real mode layout: control, status and tag words, then the last
+    // instruction's 20 bit address and opcode, then its operand's address
+    void FPU::storeEnvironment(address location) {
+        writeInteger(location, control, 2);
+        writeInteger(location + 2, (status & ~0x3800) | (top << 11), 2);
+        writeInteger(location + 4, tagWord(), 2);
+        writeInteger(location + 6, lastInstruction & 0xFFFF, 2);
+        writeInteger(location + 8, ((lastInstruction >> 4) & 0xF000) | (lastOpcode & 0x07FF), 2);
+        writeInteger(location + 10, lastOperand & 0xFFFF, 2);
+        writeInteger(location + 12, (lastOperand >> 4) & 0xF000, 2);
+    }
+    
+    void FPU::loadEnvironment(address location) {
+        control = (word) readInteger(location, 2);
+        status = (word) readInteger(location + 2, 2);
+        top = (status >> 11) & 7;
+        const word tagBits = (word) readInteger(location + 4, 2);
+        for (int i = 0; i < 8; i++) {
+            tags[i] = (tagBits >> (i * 2)) & 3;
+        }
+        const word instructionHigh = (word) readInteger(location + 8, 2);
+        lastInstruction = readInteger(location + 6, 2) | ((address) (instructionHigh & 0xF000) << 4);
+        lastOpcode = instructionHigh & 0x07FF;
+        lastOperand = readInteger(location + 10, 2) | ((address) (readInteger(location + 12, 2) & 0xF000) << 4);
+    }
+}
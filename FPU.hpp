@@ -0,0 +1,135 @@
+//
+//  FPU.hpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// implement the intel 8087
+// Values are kept as host long doubles. On x86 hosts those are the same 80 bit
+// extended format as the 8087's own registers; where long double is only a
+// double (MSVC, ARM) results are correctly rounded to 53 bits instead, as if
+// precision control were always set to double.
+// Exceptions set their status bits and give the 8087's masked responses;
+// unmasked ones also set the interrupt request bit, but on the PC that goes
+// to the NMI, which isn't emulated.
+
+#ifndef FPU_hpp
+#define FPU_hpp
+
+#include <cfloat>
+#include "Types.h"
+#include "Memory.hpp"
+
+#if LDBL_MANT_DIG == 64 && (defined(__x86_64__) || defined(__i386__))
+#define HOST_EXTENDED // long double is laid out just like an 8087 register in memory
+#endif
+
+namespace DK86PC {
+
+    typedef long double extended;
+    
+    // status word bits
+    #define FPU_INVALID 0x0001
+    #define FPU_DENORMAL 0x0002
+    #define FPU_ZERO_DIVIDE 0x0004
+    #define FPU_OVERFLOW 0x0008
+    #define FPU_UNDERFLOW 0x0010
+    #define FPU_PRECISION 0x0020
+    #define FPU_INTERRUPT_REQUEST 0x0080
+    #define FPU_C0 0x0100
+    #define FPU_C1 0x0200
+    #define FPU_C2 0x0400
+    #define FPU_C3 0x4000
+    #define FPU_CONDITION (FPU_C0 | FPU_C1 | FPU_C2 | FPU_C3)
+    
+    // tag word values, 2 bits per register
+    enum FPUTag : byte {
+        TAG_VALID = 0,
+        TAG_ZERO = 1,
+        TAG_SPECIAL = 2, // NaN, infinity or denormal
+        TAG_EMPTY = 3
+    };
+    
+    class FPU {
+    public:
+        FPU(Memory &mem) : memory(mem) {
+            reset();
+        };
+        // FINIT
+        void reset();
+        // An ESC (D8-DF) instruction with its ModRM byte; operand is the physical
+        // address of its memory operand, or NO_FPU_OPERAND for a register form.
+        // instruction is where it is, for FSTENV and FSAVE.
+        void execute(byte opcode, byte modrm, address operand, address instruction);
+        static constexpr address NO_FPU_OPERAND = 0xFFFFFFFF;
+    private:
+        // Register stack
+        extended &st(int i) {
+            return registers[(top + i) & 7];
+        };
+        byte &tag(int i) {
+            return tags[(top + i) & 7];
+        };
+        extended read(int i);
+        void write(int i, extended value);
+        void push(extended value);
+        void pop();
+        
+        // Exceptions and flags
+        void raise(word exceptions);
+        void setCondition(word condition) {
+            status = (status & ~FPU_CONDITION) | condition;
+        };
+        extended checked(extended result, extended a, extended b, bool division = false);
+        void compare(extended a, extended b);
+        void examine();
+        extended roundToInteger(extended value);
+        
+        // Groups of instructions
+        void arithmetic(byte operation, int destination, extended source);
+        void registerEscape(byte opcode, byte reg, byte rm);
+        void memoryEscape(byte opcode, byte reg, address operand);
+        void constantsAndFunctions(byte reg, byte rm);
+        
+        // Memory operands
+        uint64_t readInteger(address location, int size);
+        void writeInteger(address location, uint64_t value, int size);
+        extended readReal32(address location);
+        extended readReal64(address location);
+        extended readReal80(address location);
+        void writeReal32(address location, extended value);
+        void writeReal64(address location, extended value);
+        void writeReal80(address location, extended value);
+        void storeInteger(address location, extended value, int size);
+        extended readBCD(address location);
+        void writeBCD(address location, extended value);
+        void storeEnvironment(address location);
+        void loadEnvironment(address location);
+        word tagWord();
+        
+        Memory &memory;
+        extended registers[8];
+        byte tags[8];
+        byte top;
+        word control;
+        word status;
+        address lastInstruction;
+        word lastOpcode; // low 11 bits of the opcode and ModRM
+        address lastOperand;
+    };
+}
+
+#endif /* FPU_hpp */
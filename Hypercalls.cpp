@@ -0,0 +1,127 @@
+//
+//  Hypercalls.cpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Hypercalls.hpp"
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+namespace DK86PC {
+    
+    Hypercalls::Hypercalls(string directory) : directory(directory) {
+        services[0x00] = [](HypercallRegisters &registers, Memory &memory) {
+            registers.ax = HYPERCALL_SIGNATURE;
+            return true;
+        };
+        services[0x01] = [this](HypercallRegisters &registers, Memory &memory) {
+            return exportFile(registers, memory);
+        };
+        services[0x02] = [this](HypercallRegisters &registers, Memory &memory) {
+            return importFile(registers, memory);
+        };
+        services[0x03] = [this](HypercallRegisters &registers, Memory &memory) {
+            return clock(registers);
+        };
+        services[0x04] = [this](HypercallRegisters &registers, Memory &memory) {
+            exiting = true;
+            status = lowByte(registers.ax);
+            return true;
+        };
+    }
+    
+    void Hypercalls::setService(byte number, Service service) {
+        services[number] = service;
+    }
+    
+    void Hypercalls::call(HypercallRegisters &registers, Memory &memory) {
+        const Service &service = services[highByte(registers.ax)];
+        registers.carry = !service || !service(registers, memory);
+    }
+    
+    // Where DS:SI for CX bytes is, if it's all in one piece
+    static bool buffer(const HypercallRegisters &registers, address &location) {
+        location = (((address) registers.ds) << 4) + registers.si;
+        return (address) registers.si + registers.cx <= 0x10000 && location + registers.cx <= 0x100000;
+    }
+    
+    // The host path of the file named at ES:DI, which has to be a plain
+    // name in the hypercall directory, not a path out of it
+    bool Hypercalls::fileName(const HypercallRegisters &registers, Memory &memory, string &path) {
+        string name;
+        for (word i = 0; i < MAX_HYPERCALL_FILENAME; i++) {
+            const byte c = memory.readByte((((address) registers.es) << 4) + (word) (registers.di + i));
+            if (c == 0) {
+                if (name.empty() || name[0] == '.') {
+                    return false;
+                }
+                path = directory + "/" + name;
+                return true;
+            }
+            if (c == '/' || c == '\\' || c == ':') {
+                return false;
+            }
+            name += (char) c;
+        }
+        return false;
+    }
+    
+    bool Hypercalls::exportFile(HypercallRegisters &registers, Memory &memory) {
+        string path;
+        address location;
+        if (!fileName(registers, memory, path) || !buffer(registers, location) || !memory.isReadable(location, registers.cx)) {
+            return false;
+        }
+        ofstream output(path, ios::out | ios::binary | ios::trunc);
+        if (!output.is_open()) {
+            return false;
+        }
+        output.write((const char *) memory.readBlock(location), registers.cx);
+        registers.ax = output.good() ? registers.cx : 0;
+        return output.good();
+    }
+    
+    bool Hypercalls::importFile(HypercallRegisters &registers, Memory &memory) {
+        string path;
+        address location;
+        if (!fileName(registers, memory, path) || !buffer(registers, location)) {
+            return false;
+        }
+        ifstream input(path, ios::in | ios::binary);
+        if (!input.is_open()) {
+            return false;
+        }
+        vector<byte> data(registers.cx);
+        input.read((char *) data.data(), registers.cx);
+        const address length = (address) input.gcount();
+        memory.writeBlock(location, data.data(), length);
+        registers.ax = (word) length;
+        return true;
+    }
+    
+    bool Hypercalls::clock(HypercallRegisters &registers) {
+        const uint64_t now = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        registers.ax = now & 0xFFFF;
+        registers.bx = (now >> 16) & 0xFFFF;
+        registers.cx = (now >> 32) & 0xFFFF;
+        registers.dx = (now >> 48) & 0xFFFF;
+        return true;
+    }
+}
@@ -0,0 +1,78 @@
+//
+//  Hypercalls.hpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Opt-in services guest programs can call straight into the host for.
+// Opcode F1, which the 8086 doesn't use, calls the service numbered in AH;
+// without a Hypercalls attached to the CPU it's an unknown opcode as before.
+// Every service sets CF on failure and clears it on success.
+//
+//   AH=00 detect: AX = 444Bh ("DK")
+//   AH=01 export: write CX bytes at DS:SI to the host file named by the
+//         ASCIIZ string at ES:DI; AX = bytes written
+//   AH=02 import: read up to CX bytes of the host file named at ES:DI
+//         into DS:SI; AX = bytes read
+//   AH=03 clock: host monotonic clock in microseconds, in DX:CX:BX:AX
+//   AH=04 exit: stop the emulator, with AL as its exit status
+//
+// Files are only looked for in the directory given to the constructor, and
+// buffers may not wrap around their segment.
+
+#ifndef Hypercalls_hpp
+#define Hypercalls_hpp
+
+#include <functional>
+#include <string>
+#include "Memory.hpp"
+#include "Types.h"
+
+using namespace std;
+
+namespace DK86PC {
+
+    #define HYPERCALL_SIGNATURE 0x444B
+    #define MAX_HYPERCALL_FILENAME 64
+
+    // The guest registers a service gets and can change
+    struct HypercallRegisters {
+        word ax, bx, cx, dx, si, di, ds, es;
+        bool carry;
+    };
+
+    class Hypercalls {
+    public:
+        // services return whether they succeeded, which sets CF
+        typedef function<bool(HypercallRegisters &registers, Memory &memory)> Service;
+        Hypercalls(string directory);
+        void setService(byte number, Service service);
+        void call(HypercallRegisters &registers, Memory &memory);
+        bool exitRequested() { return exiting; };
+        int exitStatus() { return status; };
+    private:
+        bool exportFile(HypercallRegisters &registers, Memory &memory);
+        bool importFile(HypercallRegisters &registers, Memory &memory);
+        bool clock(HypercallRegisters &registers);
+        bool fileName(const HypercallRegisters &registers, Memory &memory, string &path);
+        string directory;
+        Service services[256];
+        bool exiting = false;
+        int status = 0;
+    };
+}
+
+#endif /* Hypercalls_hpp */
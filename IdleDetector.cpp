@@ -0,0 +1,53 @@
+//
+//  IdleDetector.cpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "IdleDetector.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace DK86PC {
+
+    bool IdleDetector::update(const CPU &cpu, const Memory &memory, bool portsChanged) {
+        if (since == NO_IDLE || portsChanged || memory.writes() != writes
+            || memcmp(cpu.registers, registers, sizeof(registers)) != 0
+            || memcmp(cpu.segments, segments, sizeof(segments)) != 0) {
+            restart(cpu, memory);
+            return false;
+        }
+        lowIP = min(lowIP, cpu.ip);
+        highIP = max(highIP, cpu.ip);
+        if (highIP - lowIP > IDLE_LOOP_BYTES) {
+            restart(cpu, memory);
+            return false;
+        }
+        return cpu.cycleCount - since >= IDLE_CYCLES;
+    }
+    
+    void IdleDetector::restart(const CPU &cpu, const Memory &memory) {
+        since = cpu.cycleCount;
+        writes = memory.writes();
+        memcpy(registers, cpu.registers, sizeof(registers));
+        memcpy(segments, cpu.segments, sizeof(segments));
+        lowIP = cpu.ip;
+        highIP = cpu.ip;
+    }
+
+}
@@ -0,0 +1,57 @@
+//
+//  IdleDetector.hpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Spots the guest polling for something to happen, like the BIOS waiting in
+// INT 16h for a key: the CPU going round a small loop that writes nothing,
+// leaves the registers alone (other than the flags) and only reads ports
+// that keep giving the same value. Then PC::runLoop can let the host sleep.
+
+#ifndef IdleDetector_hpp
+#define IdleDetector_hpp
+
+#include "Types.h"
+#include "CPU.hpp"
+#include "Memory.hpp"
+
+// most bytes of code a polling loop spans
+#define IDLE_LOOP_BYTES 32
+// how long it has to poll for before it counts as idle, about 1 ms
+#define IDLE_CYCLES 4096
+
+namespace DK86PC {
+    class IdleDetector {
+    public:
+        // Call after each batch the CPU runs, with whether a port read gave a
+        // new value during it; true once the guest has been polling long enough
+        bool update(const CPU &cpu, const Memory &memory, bool portsChanged);
+        void reset() {
+            since = NO_IDLE;
+        };
+    private:
+        static constexpr uint64_t NO_IDLE = UINT64_MAX;
+        void restart(const CPU &cpu, const Memory &memory);
+        uint64_t since = NO_IDLE; // cycle count polling started at
+        uint64_t writes;
+        word registers[8];
+        word segments[4];
+        word lowIP, highIP;
+    };
+}
+
+#endif /* IdleDetector_hpp */
@@ -114,22 +114,22 @@ namespace DK86PC {
     { 0x5D, "POP" },
     { 0x5E, "POP" },
     { 0x5F, "POP" },
-    { 0x60, "--" },
-    { 0x61, "--" },
-    { 0x62, "--" },
-    { 0x63, "--" },
-    { 0x64, "--" },
-    { 0x65, "--" },
-    { 0x66, "--" },
-    { 0x67, "--" },
-    { 0x68, "--" },
-    { 0x69, "--" },
-    { 0x6A, "--" },
-    { 0x6B, "--" },
-    { 0x6C, "--" },
-    { 0x6D, "--" },
-    { 0x6E, "--" },
-    { 0x6F, "--" },
+    { 0x60, "JO" },
+    { 0x61, "JNO" },
+    { 0x62, "JB" },
+    { 0x63, "JNB" },
+    { 0x64, "JZ" },
+    { 0x65, "JNZ" },
+    { 0x66, "JBE" },
+    { 0x67, "JA" },
+    { 0x68, "JS" },
+    { 0x69, "JNS" },
+    { 0x6A, "JPE" },
+    { 0x6B, "JPO" },
+    { 0x6C, "JL" },
+    { 0x6D, "JGE" },
+    { 0x6E, "JLE" },
+    { 0x6F, "JG" },
     { 0x70, "JO" },
     { 0x71, "JNO" },
     { 0x72, "JB" },
@@ -234,14 +234,14 @@ namespace DK86PC {
     { 0xD5, "AAD" },
     { 0xD6, "--" },
     { 0xD7, "XLAT" },
-    { 0xD8, "--" },
-    { 0xD9, "--" },
-    { 0xDA, "--" },
-    { 0xDB, "--" },
-    { 0xDC, "--" },
-    { 0xDD, "--" },
-    { 0xDE, "--" },
-    { 0xDF, "--" },
+    { 0xD8, "ESC" },
+    { 0xD9, "ESC" },
+    { 0xDA, "ESC" },
+    { 0xDB, "ESC" },
+    { 0xDC, "ESC" },
+    { 0xDD, "ESC" },
+    { 0xDE, "ESC" },
+    { 0xDF, "ESC" },
     { 0xE0, "LOOPNZ" },
     { 0xE1, "LOOPZ" },
     { 0xE2, "LOOP" },
@@ -259,7 +259,7 @@ namespace DK86PC {
     { 0xEE, "OUT" },
     { 0xEF, "OUT" },
     { 0xF0, "LOCK" },
-    { 0xF1, "--" },
+    { 0xF1, "HCALL" },
     { 0xF2, "REPNZ" },
     { 0xF3, "REPZ" },
     { 0xF4, "HLT" },
@@ -19,57 +19,306 @@
 
 #include "Memory.hpp"
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
 namespace DK86PC {
     
+    // The 1 MB behind every page, zeroed, in shared memory if there's a name.
+    // Otherwise calloc gets it straight from the OS as untouched zero pages,
+    // so the parts the guest never uses (like above its RAM) cost nothing.
+    void Memory::allocate(const string &name, bool replace) {
+        if (!name.empty()) {
+            #ifndef _WIN32
+            if (replace) {
+                shm_unlink(name.c_str());
+            }
+            const int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (descriptor == -1 && errno == EEXIST) {
+                cerr << "Couldn't share memory as " << name << ": another instance has it, or one that crashed left it behind" << endl;
+                ram = (byte *) calloc(ADDRESS_MASK + 1, 1);
+                return;
+            }
+            if (descriptor != -1 && ftruncate(descriptor, ADDRESS_MASK + 1) == 0) {
+                void *shared = mmap(nullptr, ADDRESS_MASK + 1, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+                if (shared != MAP_FAILED) {
+                    ram = (byte *) shared;
+                    sharedName = name;
+                    sharedDescriptor = descriptor;
+                    return;
+                }
+            }
+            cerr << "Couldn't share memory as " << name << ": " << strerror(errno) << endl;
+            if (descriptor != -1) {
+                close(descriptor);
+                shm_unlink(name.c_str());
+            }
+            #else
+            cerr << "Shared memory isn't supported on Windows" << endl;
+            #endif
+        }
+        ram = (byte *) calloc(ADDRESS_MASK + 1, 1);
+    }
+    
+    void Memory::release() {
+        #ifndef _WIN32
+        for (const pair<void *, address> &file : romFiles) {
+            munmap(file.first, file.second);
+        }
+        if (sharedDescriptor != -1) {
+            munmap(ram, ADDRESS_MASK + 1);
+            // only unlink the name if something else hasn't replaced it since
+            struct stat ours, named;
+            const int current = shm_open(sharedName.c_str(), O_RDONLY, 0);
+            if (current != -1) {
+                if (fstat(sharedDescriptor, &ours) == 0 && fstat(current, &named) == 0 &&
+                    ours.st_dev == named.st_dev && ours.st_ino == named.st_ino) {
+                    shm_unlink(sharedName.c_str());
+                }
+                close(current);
+            }
+            close(sharedDescriptor);
+            return;
+        }
+        #endif
+        free(ram);
+    }
+    
+    inline void Memory::invalidateBlock(address location, address length) {
+        for (address place = location; place < location + length; place += (1 << CODE_PAGE_SHIFT)) {
+            invalidateCode(place);
+        }
+        invalidateCode(location + length - 1);
+    }
+    
     void Memory::loadData(vector<byte> &data, address location) {
         copy(data.begin(), data.end(), ram + location);
+        writeCount++;
+        invalidateBlock(location, (address) data.size());
     }
     
-    byte Memory::readByte(address location) {
-#ifdef DEBUG
-        if (watchLocations.find(location) != watchLocations.end()) {
-            cout << "read byte "  << hex << uppercase <<  (int) ((byte) ram[location]) << dec << " from " << location << endl;
+    void Memory::mapRAM(address location, address length) {
+        for (address page = location >> PAGE_SHIFT; page < (location + length + PAGE_MASK) >> PAGE_SHIFT && page < NUM_PAGES; page++) {
+            readPages[page] = ram + (page << PAGE_SHIFT);
+            writePages[page] = ram + (page << PAGE_SHIFT);
+            handlers[page] = nullptr;
         }
-#endif
-        return ram[location];
     }
     
-    word Memory::readWord(address location) {
-#ifdef DEBUG
-        if (watchLocations.find(location) != watchLocations.end()) {
-            cout << "read word " << hex << uppercase << (int) ((((word)ram[location + 1]) << 8) | ram[location]) << dec << " from " << location << endl;
+    void Memory::mapROM(address location, address length) {
+        for (address page = location >> PAGE_SHIFT; page < (location + length + PAGE_MASK) >> PAGE_SHIFT && page < NUM_PAGES; page++) {
+            readPages[page] = ram + (page << PAGE_SHIFT);
+            writePages[page] = nullptr;
+            handlers[page] = &openBus; // for the writes
         }
-#endif
-        return (((word)ram[location + 1]) << 8) | ram[location];
     }
     
-    void Memory::setByte(address location, byte data) {
-#ifdef DEBUG
-        if (watchLocations.find(location) != watchLocations.end()) {
-            cout << "wrote byte "  << hex << uppercase << (int) data << dec << " to " << location << endl;
+    void Memory::mapHandler(address location, address length, MemoryHandler *handler) {
+        for (address page = location >> PAGE_SHIFT; page < (location + length + PAGE_MASK) >> PAGE_SHIFT && page < NUM_PAGES; page++) {
+            readPages[page] = nullptr;
+            writePages[page] = nullptr;
+            handlers[page] = handler;
         }
-#endif
-        ram[location] = data;
     }
     
-    void Memory::setWord(address location, word data) {
-        #ifdef DEBUG
-                if (watchLocations.find(location) != watchLocations.end()) {
-                    cout << "wrote word "  << hex << uppercase << (int) data << dec << " to " << location << endl;
+    // every page of the run goes straight to memory, one page right after another
+    bool Memory::isMapped(const byte * const *pages, address location, address length) {
+        if (length == 0) {
+            return true;
+        }
+        if (location + length > 0x100000) {
+            return false;
+        }
+        const address first = location >> PAGE_SHIFT;
+        if (pages[first] == nullptr) {
+            return false;
+        }
+        for (address page = first + 1; page <= (location + length - 1) >> PAGE_SHIFT; page++) {
+            if (pages[page] != pages[first] + ((page - first) << PAGE_SHIFT)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // from and to must not overlap
+    void Memory::copyBlock(address to, address from, address length) {
+        if (observer != nullptr) {
+            observer->memoryBlockWrite(to, length);
+        }
+        writeCount++;
+        invalidateBlock(to, length);
+        memcpy(writeBlockAt(to), readBlock(from), length);
+    }
+    
+    // fill with low/high byte pairs, starting with low at to
+    void Memory::fillBlock(address to, address length, byte low, byte high) {
+        if (observer != nullptr) {
+            observer->memoryBlockWrite(to, length);
+        }
+        writeCount++;
+        invalidateBlock(to, length);
+        byte *block = writeBlockAt(to);
+        if (low == high) {
+            memset(block, low, length);
+            return;
+        }
+        for (address place = 0; place < length; place += 2) {
+            block[place] = low;
+            block[place + 1] = high;
+        }
+    }
+    
+    void Memory::writeBlock(address to, const byte *from, address length) {
+        if (length == 0) {
+            return;
+        }
+        if (observer != nullptr) {
+            observer->memoryBlockWrite(to, length);
+        }
+        writeCount++;
+        if (!isWritable(to, length) || isWatched(to, length, WATCH_WRITE)) {
+            for (address i = 0; i < length; i++) {
+                const address place = (to + i) & ADDRESS_MASK;
+                if (watchPages[place >> PAGE_SHIFT] & WATCH_WRITE) {
+                    checkWatch(WATCH_WRITE, place, from[i], false);
                 }
-        #endif
-        ram[location] = lowByte(data);
-        ram[location + 1] = highByte(data);
+                poke(place, from[i]);
+            }
+            return;
+        }
+        invalidateBlock(to, length);
+        memcpy(writeBlockAt(to), from, length);
+    }
+    
+    uint32_t Memory::checksum(address location, address length) {
+        uint32_t hash = 0x811C9DC5;
+        for (address place = location; place < location + length; place++) {
+            hash = (hash ^ peek(place)) * 0x01000193;
+        }
+        return hash;
+    }
+    
+    void Memory::watch(address location, address length, byte kinds) {
+        for (address i = 0; i < length; i++) {
+            const address place = (location + i) & ADDRESS_MASK;
+            vector<byte> &map = watchMaps[place >> PAGE_SHIFT];
+            if (map.empty()) {
+                map.resize(1 << PAGE_SHIFT);
+            }
+            map[place & PAGE_MASK] |= kinds;
+        }
+        for (address page = location >> PAGE_SHIFT; page <= (location + length) >> PAGE_SHIFT; page++) {
+            updateWatchPage(page & (NUM_PAGES - 1));
+            updateWatchPage((page - 1) & (NUM_PAGES - 1));
+        }
+    }
+    
+    void Memory::unwatch(address location, address length, byte kinds) {
+        for (address i = 0; i < length; i++) {
+            const address place = (location + i) & ADDRESS_MASK;
+            vector<byte> &map = watchMaps[place >> PAGE_SHIFT];
+            if (!map.empty()) {
+                map[place & PAGE_MASK] &= ~kinds;
+            }
+        }
+        for (address page = location >> PAGE_SHIFT; page <= (location + length) >> PAGE_SHIFT; page++) {
+            updateWatchPage(page & (NUM_PAGES - 1));
+            updateWatchPage((page - 1) & (NUM_PAGES - 1));
+        }
+    }
+    
+    // Recompute a page's flags from its map, dropping the map once nothing's left in it
+    void Memory::updateWatchPage(address page) {
+        vector<byte> &map = watchMaps[page];
+        byte kinds = 0;
+        for (byte watched : map) {
+            kinds |= watched;
+        }
+        if (kinds == 0) {
+            map.clear();
+            map.shrink_to_fit();
+        }
+        const vector<byte> &next = watchMaps[(page + 1) & (NUM_PAGES - 1)];
+        if (!next.empty()) {
+            kinds |= next[0] & (WATCH_READ | WATCH_WRITE);
+        }
+        if ((watchPages[page] & WATCH_EXECUTE) && !(kinds & WATCH_EXECUTE)) {
+            breakpointPages--;
+        } else if (!(watchPages[page] & WATCH_EXECUTE) && (kinds & WATCH_EXECUTE)) {
+            breakpointPages++;
+        }
+        watchPages[page] = kinds | (watchPages[page] & WATCH_OBSERVED);
+    }
+    
+    bool Memory::isWatched(address location, address length, WatchKind kind) {
+        for (address page = location >> PAGE_SHIFT; page <= (location + length) >> PAGE_SHIFT && page < NUM_PAGES; page++) {
+            if (watchPages[page] & kind) {
+                return true;
+            }
+        }
+        return false;
     }
     
-    byte& Memory::readByteRef(address location) {
-        return ram[location];
+    // The page says something might be watched, so look at the byte(s)
+    void Memory::setObserver(Observer *o) {
+        observer = o;
+        for (address page = 0; page < NUM_PAGES; page++) {
+            if (observer != nullptr) {
+                watchPages[page] |= WATCH_OBSERVED;
+            } else {
+                watchPages[page] &= ~WATCH_OBSERVED;
+            }
+        }
+    }
+    // a read or write to a page with a watch of kind or an observer
+    void Memory::accessed(WatchKind kind, address location, word value, bool wide) {
+        if (watchPages[location >> PAGE_SHIFT] & kind) {
+            checkWatch(kind, location, value, wide);
+        }
+        if (observer == nullptr) {
+            return;
+        }
+        if (kind == WATCH_READ) {
+            observer->memoryRead(location, value, wide);
+        } else {
+            observer->memoryWrite(location, value, wide);
+        }
+    }
+    void Memory::checkWatch(WatchKind kind, address location, word value, bool wide) {
+        for (address i = 0; i < (wide ? 2 : 1); i++) {
+            const address place = (location + i) & ADDRESS_MASK;
+            const vector<byte> &map = watchMaps[place >> PAGE_SHIFT];
+            if (!map.empty() && (map[place & PAGE_MASK] & kind)) {
+                lastHit = { kind, place, value, wide };
+                hitCount++;
+                if (watchListener != nullptr) {
+                    watchListener->hit(lastHit);
+                }
+                return;
+            }
+        }
+    }
+    
+    void WatchPrinter::hit(const WatchHit &hit) {
+        if (hit.kind == WATCH_EXECUTE) {
+            cout << "executing at " << hex << uppercase << hit.location << dec << endl;
+            return;
+        }
+        cout << ((hit.kind == WATCH_READ) ? "read " : "wrote ") << (hit.wide ? "word " : "byte ") << hex << uppercase << (int) hit.value
+            << ((hit.kind == WATCH_READ) ? " from " : " to ") << hit.location << dec << endl;
     }
 
     static vector<byte> loadFile(string filename) {
@@ -87,6 +336,51 @@ namespace DK86PC {
         return buffer;
     }
 
+    // Map a ROM's file in read only, straight out of the OS's cache of it, so
+    // every process running that ROM shares the one copy. It has to be
+    // exactly length bytes at a page boundary, and the memory not shared
+    // (there the ROMs are copied in so other processes see them).
+    bool Memory::mapROMFile(const string &filename, address location, address length) {
+        #ifndef _WIN32
+        if (sharedDescriptor != -1 || length == 0 || (location & PAGE_MASK) != 0 || (length & PAGE_MASK) != 0 || location + length > 0x100000) {
+            return false;
+        }
+        const int descriptor = open(filename.c_str(), O_RDONLY);
+        if (descriptor == -1) {
+            return false;
+        }
+        struct stat file;
+        void *image = MAP_FAILED;
+        if (fstat(descriptor, &file) == 0 && file.st_size == (off_t) length) {
+            image = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        }
+        close(descriptor);
+        if (image == MAP_FAILED) {
+            return false;
+        }
+        romFiles.push_back({image, length});
+        for (address page = location >> PAGE_SHIFT; page < (location + length) >> PAGE_SHIFT; page++) {
+            readPages[page] = (const byte *) image + ((page << PAGE_SHIFT) - location);
+            writePages[page] = nullptr;
+            handlers[page] = &openBus; // for the writes
+        }
+        writeCount++;
+        invalidateBlock(location, length);
+        return true;
+        #else
+        return false;
+        #endif
+    }
+    
+    // Any other ROM is copied into the memory behind it
+    void Memory::loadROM(const string &filename, vector<byte> &data, address location) {
+        if (mapROMFile(filename, location, (address) data.size())) {
+            return;
+        }
+        loadData(data, location);
+        mapROM(location, (address) data.size());
+    }
+    
     // On the original PC BIOS exists from 0xE0000 to 0xFFFFF
     // so implicitly must be <= 128k
     void Memory::loadBIOS(string filename) {
@@ -94,18 +388,17 @@ namespace DK86PC {
         vector<byte> buffer = loadFile(filename);
         // in original IBM PC BIOS is right before end of 1 MB of memory
         address biosPlace = 0x100000 - (address) buffer.size();
-        loadData(buffer, biosPlace);
+        loadROM(filename, buffer, biosPlace);
     }
 
+    // each of the four 8K chips, one after another from 0xF6000
     void Memory::loadCasetteBASIC(string filename1, string filename2, string filename3, string filename4) {
-        vector<byte> buffer1 = loadFile(filename1);
-        loadData(buffer1, 0xF6000);
-        vector<byte> buffer2 = loadFile(filename2);
-        loadData(buffer2, 0xF8000);
-        vector<byte> buffer3 = loadFile(filename3);
-        loadData(buffer3, 0xFA000);
-        vector<byte> buffer4 = loadFile(filename4);
-        loadData(buffer4, 0xFC000);
+        const string filenames[] = {filename1, filename2, filename3, filename4};
+        for (int chip = 0; chip < 4; chip++) {
+            vector<byte> buffer = loadFile(filenames[chip]);
+            buffer.resize(0x2000);
+            loadROM(filenames[chip], buffer, 0xF6000 + chip * 0x2000);
+        }
     }
     
 }
@@ -20,44 +20,254 @@
 #ifndef Memory_hpp
 #define Memory_hpp
 
+#include <cstring>
+#include <string>
+#include <utility>
 #include <vector>
 #include "Types.h"
-#ifdef DEBUG
-#include <set>
-#endif
+#include "Observer.hpp"
 
 using namespace std;
 
 namespace DK86PC {
 
+    #define CODE_PAGE_SHIFT 12 // 4K pages for tracking writes to code
+    #define NUM_CODE_PAGES (1048576 >> CODE_PAGE_SHIFT)
+    #define FETCH_WINDOW 8 // bytes of code the CPU decodes from at once
+    #define PAGE_SHIFT 12 // 4K pages in the memory map
+    #define NUM_PAGES (1048576 >> PAGE_SHIFT)
+    #define PAGE_MASK ((1 << PAGE_SHIFT) - 1)
+    #define ADDRESS_MASK 0xFFFFF // 20 bit addresses, which wrap around at 1 MB
+    #define WATCH_OBSERVED 0x80 // not a WatchKind: on every page while there's an observer
+
+    // Takes the accesses to pages of the memory map that aren't just RAM or ROM
+    class MemoryHandler {
+    public:
+        virtual ~MemoryHandler() {}
+        virtual byte read(address location) = 0;
+        virtual void write(address location, byte data) = 0;
+    };
+    
+    // Where nothing answers: reads float high and writes go nowhere
+    class OpenBus : public MemoryHandler {
+    public:
+        byte read(address location) override {
+            return 0xFF;
+        }
+        void write(address location, byte data) override {}
+    };
+
     class Memory {
     public:
-        Memory(unsigned int ramSize = 1048576) {
-            ram = new byte[ramSize]();
-            
+        // ramSize bytes of RAM from 0, rounded up to whole pages, and open bus above.
+        // Given a sharedName (like "/dk86pc"), the whole 1 MB lives in a POSIX shared
+        // memory object of that name, which other processes can map read only to
+        // look at the running machine without copying anything out of it. If the
+        // name's already taken the memory isn't shared, unless replaceShared says
+        // to unlink whatever has it (like what a crashed run left behind).
+        Memory(unsigned int ramSize = 1048576, const string &sharedName = "", bool replaceShared = false) {
+            allocate(sharedName, replaceShared);
+            mapRAM(0, ramSize);
+            const address ramEnd = (ramSize + PAGE_MASK) & ~PAGE_MASK;
+            mapHandler(ramEnd, 1048576 - ramEnd, &openBus);
         }
         ~Memory() {
-            delete[] ram;
+            release();
         }
+        // the shared memory object, or "" and -1 if the memory isn't shared
+        const string &getSharedName() const {
+            return sharedName;
+        }
+        int getSharedDescriptor() const {
+            return sharedDescriptor;
+        }
+        
+        // The memory map, by whole 4K pages
+        void mapRAM(address location, address length);
+        void mapROM(address location, address length); // reads like RAM, ignores writes
+        void mapHandler(address location, address length, MemoryHandler *handler);
+        // whether a run of memory is all RAM/ROM (and for writing, all RAM)
+        // that the block functions below can go straight to
+        bool isReadable(address location, address length) {
+            return isMapped(readPages, location, length);
+        }
+        bool isWritable(address location, address length) {
+            return isMapped(writePages, location, length);
+        }
+        
         void loadData(vector<byte> &data, address location);
-        byte readByte(address location);
-        word readWord(address location);
-        void setByte(address location, byte data);
-        void setWord(address location, word data);
-        byte& readByteRef(address location);
+        byte readByte(address location) {
+            location &= ADDRESS_MASK;
+            const byte data = peek(location);
+            if (watchPages[location >> PAGE_SHIFT] & (WATCH_READ | WATCH_OBSERVED)) {
+                accessed(WATCH_READ, location, data, false);
+            }
+            return data;
+        }
+        word readWord(address location) {
+            location &= ADDRESS_MASK;
+            const byte *page = readPages[location >> PAGE_SHIFT];
+            word data;
+            if (page != nullptr && (location & PAGE_MASK) != PAGE_MASK) {
+                data = (((word) page[(location & PAGE_MASK) + 1]) << 8) | page[location & PAGE_MASK];
+            } else { // across pages, or off the end of the 1 MB
+                data = (((word) peek((location + 1) & ADDRESS_MASK)) << 8) | peek(location);
+            }
+            if (watchPages[location >> PAGE_SHIFT] & (WATCH_READ | WATCH_OBSERVED)) {
+                accessed(WATCH_READ, location, data, true);
+            }
+            return data;
+        }
+        void setByte(address location, byte data) {
+            location &= ADDRESS_MASK;
+            if (watchPages[location >> PAGE_SHIFT] & (WATCH_WRITE | WATCH_OBSERVED)) {
+                accessed(WATCH_WRITE, location, data, false);
+            }
+            writeCount++;
+            poke(location, data);
+        }
+        void setWord(address location, word data) {
+            location &= ADDRESS_MASK;
+            if (watchPages[location >> PAGE_SHIFT] & (WATCH_WRITE | WATCH_OBSERVED)) {
+                accessed(WATCH_WRITE, location, data, true);
+            }
+            writeCount++;
+            poke(location, lowByte(data));
+            poke((location + 1) & ADDRESS_MASK, highByte(data));
+        }
+        // Whole runs of bytes at once, for REP string instructions;
+        // the caller makes sure they fit in the 1 MB and are isReadable()/isWritable()
+        void copyBlock(address to, address from, address length);
+        void fillBlock(address to, address length, byte low, byte high);
+        const byte *readBlock(address location) { return readPages[location >> PAGE_SHIFT] + (location & PAGE_MASK); };
+        // anywhere, going through the memory map a byte at a time if it has to
+        void writeBlock(address to, const byte *from, address length);
+        // The FETCH_WINDOW bytes of code at location, in one load unless they
+        // cross a page, where they go a byte at a time and wrap around at 1 MB
+        void fetchWindow(address location, byte (&window)[FETCH_WINDOW]) {
+            const byte *page = readPages[(location >> PAGE_SHIFT) & (NUM_PAGES - 1)];
+            if (page != nullptr && (location & PAGE_MASK) <= (1 << PAGE_SHIFT) - FETCH_WINDOW) {
+                memcpy(window, page + (location & PAGE_MASK), FETCH_WINDOW);
+                return;
+            }
+            for (address i = 0; i < FETCH_WINDOW; i++) {
+                window[i] = peek((location + i) & ADDRESS_MASK);
+            }
+        }
          
+        // 32 bit FNV-1a of a run of memory, to recognize ROM images
+        uint32_t checksum(address location, address length);
+        // Load and write protect the ROMs. Where they can be, they're mapped
+        // straight from their files, so however many processes run the same
+        // ROM there's one copy of it in the OS's page cache and none here.
         void loadBIOS(string filename);
         void loadCasetteBASIC(string filename1, string filename2, string filename3, string filename4);
-#ifdef DEBUG
-        void setWatch(address location) {
-            watchLocations.insert(location);
+        
+        // For the CPU's decoded instruction cache: once code has been decoded
+        // out of a page, the next write into that page bumps its version
+        uint32_t codeVersion(address location) {
+            return codeVersions[(location >> CODE_PAGE_SHIFT) & (NUM_CODE_PAGES - 1)];
+        }
+        void markCode(address location) {
+            codePages[(location >> CODE_PAGE_SHIFT) & (NUM_CODE_PAGES - 1)] = true;
+        }
+        // how many writes there have been, to tell if anything changed
+        uint64_t writes() const {
+            return writeCount;
+        }
+        // reads and writes are reported to it, nullptr for none; while there's
+        // one every page is marked WATCH_OBSERVED, so the accesses take the
+        // same out of line path as watchpoints and the rest pay nothing extra
+        void setObserver(Observer *o);
+        
+        // Watchpoints and execution breakpoints on length bytes, kinds being
+        // WatchKinds or'd together. Accesses to pages with nothing watched
+        // pay one predictable branch; the rest look up the byte.
+        void watch(address location, address length, byte kinds);
+        void unwatch(address location, address length, byte kinds);
+        // whether any of a run has a watch of kind, so block accesses go by element
+        bool isWatched(address location, address length, WatchKind kind);
+        bool hasBreakpoints() const {
+            return breakpointPages != 0;
+        }
+        // the CPU's check for a breakpoint as each instruction starts
+        void executing(address location) {
+            location &= ADDRESS_MASK;
+            if (watchPages[location >> PAGE_SHIFT] & WATCH_EXECUTE) {
+                checkWatch(WATCH_EXECUTE, location, 0, false);
+            }
+        }
+        // hits are reported to it, nullptr for none, and can be asked about here
+        void setWatchListener(WatchListener *l) {
+            watchListener = l;
+        }
+        uint64_t watchHits() const {
+            return hitCount;
+        }
+        const WatchHit &lastWatchHit() const {
+            return lastHit;
         }
-#endif
     private:
-        byte *ram;
-#ifdef DEBUG
-        set<address> watchLocations;
-#endif
+        friend class Recompiler; // compiled code goes straight to the page tables
+        void accessed(WatchKind kind, address location, word value, bool wide);
+        void checkWatch(WatchKind kind, address location, word value, bool wide);
+        void updateWatchPage(address page);
+        inline void invalidateCode(address location) {
+            const address page = (location >> CODE_PAGE_SHIFT) & (NUM_CODE_PAGES - 1);
+            if (codePages[page]) {
+                codePages[page] = false;
+                codeVersions[page]++;
+            }
+        }
+        inline void invalidateBlock(address location, address length);
+        // one byte through the memory map, location already wrapped
+        byte peek(address location) {
+            const byte *page = readPages[location >> PAGE_SHIFT];
+            if (page != nullptr) {
+                return page[location & PAGE_MASK];
+            }
+            return handlers[location >> PAGE_SHIFT]->read(location);
+        }
+        void poke(address location, byte data) {
+            byte *page = writePages[location >> PAGE_SHIFT];
+            if (page != nullptr) {
+                invalidateCode(location);
+                page[location & PAGE_MASK] = data;
+                return;
+            }
+            handlers[location >> PAGE_SHIFT]->write(location, data);
+        }
+        bool isMapped(const byte * const *pages, address location, address length);
+        // where a run that isWritable() goes, its pages being one after another
+        byte *writeBlockAt(address location) {
+            return writePages[location >> PAGE_SHIFT] + (location & PAGE_MASK);
+        }
+        bool mapROMFile(const string &filename, address location, address length);
+        void loadROM(const string &filename, vector<byte> &data, address location);
+        void allocate(const string &name, bool replace);
+        void release();
+        byte *ram; // backs all of the RAM pages, at the same addresses, and only takes up memory where touched
+        vector<pair<void *, address>> romFiles; // the ROM files mapped in, and their lengths
+        string sharedName;
+        int sharedDescriptor = -1;
+        // per page, where to read and write directly, or nullptr to go to its handler
+        const byte *readPages[NUM_PAGES] = {};
+        byte *writePages[NUM_PAGES] = {};
+        MemoryHandler *handlers[NUM_PAGES] = {};
+        OpenBus openBus;
+        bool codePages[NUM_CODE_PAGES] = {};
+        uint32_t codeVersions[NUM_CODE_PAGES] = {};
+        Observer *observer = nullptr;
+        uint64_t writeCount = 0;
+        // per page, the kinds watched in it (and for word accesses that
+        // cross into the next page, at its first byte), and per byte of
+        // those pages, the kinds watched there
+        byte watchPages[NUM_PAGES] = {};
+        vector<byte> watchMaps[NUM_PAGES];
+        address breakpointPages = 0; // how many pages have WATCH_EXECUTE
+        WatchListener *watchListener = nullptr;
+        uint64_t hitCount = 0;
+        WatchHit lastHit = {};
     };
 }
 
@@ -0,0 +1,84 @@
+//
+//  Observer.hpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Hooks for watching the emulator run, for tracing and debugging, in any build.
+// Attach one with CPU::setObserver() and/or Memory::setObserver(), or for
+// just particular locations, a WatchListener with Memory::setWatchListener().
+
+#ifndef Observer_hpp
+#define Observer_hpp
+
+#include "Types.h"
+
+using namespace std;
+
+namespace DK86PC {
+
+    class CPU;
+    struct DecodedInstruction;
+
+    class Observer {
+    public:
+        virtual ~Observer() {}
+        // each instruction just before it executes, with ip on its opcode
+        virtual void instruction(CPU &cpu, const DecodedInstruction &decoded) {}
+        virtual void interrupt(byte type) {}
+        virtual void portRead(word port, word value) {}
+        virtual void portWrite(word port, word value) {}
+        virtual void memoryRead(address location, word value, bool wide) {}
+        virtual void memoryWrite(address location, word value, bool wide) {}
+        // a REP string instruction's bulk write
+        virtual void memoryBlockWrite(address location, address length) {}
+    };
+
+    // Prints the registers and mnemonic of every instruction, as DEBUG builds used to
+    class TraceObserver : public Observer {
+    public:
+        void instruction(CPU &cpu, const DecodedInstruction &decoded) override;
+    };
+
+    // What a watchpoint or breakpoint set with Memory::watch() catches
+    enum WatchKind : byte {
+        WATCH_READ = 1,
+        WATCH_WRITE = 2,
+        WATCH_EXECUTE = 4 // an instruction starting there
+    };
+    
+    struct WatchHit {
+        WatchKind kind;
+        address location; // the watched byte
+        word value; // read or written, the whole word for word accesses
+        bool wide;
+    };
+    
+    // Told of every hit on a watched location
+    class WatchListener {
+    public:
+        virtual ~WatchListener() {}
+        virtual void hit(const WatchHit &hit) = 0;
+    };
+    
+    // Prints the hits
+    class WatchPrinter : public WatchListener {
+    public:
+        void hit(const WatchHit &hit) override;
+    };
+}
+
+#endif /* Observer_hpp */
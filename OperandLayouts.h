@@ -0,0 +1,41 @@
+//
+//  OperandLayouts.h
+//  DK86PC
+//
+//  Generated from DebugTable/8086_table.txt by DebugTable/generate_decoder.py,
+//  don't edit by hand.
+//
+
+#include "Types.h"
+
+#ifndef OperandLayouts_h
+#define OperandLayouts_h
+
+namespace DK86PC {
+    // Operand layout of each opcode after the opcode byte itself, used by decode()
+    #define MODRM 1 // ModRM byte plus any displacement it calls for
+    #define IMM8 2 // one byte immediate (also 8 bit jump displacements and ports)
+    #define IMM16 4 // two byte immediate (also 16 bit jump displacements and offsets)
+    #define FARPTR 8 // offset followed by segment
+    #define GRP3IMM 16 // F6/F7 TEST is the only member of its group with an immediate
+    
+    static constexpr byte operandLayouts[256] = {
+        /* 0_ */ MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0, MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0,
+        /* 1_ */ MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0, MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0,
+        /* 2_ */ MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0, MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0,
+        /* 3_ */ MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0, MODRM, MODRM, MODRM, MODRM, IMM8, IMM16, 0, 0,
+        /* 4_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 5_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        /* 6_ */ IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8,
+        /* 7_ */ IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8,
+        /* 8_ */ MODRM | IMM8, MODRM | IMM16, MODRM | IMM8, MODRM | IMM8, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM,
+        /* 9_ */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, FARPTR, 0, 0, 0, 0, 0,
+        /* A_ */ IMM16, IMM16, IMM16, IMM16, 0, 0, 0, 0, IMM8, IMM16, 0, 0, 0, 0, 0, 0,
+        /* B_ */ IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM16, IMM16, IMM16, IMM16, IMM16, IMM16, IMM16, IMM16,
+        /* C_ */ 0, 0, IMM16, 0, MODRM, MODRM, MODRM | IMM8, MODRM | IMM16, 0, 0, IMM16, 0, 0, IMM8, 0, 0,
+        /* D_ */ MODRM, MODRM, MODRM, MODRM, IMM8, IMM8, 0, 0, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM, MODRM,
+        /* E_ */ IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM8, IMM16, IMM16, FARPTR, IMM8, 0, 0, 0, 0,
+        /* F_ */ 0, 0, 0, 0, 0, 0, MODRM | GRP3IMM, MODRM | GRP3IMM, 0, 0, 0, 0, 0, 0, MODRM, MODRM,
+    };
+}
+#endif /* OperandLayouts_h */
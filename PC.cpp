@@ -20,6 +20,7 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <chrono>
 #include <vector>
 #include "PC.hpp"
 #include <SDL.h>
@@ -34,10 +35,12 @@ namespace DK86PC {
     // so implicitly must be <= 128k
     void PC::loadBIOS(string filename) {
         memory.loadBIOS(filename);
+        cpu.translateROMs();
     }
 
     void PC::loadCasetteBASIC(string filename1, string filename2, string filename3, string filename4) {
         memory.loadCasetteBASIC(filename1, filename2, filename3, filename4);
+        cpu.translateROMs();
     }
     
 //    static int cgaThreadHelper(void *cga) {
@@ -47,18 +50,28 @@ namespace DK86PC {
 //    }
 
     void PC::runLoop() {
-        // keep going until the user quits
-        while (!shouldQuit) {
+        // keep going until the user quits, or a guest program asks to
+        while (!shouldQuit && !(hypercalls != nullptr && hypercalls->exitRequested())) {
             
-            if (cpu.canInterrupt()) {
+            if (cpu.canInterrupt() && pic.hasInterrupt()) {
                 byte interruptType = pic.getInterrupt();
                 if (interruptType != NO_INTERRUPT) {
                     cpu.hardwareInterrupt(interruptType);
                 }
             }
             
-            cpu.step();
-            pit.update(); // not quite right, but hopefully close enough
+            const uint64_t start = cpu.getCycleCount();
+            const RunExit exit = cpu.run(CYCLES_PER_BATCH);
+            for (pitCycles += cpu.getCycleCount() - start; pitCycles >= CYCLES_PER_PIT_TICK; pitCycles -= CYCLES_PER_PIT_TICK) {
+                pit.update();
+            }
+            if (exit == EXIT_HALTED) {
+                waitWhileHalted();
+            } else if (idleDetector.update(cpu, memory, portsChanged)) {
+                sleepUntilEvent();
+                idleDetector.reset();
+            }
+            portsChanged = false;
             
         }
         //quit:
@@ -66,6 +79,36 @@ namespace DK86PC {
     }
     
 
+    // Nothing happens while the CPU is halted until an interrupt, so unless
+    // one can be taken now, sleep for real until the timer's next one is due
+    // or a key comes. The floppy only raises its interrupt in answer to a
+    // port write, so it can't come while halted. (A HLT with interrupts off
+    // never wakes, but the host still sleeps between looks.)
+    void PC::waitWhileHalted() {
+        if (cpu.canInterrupt() && pic.hasInterrupt()) {
+            return;
+        }
+        sleepUntilEvent();
+        idleDetector.reset();
+    }
+    
+    // The guest is only polling, so rather than spin the host, sleep until
+    // the timer's next interrupt is due in real time or a key comes first,
+    // then catch the timer up on however long it was.
+    void PC::sleepUntilEvent() {
+        uint64_t ticks = pic.isMasked(0) ? NO_PIT_EVENT : pit.ticksUntilInterrupt();
+        if (ticks == NO_PIT_EVENT) {
+            ticks = PIT_HZ / 1000; // nothing from the timer, look again in 1 ms
+        }
+        const auto start = chrono::steady_clock::now();
+        if (ppi.waitForKey(ticks * 1000000 / PIT_HZ)) {
+            const uint64_t slept = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            ticks = min(ticks, slept * PIT_HZ / 1000000);
+        }
+        pit.advance(ticks);
+        pitCycles = 0;
+    }
+    
     static int runLoopHelper(void *pc) {
         PC *pcPtr = static_cast<PC *>(pc);
         pcPtr->runLoop();
@@ -221,7 +264,32 @@ namespace DK86PC {
         }
     }
 
+    // The PIC, PIT, keyboard, CGA and floppy controller all have timing the
+    // program could notice, the rest can wait until the end of the batch
+    bool PC::requiresSync(word port) {
+        switch (port) {
+            case 0x20: case 0x21: // PIC
+            case 0x40: case 0x41: case 0x42: case 0x43: // PIT
+            case 0x60: case 0x61: case 0x62: case 0x63: // PPI
+            case 0x3D4: case 0x3D5: case 0x3D8: case 0x3D9: case 0x3DA: // CGA
+            case 0x3F2: case 0x3F4: case 0x3F5: // FDC
+                return true;
+            default:
+                return false;
+        }
+    }
+
     word PC::readPort(word port) {
+        const word value = readDevice(port);
+        // a value that's different from last time means the guest isn't just polling
+        if (value != lastPortValues[port & 0x3FF]) {
+            lastPortValues[port & 0x3FF] = value;
+            portsChanged = true;
+        }
+        return value;
+    }
+    
+    word PC::readDevice(word port) {
         switch (port) {
             case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
             {
@@ -29,32 +29,74 @@
 #include "PIT.hpp"
 #include "CGA.hpp"
 #include "FDC.hpp"
+#include "Hypercalls.hpp"
+#include "IdleDetector.hpp"
 #include "PortInterface.hpp"
 
 using namespace std;
 
+// how long the CPU runs between catching the devices up to it
+#define CYCLES_PER_BATCH 256
+// the PIT's 1.19 MHz clock is the 4.77 MHz CPU clock divided by 4
+#define CYCLES_PER_PIT_TICK 4
+#define PIT_HZ 1193182
+// the most RAM a 5150 could have below video memory
+#define RAM_SIZE 655360
+
 namespace DK86PC {
     class CPU;
 
     class PC: PortInterface {
     public:
-        PC() : memory(), cpu(*this, memory), dma(), pic(), ppi(pic), pit(pic), cga(memory, ppi), fdc(pic) {
-#ifdef DEBUG
-            //memory.setWatch(90094);
-            //memory.setWatch(00000);
-            //memory.setWatch(0x3E4);
-            //memory.setWatch(0x415);
-#endif
-            
+        // sharedMemoryName puts the guest's memory where other processes can map it, see Memory
+        PC(const string &sharedMemoryName = "", bool replaceSharedMemory = false) : memory(RAM_SIZE, sharedMemoryName, replaceSharedMemory), cpu(*this, memory), dma(), pic(), ppi(pic), pit(pic), cga(memory, ppi), fdc(pic) {
+            memory.mapRAM(0xB8000, 0x4000); // CGA video memory
         };
         void loadBIOS(string filename);
         void loadCasetteBASIC(string filename1, string filename2, string filename3, string filename4);
+        // report the CPU's instructions and memory accesses to o, nullptr for none
+        void setObserver(Observer *o) {
+            cpu.setObserver(o);
+            memory.setObserver(o);
+        };
+        // watchpoints and execution breakpoints, kinds from WatchKind
+        void watch(address location, address length, byte kinds) {
+            memory.watch(location, length, kinds);
+        };
+        void unwatch(address location, address length, byte kinds) {
+            memory.unwatch(location, length, kinds);
+        };
+        // report their hits to l, nullptr for none
+        void setWatchListener(WatchListener *l) {
+            memory.setWatchListener(l);
+        };
+        uint64_t watchHits() {
+            return memory.watchHits();
+        };
+        const WatchHit &lastWatchHit() {
+            return memory.lastWatchHit();
+        };
+        // let guest programs call host services, nullptr to turn them off;
+        // the hypercall exit service ends the run loop
+        void setHypercalls(Hypercalls *h) {
+            hypercalls = h;
+            cpu.setHypercalls(h);
+        };
         void runLoop();
         void run();
         void writePort(word port, word value) override;
         word readPort(word port) override;
+        bool requiresSync(word port) override;
     private:
+        void waitWhileHalted();
+        void sleepUntilEvent();
+        word readDevice(word port);
         bool shouldQuit = false;
+        uint64_t pitCycles = 0; // CPU cycles not yet passed on to the PIT
+        IdleDetector idleDetector;
+        word lastPortValues[0x400] = {}; // ports are only decoded to 10 bits
+        bool portsChanged = false; // has a port read given a new value this batch
+        Hypercalls *hypercalls = nullptr;
         Memory memory;
         CPU cpu;
         DMA dma;
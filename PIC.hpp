@@ -39,6 +39,8 @@ namespace DK86PC {
         byte readData();
         void requestInterrupt(byte irq);
         byte getInterrupt();
+        bool hasInterrupt() { return (interruptRequestRegister & ~interruptMaskRegister) != 0; };
+        bool isMasked(byte irq) { return interruptMaskRegister & (1 << irq); };
         
     private:
         byte baseVectorAddress;
@@ -20,6 +20,7 @@
 // implement the intel 8253
 
 #include "PIT.hpp"
+#include <algorithm>
 
 namespace DK86PC {
 
@@ -76,51 +77,92 @@ void PIT::writeControl(byte value) {
 
 void PIT::update() {
     for (int i = 0; i < NUM_COUNTERS; i++) {
-        switch(modes[i]) {
-            case 0:
-                if (count[i] > 0) { // only fire once
-                    count[i]--;
-                    if (count[i] == 0 && i == 0) {
-                        pic.requestInterrupt(0);
-                    }
-                }
-                break;
-            case 1:
+        tick(i);
+    }
+}
+
+void PIT::tick(int i) {
+    switch(modes[i]) {
+        case 0:
+            if (count[i] > 0) { // only fire once
                 count[i]--;
-                if (count[i] == 0) {
-                    if (i == 0) {
-                        pic.requestInterrupt(0);
-                    }
-                    // reset
-                    count[i] = counters[i];
+                if (count[i] == 0 && i == 0) {
+                    pic.requestInterrupt(0);
                 }
-                break;
-            case 2:
-                count[i]--;
-                if (count[i] == 1) {
-                    if (i == 0) {
-                        pic.requestInterrupt(0);
-                    }
-                    // reset
-                    count[i] = counters[i];
+            }
+            break;
+        case 1:
+            count[i]--;
+            if (count[i] == 0) {
+                if (i == 0) {
+                    pic.requestInterrupt(0);
                 }
-                break;
-            case 3: // supposed to be square wave, but not really implemented right now
-                count[i]--;
-                if (count[i] == 0) {
-                    if (i == 0) {
-                        pic.requestInterrupt(0);
-                    }
-                    // reset
-                    count[i] = counters[i];
+                // reset
+                count[i] = counters[i];
+            }
+            break;
+        case 2:
+            count[i]--;
+            if (count[i] == 1) {
+                if (i == 0) {
+                    pic.requestInterrupt(0);
                 }
-                break;
-            default:
-                cout << "Unimplemented timer mode " << modes[i] << endl;
-                break;
+                // reset
+                count[i] = counters[i];
+            }
+            break;
+        case 3: // supposed to be square wave, but not really implemented right now
+            count[i]--;
+            if (count[i] == 0) {
+                if (i == 0) {
+                    pic.requestInterrupt(0);
+                }
+                // reset
+                count[i] = counters[i];
+            }
+            break;
+        default:
+            cout << "Unimplemented timer mode " << modes[i] << endl;
+            break;
+    }
+    if (modes[i] == 1 && counters[i] == 0) { return; }
+    counters[i]--;
+}
+
+// How many tick()s until the counter fires (or would, for counters 1 and 2)
+uint64_t PIT::ticksUntilEvent(int i) {
+    switch(modes[i]) {
+        case 0:
+            return count[i] > 0 ? count[i] : NO_PIT_EVENT;
+        case 1: case 3:
+            return count[i] == 0 ? 0x10000 : count[i];
+        case 2:
+            return ((word) (count[i] - 2)) + 1;
+        default:
+            return NO_PIT_EVENT;
+    }
+}
+
+void PIT::advance(uint64_t ticks) {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        uint64_t remaining = ticks;
+        while (remaining > 0) {
+            // everything up to the next event just counts down
+            const uint64_t quiet = min(ticksUntilEvent(i) - 1, remaining);
+            if (modes[i] != 0 || count[i] > 0) {
+                count[i] -= (word) quiet;
+            }
+            if (modes[i] == 1) {
+                counters[i] = counters[i] > quiet ? counters[i] - (word) quiet : 0;
+            } else {
+                counters[i] -= (word) quiet;
+            }
+            remaining -= quiet;
+            if (remaining > 0) {
+                tick(i);
+                remaining--;
+            }
         }
-        if (modes[i] == 1 && counters[i] == 0) { continue; }
-        counters[i]--;
     }
 }
 
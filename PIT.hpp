@@ -26,6 +26,7 @@
 #include "PIC.hpp"
 
 #define NUM_COUNTERS 3
+#define NO_PIT_EVENT UINT64_MAX
 
 namespace DK86PC {
     class PIT {
@@ -44,7 +45,15 @@ namespace DK86PC {
         void writeCounter(int counterIndex, byte value);
         void writeControl(byte value);
         void update();
+        // update()s until counter 0 next requests IRQ 0, or NO_PIT_EVENT
+        uint64_t ticksUntilInterrupt() {
+            return ticksUntilEvent(0);
+        };
+        // same as calling update() ticks times, without going tick by tick
+        void advance(uint64_t ticks);
     private:
+        uint64_t ticksUntilEvent(int counterIndex);
+        void tick(int counterIndex);
         word counters[NUM_COUNTERS];
         word count[NUM_COUNTERS];
         byte latches[NUM_COUNTERS];
@@ -87,6 +87,7 @@ void PPI::keyboardDown(SDL_Keysym s) {
     }
     a = scancode; // set it
     pic.requestInterrupt(1); // interrupt 9 when key happened
+    keyEvent();
 }
 
 void PPI::keyboardUp(SDL_Keysym s) {
@@ -99,6 +100,22 @@ void PPI::keyboardUp(SDL_Keysym s) {
     }
     a = (scancode | 0x80); // set it with bit 7 for key up
     pic.requestInterrupt(1); // interrupt 9 when key happened
+    keyEvent();
+}
+
+// wake up the run loop if it's waiting in waitForKey()
+void PPI::keyEvent() {
+    {
+        lock_guard<mutex> lock(keyMutex);
+        keyEvents++;
+    }
+    keyCondition.notify_all();
+}
+
+bool PPI::waitForKey(uint64_t microseconds) {
+    unique_lock<mutex> lock(keyMutex);
+    const uint64_t seen = keyEvents;
+    return keyCondition.wait_for(lock, chrono::microseconds(microseconds), [&] { return keyEvents != seen; });
 }
 
 }
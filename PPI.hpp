@@ -23,6 +23,8 @@
 #define PPI_hpp
 
 #include <stdio.h>
+#include <condition_variable>
+#include <mutex>
 #include "Types.h"
 #include "PIC.hpp"
 #include <SDL.h>
@@ -38,8 +40,15 @@ namespace DK86PC {
         byte readC();
         void keyboardDown(SDL_Keysym s);
         void keyboardUp(SDL_Keysym s);
+        // Blocks until a key goes down or up, or microseconds go by;
+        // returns whether it was a key
+        bool waitForKey(uint64_t microseconds);
     private:
+        void keyEvent();
         byte a, b, c, control; // registers
+        mutex keyMutex;
+        condition_variable keyCondition;
+        uint64_t keyEvents = 0;
         PIC &pic;
     };
 }
@@ -17,6 +17,9 @@ class PortInterface {
     public:
     virtual void writePort(word port, word value) = 0;
     virtual word readPort(word port) = 0;
+    // Whether devices behind this port have to be caught up to the CPU
+    // before it's accessed, which ends a CPU::run() batch
+    virtual bool requiresSync(word port) { return true; };
 };
 
 }
@@ -0,0 +1,744 @@
+//
+//  Recompiler.cpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "CPU.hpp"
+
+#ifdef RECOMPILER_AVAILABLE
+
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace DK86PC {
+
+    // Compiled blocks are a run of straight line code ending at the first jump.
+    // MOVs, PUSH/POP reg, ALU operations on registers, INC/DEC reg, the flag
+    // instructions and conditional jumps are emitted as native x86-64, which
+    // works on the CPU's registers in place and has the host's flags stand in
+    // for the 8086's, as they're set the same way by the same operations.
+    // Memory goes straight to the page tables when it's plain RAM/ROM with no
+    // watchpoints, observer or compiled code on the page, and through
+    // CPU::readTranslated()/writeTranslated() when it isn't. Everything else
+    // is a call back into CPU::executeTranslated(), which runs that one
+    // already decoded instruction through the interpreter's handlers and says
+    // whether the block can keep going.
+
+    #if CODE_PAGE_SHIFT != PAGE_SHIFT
+    #error "compiled code looks up codePages with the memory map's page number"
+    #endif
+
+    // x86-64 registers, by their encoding
+    #define HOST_EAX 0
+    #define HOST_ECX 1
+    #define HOST_EDX 2
+
+    // The arithmetic flags, by what sets them
+    #define ARITHMETIC_FLAGS 0x08D5 // OF, SF, ZF, AF, PF, CF
+    #define LOGIC_FLAGS 0x08C5 // all but AF, which logic ops leave alone
+    #define INC_DEC_FLAGS 0x08D4 // all but CF, which INC/DEC leave alone
+
+    #define ALU_TEST 8 // next to the 8086's own numbering of ADD, OR, ADC, SBB, AND, SUB, XOR, CMP
+
+    Recompiler::Recompiler(CPU &c) : cpu(c) {
+        void *buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            cout << "Couldn't map memory for the recompiler, interpreting everything" << endl;
+            return;
+        }
+        codeBuffer = (byte *)buffer;
+        // lets perf attribute samples in compiled code back to guest addresses
+        char perfMapName[64];
+        snprintf(perfMapName, sizeof(perfMapName), "/tmp/perf-%d.map", (int)getpid());
+        perfMap = fopen(perfMapName, "a");
+    }
+
+    Recompiler::~Recompiler() {
+        if (codeBuffer != nullptr) {
+            munmap(codeBuffer, CODE_BUFFER_SIZE);
+        }
+        if (perfMap != nullptr) {
+            fclose(perfMap);
+        }
+    }
+
+    bool Recompiler::run(address location) {
+        if (codeBuffer == nullptr) {
+            return false;
+        }
+
+        BlockEntry &entry = blocks[location & (BLOCK_CACHE_SIZE - 1)];
+        const uint32_t version = cpu.memory.codeVersion(location);
+        if (entry.location != location || entry.version != version) {
+            // new block, or the code it was compiled from has been written to
+            entry = BlockEntry();
+            entry.location = location;
+            entry.version = version;
+        }
+
+        if (entry.code == nullptr) {
+            if (entry.untranslatable || ++entry.count < HOT_BLOCK_THRESHOLD) {
+                return false;
+            }
+            entry.code = compile(location, entry.instructions);
+            if (entry.code == nullptr) {
+                entry.untranslatable = true;
+                return false;
+            }
+        }
+
+        cpu.jump = false;
+        entry.code(&cpu);
+        return true;
+    }
+
+    // Port I/O, software interrupts, hypercalls and HLT always go through the interpreter,
+    // as do the rarely used BCD and FPU opcodes
+    inline bool Recompiler::translatable(const DecodedInstruction &decoded) {
+        switch (decoded.opcode) {
+            case 0xE4: case 0xE5: case 0xE6: case 0xE7: // IN/OUT
+            case 0xEC: case 0xED: case 0xEE: case 0xEF:
+            case 0xCC: case 0xCD: case 0xCE: case 0xCF: // INT/INTO/IRET
+            case 0xF1: case 0xF4: // hypercall, HLT
+            case 0x27: case 0x2F: case 0x37: case 0x3F: // DAA/DAS/AAA/AAS
+            case 0xD4: case 0xD5: // AAM/AAD
+            case 0xD8: case 0xD9: case 0xDA: case 0xDB: case 0xDC: case 0xDD: case 0xDE: case 0xDF:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    // Anything that can change cs:ip other than falling through, plus POPF and STI
+    // since they turn interrupts on and the PC only checks for them between steps
+    // (and STI's one instruction delay is handled by step())
+    inline bool Recompiler::endsBlock(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        return (opcode >= 0x60 && opcode <= 0x7F) || (opcode >= 0xE0 && opcode <= 0xE3) ||
+            (opcode >= 0xE8 && opcode <= 0xEB) || opcode == 0x9A || opcode == 0x9D || opcode == 0xFB ||
+            opcode == 0xC2 || opcode == 0xC3 || opcode == 0xCA || opcode == 0xCB || opcode == 0xFF;
+    }
+
+    // The block's instructions are decoded into instructions, which the
+    // caller keeps for as long as the compiled code is around
+    CompiledBlock Recompiler::compile(address location, vector<DecodedInstruction> &instructions) {
+        if (codeSize + MAX_BLOCK_CODE > CODE_BUFFER_SIZE) {
+            flush();
+        }
+
+        // gather the block
+        instructions.clear();
+        instructions.reserve(MAX_BLOCK_INSTRUCTIONS);
+        address place = location;
+        while (instructions.size() < MAX_BLOCK_INSTRUCTIONS) {
+            DecodedInstruction decoded;
+            cpu.decode(place, decoded);
+            const address last = place + decoded.prefixCount + decoded.length - 1;
+            if ((last >> CODE_PAGE_SHIFT) != (location >> CODE_PAGE_SHIFT) || !translatable(decoded)) {
+                break;
+            }
+            instructions.push_back(decoded);
+            place = last + 1;
+            if (endsBlock(decoded)) {
+                break;
+            }
+        }
+        if (instructions.empty()) {
+            return nullptr;
+        }
+
+        // writes into this page from now on bump its version, which the
+        // compiled code and run() both check against
+        cpu.memory.markCode(location);
+        blockLocation = location;
+        blockVersion = cpu.memory.codeVersion(location);
+        for (DecodedInstruction &decoded : instructions) {
+            decoded.version = blockVersion;
+        }
+
+        byte *start = codeBuffer + codeSize;
+        emitPlace = start;
+        flagsKnown = false;
+        emitByte(0x53); // push rbx (also aligns the stack for calls)
+        emitByte(0x48); emitByte(0x89); emitByte(0xFB); // mov rbx, rdi
+        for (const DecodedInstruction &decoded : instructions) {
+            emitNative(decoded);
+        }
+        emitExit();
+
+        const size_t size = emitPlace - start;
+        codeSize += size;
+        if (perfMap != nullptr) {
+            fprintf(perfMap, "%lx %zx dk86pc_block_%05X\n", (unsigned long)start, size, location);
+            fflush(perfMap);
+        }
+        return (CompiledBlock)start;
+    }
+
+    void Recompiler::flush() {
+        for (BlockEntry &entry : blocks) {
+            entry = BlockEntry();
+        }
+        codeSize = 0;
+    }
+
+    inline void Recompiler::emitByte(byte b) {
+        *emitPlace++ = b;
+    }
+
+    inline void Recompiler::emit16(word w) {
+        emitByte(lowByte(w));
+        emitByte(highByte(w));
+    }
+
+    inline void Recompiler::emit32(uint32_t d) {
+        emit16(d & 0xFFFF);
+        emit16(d >> 16);
+    }
+
+    inline void Recompiler::emit64(uint64_t q) {
+        emit32(q & 0xFFFFFFFF);
+        emit32(q >> 32);
+    }
+
+    // rbx holds the CPU, so its members are addressed as [rbx + disp32]
+    inline int32_t Recompiler::offsetOf(const void *member) {
+        return (int32_t)((const byte *)member - (const byte *)&cpu);
+    }
+
+    // and the memory's are from its address, which doesn't change
+    inline int32_t Recompiler::memoryOffsetOf(const void *member) {
+        return (int32_t)((const byte *)member - (const byte *)&cpu.memory);
+    }
+
+    // where a register is in the CPU, by its ModRM encoding
+    inline int32_t Recompiler::registerOffset(byte reg, bool wide) {
+        if (wide) {
+            return offsetOf(&cpu.registers[reg]);
+        }
+        return offsetOf(&cpu.registerBytes[CPU::byteRegisterIndex[reg]]);
+    }
+
+    // a native instruction's own effect on ip and the cycle count, written back later
+    inline void Recompiler::advance(const DecodedInstruction &decoded) {
+        pendingIP += decoded.prefixCount + decoded.length;
+        pendingCycles += decoded.cycles;
+    }
+
+    // Conditional jumps that are the JNZ of a DEC/JNZ delay loop are left to
+    // the interpreter, which skips the whole loop. LOOP and JCXZ are too.
+    inline void Recompiler::emitNative(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        const int32_t flags = offsetOf(&cpu.flags);
+        if (opcode == 0xE9 || opcode == 0xEB) { // JMP relative, always the end of a block
+            word displacement = (opcode == 0xEB) ? signExtend((byte) decoded.immediate) : decoded.immediate;
+            pendingIP += decoded.prefixCount + decoded.length + displacement;
+            pendingCycles += decoded.cycles;
+            emitByte(0xC6); emitByte(0x83); // mov byte [rbx + disp32], imm8
+            emit32(offsetOf(&cpu.jump));
+            emitByte(1);
+            return;
+        } else if (opcode >= 0x60 && opcode <= 0x7F) { // Jcc and its 60-6F alias
+            if ((opcode & 0x0F) == 0x05 && (byte) decoded.immediate == 0xFD) {
+                emitCall(&decoded);
+            } else {
+                emitConditionalJump(decoded);
+            }
+            return;
+        } else if (opcode >= 0xB8 && opcode <= 0xBF) {
+            emitByte(0x66); emitByte(0xC7); emitByte(0x83); // mov word [rbx + disp32], imm16
+            emit32(registerOffset(opcode & 7, true));
+            emit16(decoded.immediate);
+        } else if (opcode >= 0xB0 && opcode <= 0xB7) {
+            emitByte(0xC6); emitByte(0x83); // mov byte [rbx + disp32], imm8
+            emit32(registerOffset(opcode & 7, false));
+            emitByte((byte) decoded.immediate);
+        } else if (opcode == 0xFA || opcode == 0xFC) { // CLI, CLD
+            emitByte(0x66); emitByte(0x81); emitByte(0xA3); // and word [rbx + disp32], imm16
+            emit32(flags);
+            emit16(opcode == 0xFA ? ~0x0200 : ~0x0400);
+        } else if (opcode == 0xFD) { // STD
+            emitByte(0x66); emitByte(0x81); emitByte(0x8B); // or word [rbx + disp32], imm16
+            emit32(flags);
+            emit16(0x0400);
+        } else if (opcode == 0x90) { // NOP needs nothing at all
+        } else if (emitALU(decoded) || emitIncDec(decoded) || emitFlagOp(decoded) || emitMove(decoded) || emitStack(decoded)) {
+            return; // they advance themselves, before any exit out of the middle of them
+        } else {
+            emitCall(&decoded);
+            return;
+        }
+        advance(decoded);
+    }
+
+    // ADD, OR, ADC, SBB, AND, SUB, XOR, CMP and TEST between registers, or a
+    // register and an immediate, done by the host's own instruction on the
+    // register in place, whose flags are then copied into the flags word
+    inline bool Recompiler::emitALU(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        const ModRegRM mrr = ModRegRM(decoded.modrm);
+        const bool wide = opcode & 1;
+        byte operation;
+        int32_t destination;
+        int32_t source = -1; // the immediate
+        if (opcode < 0x40 && (opcode & 0x07) <= 5) {
+            operation = opcode >> 3;
+            if ((opcode & 0x07) >= 4) { // AL/AX, immediate
+                destination = registerOffset(0, wide);
+            } else if (mrr.mod != 0b11) {
+                return false;
+            } else if ((opcode & 0x02) == 0) { // r/m, reg
+                destination = registerOffset(mrr.rm, wide);
+                source = registerOffset(mrr.reg, wide);
+            } else { // reg, r/m
+                destination = registerOffset(mrr.reg, wide);
+                source = registerOffset(mrr.rm, wide);
+            }
+        } else if (opcode >= 0x80 && opcode <= 0x83 && mrr.mod == 0b11) {
+            operation = mrr.reg;
+            destination = registerOffset(mrr.rm, wide);
+        } else if ((opcode == 0x84 || opcode == 0x85) && mrr.mod == 0b11) {
+            operation = ALU_TEST;
+            destination = registerOffset(mrr.rm, wide);
+            source = registerOffset(mrr.reg, wide);
+        } else if (opcode == 0xA8 || opcode == 0xA9) {
+            operation = ALU_TEST;
+            destination = registerOffset(0, wide);
+        } else if ((opcode == 0xF6 || opcode == 0xF7) && mrr.mod == 0b11 && mrr.reg == 0b000) {
+            operation = ALU_TEST;
+            destination = registerOffset(mrr.rm, wide);
+        } else {
+            return false;
+        }
+        const bool logic = operation == 1 || operation == 4 || operation == 6 || operation == ALU_TEST;
+        const bool carryIn = operation == 2 || operation == 3; // ADC, SBB
+        const bool store = operation != 7 && operation != ALU_TEST; // not CMP or TEST
+
+        advance(decoded);
+        if (logic || carryIn) {
+            emitMaterialize(); // for the AF they leave alone, or the carry they take in
+        }
+        emitLoad(HOST_EAX, destination, wide);
+        if (source >= 0) {
+            emitLoad(HOST_ECX, source, wide);
+        }
+        if (carryIn) {
+            emitByte(0x66); emitByte(0x0F); emitByte(0xBA); emitByte(0xA3); // bt word [rbx + disp32], imm8
+            emit32(offsetOf(&cpu.flags));
+            emitByte(0); // carry
+        }
+        byte hostOpcode = (operation == ALU_TEST) ? ((source >= 0) ? 0x84 : 0xA8) : ((operation << 3) | ((source >= 0) ? 0x00 : 0x04));
+        if (wide) {
+            emitByte(0x66);
+        }
+        emitByte(hostOpcode | wide); // op al/ax, cl/cx or op al/ax, imm
+        if (source >= 0) {
+            emitByte(0xC8);
+        } else if (wide) {
+            emit16(decoded.immediate);
+        } else {
+            emitByte((byte) decoded.immediate);
+        }
+        if (store) {
+            emitStore(HOST_EAX, destination, wide);
+        }
+        emitMergeFlags(logic ? LOGIC_FLAGS : ARITHMETIC_FLAGS);
+        return true;
+    }
+
+    // INC and DEC of a register, right on it
+    inline bool Recompiler::emitIncDec(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        const ModRegRM mrr = ModRegRM(decoded.modrm);
+        bool wide, decrement;
+        int32_t place;
+        if (opcode >= 0x40 && opcode <= 0x4F) {
+            wide = true;
+            decrement = opcode & 0x08;
+            place = registerOffset(opcode & 7, true);
+        } else if ((opcode == 0xFE || opcode == 0xFF) && mrr.mod == 0b11 && mrr.reg <= 0b001) {
+            wide = opcode & 1;
+            decrement = mrr.reg;
+            place = registerOffset(mrr.rm, wide);
+        } else {
+            return false;
+        }
+        advance(decoded);
+        emitMaterialize(); // for the carry they leave alone
+        if (wide) {
+            emitByte(0x66);
+        }
+        emitByte(wide ? 0xFF : 0xFE); emitByte(decrement ? 0x8B : 0x83); // inc/dec [rbx + disp32]
+        emit32(place);
+        emitMergeFlags(INC_DEC_FLAGS);
+        return true;
+    }
+
+    // CLC, STC and CMC, once the carry has been worked out
+    inline bool Recompiler::emitFlagOp(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        if (opcode != 0xF8 && opcode != 0xF9 && opcode != 0xF5) {
+            return false;
+        }
+        advance(decoded);
+        emitMaterialize();
+        emitByte(0x66); emitByte(0x81); // and/or/xor word [rbx + disp32], imm16
+        emitByte(opcode == 0xF8 ? 0xA3 : (opcode == 0xF9 ? 0x8B : 0xB3));
+        emit32(offsetOf(&cpu.flags));
+        emit16(opcode == 0xF8 ? ~0x0001 : 0x0001);
+        return true;
+    }
+
+    // MOV between registers and memory, and of immediates to memory
+    inline bool Recompiler::emitMove(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        const ModRegRM mrr = ModRegRM(decoded.modrm);
+        const bool wide = opcode & 1;
+        if (opcode >= 0x88 && opcode <= 0x8B) {
+            const bool toRegister = opcode & 0x02;
+            advance(decoded);
+            if (mrr.mod == 0b11) {
+                emitLoad(HOST_EAX, registerOffset(toRegister ? mrr.rm : mrr.reg, wide), wide);
+                emitStore(HOST_EAX, registerOffset(toRegister ? mrr.reg : mrr.rm, wide), wide);
+            } else if (toRegister) {
+                emitAddress(decoded);
+                emitRead(wide);
+                emitStore(HOST_ECX, registerOffset(mrr.reg, wide), wide);
+            } else {
+                emitAddress(decoded);
+                emitWrite(wide, registerOffset(mrr.reg, wide), 0);
+            }
+            return true;
+        } else if ((opcode == 0xC6 || opcode == 0xC7) && mrr.reg == 0b000) {
+            advance(decoded);
+            if (mrr.mod == 0b11) {
+                if (wide) {
+                    emitByte(0x66); emitByte(0xC7); emitByte(0x83); // mov word [rbx + disp32], imm16
+                    emit32(registerOffset(mrr.rm, true));
+                    emit16(decoded.immediate);
+                } else {
+                    emitByte(0xC6); emitByte(0x83); // mov byte [rbx + disp32], imm8
+                    emit32(registerOffset(mrr.rm, false));
+                    emitByte((byte) decoded.immediate);
+                }
+            } else {
+                emitAddress(decoded);
+                emitWrite(wide, -1, decoded.immediate);
+            }
+            return true;
+        } else if (opcode >= 0xA0 && opcode <= 0xA3) { // AL/AX to and from a direct address
+            advance(decoded);
+            emitAddress(decoded);
+            if (opcode & 0x02) {
+                emitWrite(wide, registerOffset(0, wide), 0);
+            } else {
+                emitRead(wide);
+                emitStore(HOST_ECX, registerOffset(0, wide), wide);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // PUSH and POP of a general purpose register, other than SP
+    inline bool Recompiler::emitStack(const DecodedInstruction &decoded) {
+        const byte opcode = decoded.opcode;
+        if (opcode < 0x50 || opcode > 0x5F || (opcode & 7) == 4) {
+            return false;
+        }
+        const int32_t sp = offsetOf(&cpu.sp);
+        advance(decoded);
+        if (opcode < 0x58) {
+            emitByte(0x66); emitByte(0x83); emitByte(0xAB); emit32(sp); emitByte(2); // sub word [rbx + disp32], 2
+            emitStackAddress();
+            emitWrite(true, registerOffset(opcode & 7, true), 0);
+        } else {
+            emitStackAddress();
+            emitRead(true);
+            emitByte(0x66); emitByte(0x83); emitByte(0x83); emit32(sp); emitByte(2); // add word [rbx + disp32], 2
+            emitStore(HOST_ECX, registerOffset(opcode & 7, true), true);
+        }
+        return true;
+    }
+
+    // The flags word is loaded into the host's flags, which have the
+    // arithmetic flags in the same places, for the host's own Jcc to test
+    inline void Recompiler::emitConditionalJump(const DecodedInstruction &decoded) {
+        advance(decoded);
+        emitMaterialize();
+        emitLoad(HOST_EAX, offsetOf(&cpu.flags), true);
+        emitByte(0x25); emit32(ARITHMETIC_FLAGS); // and eax, imm32
+        emitByte(0x50); // push rax
+        emitByte(0x9D); // popfq
+        byte *notTaken = emitJump((decoded.opcode & 0x0F) ^ 1); // the opposite condition
+        // taken
+        const word fallThroughIP = pendingIP;
+        const uint32_t fallThroughCycles = pendingCycles;
+        pendingIP += signExtend((byte) decoded.immediate);
+        pendingCycles += JUMP_TAKEN_CYCLES;
+        emitByte(0xC6); emitByte(0x83); // mov byte [rbx + disp32], imm8
+        emit32(offsetOf(&cpu.jump));
+        emitByte(1);
+        emitExit();
+        pendingIP = fallThroughIP;
+        pendingCycles = fallThroughCycles;
+        patchJump(notTaken);
+    }
+
+    // movzx hostRegister, byte/word [rbx + offset]
+    inline void Recompiler::emitLoad(byte hostRegister, int32_t offset, bool wide) {
+        emitByte(0x0F); emitByte(wide ? 0xB7 : 0xB6); emitByte(0x83 | (hostRegister << 3));
+        emit32(offset);
+    }
+
+    // mov byte/word [rbx + offset], hostRegister
+    inline void Recompiler::emitStore(byte hostRegister, int32_t offset, bool wide) {
+        if (wide) {
+            emitByte(0x66);
+        }
+        emitByte(wide ? 0x89 : 0x88); emitByte(0x83 | (hostRegister << 3));
+        emit32(offset);
+    }
+
+    // Copy the flags in mask out of the host's flags into the flags word,
+    // which is then up to date
+    inline void Recompiler::emitMergeFlags(word mask) {
+        const int32_t flags = offsetOf(&cpu.flags);
+        emitByte(0x9C); // pushfq
+        emitByte(0x5A); // pop rdx
+        emitByte(0x81); emitByte(0xE2); emit32(mask); // and edx, imm32
+        emitByte(0x66); emitByte(0x81); emitByte(0xA3); emit32(flags); emit16(~mask); // and word [rbx + disp32], imm16
+        emitByte(0x66); emitByte(0x09); emitByte(0x93); emit32(flags); // or word [rbx + disp32], dx
+        if (!flagsKnown) {
+            emitByte(0xC6); emitByte(0x83); emit32(offsetOf(&cpu.lazyOp)); emitByte(LAZY_NONE); // mov byte [rbx + disp32], imm8
+            flagsKnown = true;
+        }
+    }
+
+    // Work out any lazy flags, unless that's known to be done already
+    inline void Recompiler::emitMaterialize() {
+        if (flagsKnown) {
+            return;
+        }
+        emitByte(0x80); emitByte(0xBB); emit32(offsetOf(&cpu.lazyOp)); emitByte(LAZY_NONE); // cmp byte [rbx + disp32], imm8
+        emitByte(0x74); emitByte(0x0F); // je past the call
+        emitHelperCall((const void *)&CPU::materializeTranslated);
+        flagsKnown = true;
+    }
+
+    // eax = the physical address of the memory operand
+    inline void Recompiler::emitAddress(const DecodedInstruction &decoded) {
+        const ModRegRM mrr = ModRegRM(decoded.modrm);
+        byte segment = decoded.addressSegment;
+        if (decoded.opcode >= 0xA0 && decoded.opcode <= 0xA3) {
+            segment = decoded.segmentOverride ? decoded.segment : 0b11;
+            emitByte(0xB8); emit32(decoded.immediate); // mov eax, imm32
+        } else if (mrr.mod == 0b00 && mrr.rm == 0b110) {
+            emitByte(0xB8); emit32(decoded.displacement); // mov eax, imm32
+        } else {
+            // the same registers as CPU::effectiveAddress(), added up in 16 bits
+            static const byte bases[8] = {3, 3, 5, 5, 6, 7, 5, 3}; // bx, bp, si, di
+            static const byte indexes[8] = {6, 7, 6, 7, 0, 0, 0, 0};
+            emitLoad(HOST_EAX, registerOffset(bases[mrr.rm], true), true);
+            if (indexes[mrr.rm] != 0) {
+                emitByte(0x66); emitByte(0x03); emitByte(0x83); // add ax, word [rbx + disp32]
+                emit32(registerOffset(indexes[mrr.rm], true));
+            }
+            if (mrr.mod != 0b00 && decoded.displacement != 0) {
+                emitByte(0x66); emitByte(0x05); emit16(decoded.displacement); // add ax, imm16
+            }
+        }
+        emitSegmentBase(segment);
+    }
+
+    // eax = the physical address of the top of the stack
+    inline void Recompiler::emitStackAddress() {
+        emitLoad(HOST_EAX, offsetOf(&cpu.sp), true);
+        emitSegmentBase(0b10);
+    }
+
+    // eax += segment << 4, wrapped around at 1 MB
+    inline void Recompiler::emitSegmentBase(byte segment) {
+        emitLoad(HOST_ECX, offsetOf(&cpu.segments[segment]), true);
+        emitByte(0xC1); emitByte(0xE1); emitByte(4); // shl ecx, 4
+        emitByte(0x01); emitByte(0xC8); // add eax, ecx
+        emitByte(0x25); emit32(ADDRESS_MASK); // and eax, imm32
+    }
+
+    // ecx = the byte or word at eax, from its page, or from
+    // CPU::readTranslated() where it can't be read directly
+    inline void Recompiler::emitRead(bool wide) {
+        Memory &memory = cpu.memory;
+        vector<byte *> slow;
+        emitByte(0x48); emitByte(0xBE); emit64((uint64_t)&memory); // mov rsi, imm64
+        emitByte(0x89); emitByte(0xC2); // mov edx, eax
+        emitByte(0xC1); emitByte(0xEA); emitByte(PAGE_SHIFT); // shr edx, imm8
+        emitByte(0xF6); emitByte(0x84); emitByte(0x16); emit32(memoryOffsetOf(memory.watchPages)); // test byte [rsi + rdx + disp32], imm8
+        emitByte(WATCH_READ | WATCH_OBSERVED);
+        slow.push_back(emitJump(0x05)); // jnz
+        emitByte(0x48); emitByte(0x8B); emitByte(0xBC); emitByte(0xD6); emit32(memoryOffsetOf(memory.readPages)); // mov rdi, [rsi + rdx * 8 + disp32]
+        emitByte(0x48); emitByte(0x85); emitByte(0xFF); // test rdi, rdi
+        slow.push_back(emitJump(0x04)); // jz
+        emitByte(0x89); emitByte(0xC1); // mov ecx, eax
+        emitByte(0x81); emitByte(0xE1); emit32(PAGE_MASK); // and ecx, imm32
+        if (wide) {
+            emitByte(0x81); emitByte(0xF9); emit32(PAGE_MASK); // cmp ecx, imm32
+            slow.push_back(emitJump(0x04)); // je, across pages
+        }
+        emitByte(0x0F); emitByte(wide ? 0xB7 : 0xB6); emitByte(0x0C); emitByte(0x0F); // movzx ecx, [rdi + rcx]
+        byte *done = emitJump(0xFF);
+        for (byte *jump : slow) {
+            patchJump(jump);
+        }
+        emitByte(0x48); emitByte(0x89); emitByte(0xDF); // mov rdi, rbx
+        emitByte(0x89); emitByte(0xC6); // mov esi, eax
+        emitByte(0xBA); emit32(wide); // mov edx, imm32
+        emitByte(0x48); emitByte(0xB8); emit64((uint64_t)&CPU::readTranslated); // mov rax, imm64
+        emitByte(0xFF); emitByte(0xD0); // call rax
+        emitByte(0x0F); emitByte(0xB7); emitByte(0xC8); // movzx ecx, ax
+        patchJump(done);
+    }
+
+    // Write a register (source) or an immediate to eax, into its page, or
+    // through CPU::writeTranslated() where it can't be written directly,
+    // leaving the block if that wrote over it
+    inline void Recompiler::emitWrite(bool wide, int32_t source, word immediate) {
+        Memory &memory = cpu.memory;
+        vector<byte *> slow;
+        emitByte(0x48); emitByte(0xBE); emit64((uint64_t)&memory); // mov rsi, imm64
+        emitByte(0x89); emitByte(0xC2); // mov edx, eax
+        emitByte(0xC1); emitByte(0xEA); emitByte(PAGE_SHIFT); // shr edx, imm8
+        emitByte(0xF6); emitByte(0x84); emitByte(0x16); emit32(memoryOffsetOf(memory.watchPages)); // test byte [rsi + rdx + disp32], imm8
+        emitByte(WATCH_WRITE | WATCH_OBSERVED);
+        slow.push_back(emitJump(0x05)); // jnz
+        emitByte(0x80); emitByte(0xBC); emitByte(0x16); emit32(memoryOffsetOf(memory.codePages)); emitByte(0); // cmp byte [rsi + rdx + disp32], imm8
+        slow.push_back(emitJump(0x05)); // jne, decoded code to invalidate
+        emitByte(0x48); emitByte(0x8B); emitByte(0xBC); emitByte(0xD6); emit32(memoryOffsetOf(memory.writePages)); // mov rdi, [rsi + rdx * 8 + disp32]
+        emitByte(0x48); emitByte(0x85); emitByte(0xFF); // test rdi, rdi
+        slow.push_back(emitJump(0x04)); // jz
+        emitByte(0x89); emitByte(0xC1); // mov ecx, eax
+        emitByte(0x81); emitByte(0xE1); emit32(PAGE_MASK); // and ecx, imm32
+        if (wide) {
+            emitByte(0x81); emitByte(0xF9); emit32(PAGE_MASK); // cmp ecx, imm32
+            slow.push_back(emitJump(0x04)); // je, across pages
+        }
+        emitValue(wide, source, immediate);
+        if (wide) {
+            emitByte(0x66);
+        }
+        emitByte(wide ? 0x89 : 0x88); emitByte(0x14); emitByte(0x0F); // mov [rdi + rcx], dl/dx
+        emitByte(0x48); emitByte(0xFF); emitByte(0x86); emit32(memoryOffsetOf(&memory.writeCount)); // inc qword [rsi + disp32]
+        byte *done = emitJump(0xFF);
+        for (byte *jump : slow) {
+            patchJump(jump);
+        }
+        emitValue(wide, source, immediate);
+        emitByte(0x48); emitByte(0x89); emitByte(0xDF); // mov rdi, rbx
+        emitByte(0x89); emitByte(0xC6); // mov esi, eax
+        emitByte(0xB9); emit32(wide); // mov ecx, imm32
+        emitByte(0x41); emitByte(0xB8); emit32(blockLocation); // mov r8d, imm32
+        emitByte(0x41); emitByte(0xB9); emit32(blockVersion); // mov r9d, imm32
+        emitByte(0x48); emitByte(0xB8); emit64((uint64_t)&CPU::writeTranslated); // mov rax, imm64
+        emitByte(0xFF); emitByte(0xD0); // call rax
+        emitByte(0x84); emitByte(0xC0); // test al, al
+        byte *unchanged = emitJump(0x05); // jnz
+        emitSideExit();
+        patchJump(unchanged);
+        patchJump(done);
+    }
+
+    // edx = what emitWrite() writes
+    inline void Recompiler::emitValue(bool wide, int32_t source, word immediate) {
+        if (source >= 0) {
+            emitLoad(HOST_EDX, source, wide);
+        } else {
+            emitByte(0xBA); emit32(wide ? immediate : (byte) immediate); // mov edx, imm32
+        }
+    }
+
+    // call a static function taking the CPU
+    inline void Recompiler::emitHelperCall(const void *function) {
+        emitByte(0x48); emitByte(0x89); emitByte(0xDF); // mov rdi, rbx
+        emitByte(0x48); emitByte(0xB8); emit64((uint64_t)function); // mov rax, imm64
+        emitByte(0xFF); emitByte(0xD0); // call rax
+    }
+
+    // A jump forward to be patched once where it goes is emitted;
+    // condition is an x86 condition code, or 0xFF for always
+    inline byte *Recompiler::emitJump(byte condition) {
+        if (condition == 0xFF) {
+            emitByte(0xE9); // jmp rel32
+        } else {
+            emitByte(0x0F); emitByte(0x80 | condition); // jcc rel32
+        }
+        byte *rel = emitPlace;
+        emit32(0);
+        return rel;
+    }
+
+    inline void Recompiler::patchJump(byte *rel) {
+        const int32_t distance = (int32_t)(emitPlace - (rel + 4));
+        memcpy(rel, &distance, sizeof(distance));
+    }
+
+    inline void Recompiler::emitCall(const DecodedInstruction *decoded) {
+        emitPendingAdvance();
+        emitByte(0x48); emitByte(0x89); emitByte(0xDF); // mov rdi, rbx
+        emitByte(0x48); emitByte(0xBE); emit64((uint64_t)decoded); // mov rsi, imm64
+        emitByte(0x48); emitByte(0xB8); emit64((uint64_t)&CPU::executeTranslated); // mov rax, imm64
+        emitByte(0xFF); emitByte(0xD0); // call rax
+        emitByte(0x84); emitByte(0xC0); // test al, al
+        emitByte(0x75); emitByte(0x02); // jnz past the early exit
+        emitByte(0x5B); // pop rbx
+        emitByte(0xC3); // ret
+        flagsKnown = false; // the interpreter's ALU helpers leave them lazy
+    }
+
+    // write back what native instructions did to ip and the cycle count
+    inline void Recompiler::emitPendingAdvance() {
+        if (pendingIP != 0) {
+            emitByte(0x66); emitByte(0x81); emitByte(0x83); // add word [rbx + disp32], imm16
+            emit32(offsetOf(&cpu.ip));
+            emit16(pendingIP);
+        }
+        if (pendingCycles != 0) {
+            emitByte(0x48); emitByte(0x81); emitByte(0x83); // add qword [rbx + disp32], imm32
+            emit32(offsetOf(&cpu.cycleCount));
+            emit32(pendingCycles);
+        }
+        pendingIP = 0;
+        pendingCycles = 0;
+    }
+
+    // leave from the middle of the block, which carries on compiling after it
+    inline void Recompiler::emitSideExit() {
+        const word ip = pendingIP;
+        const uint32_t cycles = pendingCycles;
+        emitExit();
+        pendingIP = ip;
+        pendingCycles = cycles;
+    }
+
+    inline void Recompiler::emitExit() {
+        emitPendingAdvance();
+        emitByte(0x5B); // pop rbx
+        emitByte(0xC3); // ret
+    }
+}
+
+#endif
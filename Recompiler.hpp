@@ -0,0 +1,136 @@
+//
+//  Recompiler.hpp
+//
+//  DK86PC - An Intel 8086 and IBM PC 5150 emulator.
+//  Copyright (C) 2020 David Kopec
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Optional x86-64 dynamic recompiler for hot basic blocks.
+// Build with -DRECOMPILER to turn it on; it's quietly left out on hosts
+// that aren't x86-64 Linux or macOS and the interpreter runs everything.
+
+#ifndef Recompiler_hpp
+#define Recompiler_hpp
+
+#if defined(RECOMPILER) && defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define RECOMPILER_AVAILABLE
+#endif
+
+#ifdef RECOMPILER_AVAILABLE
+
+#include <cstdio>
+#include <vector>
+#include "Types.h"
+
+using namespace std;
+
+namespace DK86PC {
+
+    class CPU;
+    struct DecodedInstruction;
+
+    #define BLOCK_CACHE_SIZE 4096 // must be a power of 2
+    #ifndef HOT_BLOCK_THRESHOLD
+    #define HOT_BLOCK_THRESHOLD 32 // times a block is entered before it's compiled
+    #endif
+    #define MAX_BLOCK_INSTRUCTIONS 64
+    #define MAX_BLOCK_CODE 32768 // bytes of x86-64 a single block can need, worst case
+    #define CODE_BUFFER_SIZE (16 * 1048576)
+
+    typedef void (*CompiledBlock)(CPU *cpu);
+
+    // A block entry point seen by the CPU, keyed by physical address
+    struct BlockEntry {
+        address location = 0xFFFFFFFF;
+        uint32_t version = 0; // Memory::codeVersion() of its page
+        uint32_t count = 0; // times entered
+        bool untranslatable = false;
+        CompiledBlock code = nullptr;
+        // referenced by the compiled code, so they go when the entry is replaced;
+        // moving keeps them where they are, but copying wouldn't
+        vector<DecodedInstruction> instructions;
+        BlockEntry() = default;
+        BlockEntry(BlockEntry &&) = default;
+        BlockEntry &operator=(BlockEntry &&) = default;
+        BlockEntry(const BlockEntry &) = delete;
+        BlockEntry &operator=(const BlockEntry &) = delete;
+    };
+
+    class Recompiler {
+    public:
+        Recompiler(CPU &c);
+        ~Recompiler();
+        Recompiler(const Recompiler&) = delete;
+        Recompiler& operator=(const Recompiler&) = delete;
+        // Run the compiled block starting at location, compiling it if it's become hot.
+        // Returns false if there's nothing to run and the interpreter should step instead.
+        bool run(address location);
+    private:
+        CompiledBlock compile(address location, vector<DecodedInstruction> &instructions);
+        void flush();
+        inline bool translatable(const DecodedInstruction &decoded);
+        inline bool endsBlock(const DecodedInstruction &decoded);
+
+        // Emitting x86-64
+        inline void emitByte(byte b);
+        inline void emit16(word w);
+        inline void emit32(uint32_t d);
+        inline void emit64(uint64_t q);
+        inline int32_t offsetOf(const void *member);
+        inline int32_t memoryOffsetOf(const void *member);
+        inline int32_t registerOffset(byte reg, bool wide);
+        inline void advance(const DecodedInstruction &decoded);
+        inline void emitNative(const DecodedInstruction &decoded);
+        inline bool emitALU(const DecodedInstruction &decoded);
+        inline bool emitIncDec(const DecodedInstruction &decoded);
+        inline bool emitFlagOp(const DecodedInstruction &decoded);
+        inline bool emitMove(const DecodedInstruction &decoded);
+        inline bool emitStack(const DecodedInstruction &decoded);
+        inline void emitConditionalJump(const DecodedInstruction &decoded);
+        inline void emitLoad(byte hostRegister, int32_t offset, bool wide);
+        inline void emitStore(byte hostRegister, int32_t offset, bool wide);
+        inline void emitMergeFlags(word mask);
+        inline void emitMaterialize();
+        inline void emitAddress(const DecodedInstruction &decoded);
+        inline void emitStackAddress();
+        inline void emitSegmentBase(byte segment);
+        inline void emitRead(bool wide);
+        inline void emitWrite(bool wide, int32_t source, word immediate);
+        inline void emitValue(bool wide, int32_t source, word immediate);
+        inline void emitHelperCall(const void *function);
+        inline byte *emitJump(byte condition);
+        inline void patchJump(byte *jump);
+        inline void emitCall(const DecodedInstruction *decoded);
+        inline void emitPendingAdvance();
+        inline void emitSideExit();
+        inline void emitExit();
+
+        CPU &cpu;
+        BlockEntry blocks[BLOCK_CACHE_SIZE];
+        byte *codeBuffer = nullptr;
+        size_t codeSize = 0;
+        byte *emitPlace = nullptr;
+        word pendingIP = 0; // ip and cycle advances of native instructions not yet written back
+        uint32_t pendingCycles = 0;
+        bool flagsKnown = false; // lazyOp is known to be LAZY_NONE at this point in the block
+        address blockLocation = 0; // of the block being compiled, and its page's code version
+        uint32_t blockVersion = 0;
+        FILE *perfMap = nullptr;
+    };
+}
+
+#endif
+
+#endif /* Recompiler_hpp */
@@ -39,12 +39,49 @@ int main(int argc, const char * argv[]) {
     auto path = filesystem::current_path(); //getting path
     cout << path << endl;
 #endif
-    PC pc = PC();
+    bool trace = false;
+    string hypercallDirectory;
+    string sharedMemoryName;
+    bool replaceSharedMemory = false;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--trace") {
+            trace = true;
+        } else if (string(argv[i]) == "--hypercalls" && i + 1 < argc) {
+            // guest programs can use opcode F1 to reach files in this directory
+            hypercallDirectory = argv[++i];
+        } else if (string(argv[i]) == "--shared-memory" && i + 1 < argc) {
+            // the guest's 1 MB in a POSIX shared memory object, like /dk86pc,
+            // for other processes to map read only
+            sharedMemoryName = argv[++i];
+        } else if (string(argv[i]) == "--replace-shared-memory") {
+            // take the name over even if something already has it
+            replaceSharedMemory = true;
+        }
+    }
+    PC pc = PC(sharedMemoryName, replaceSharedMemory);
+    TraceObserver tracer;
+    if (trace) {
+        pc.setObserver(&tracer);
+    }
+    Hypercalls *hypercalls = nullptr;
+    if (!hypercallDirectory.empty()) {
+        hypercalls = new Hypercalls(hypercallDirectory);
+        pc.setHypercalls(hypercalls);
+    }
+    // or watch particular memory locations, which costs nothing elsewhere:
+    //WatchPrinter watcher;
+    //pc.setWatchListener(&watcher);
+    //pc.watch(0x415, 1, WATCH_READ | WATCH_WRITE);
     //pc.loadBIOS("BIOS/Original5150/BIOS_5150_24APR81_U33.BIN");
     //pc.loadBIOS("BIOS/5150_2764_DIAG.bin");
     pc.loadBIOS("BIOS/pcxtbios.bin");
     pc.loadCasetteBASIC("CasetteBASIC/5150cb10_1.bin", "CasetteBASIC/5150cb10_2.bin", "CasetteBASIC/5150cb10_3.bin", "CasetteBASIC/5150cb10_4.bin");
     pc.run();
     
-    return 0;
+    int status = 0;
+    if (hypercalls != nullptr) {
+        status = hypercalls->exitStatus();
+        delete hypercalls;
+    }
+    return status;
 }